@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "chess_constants.h"
+#include "bitboard.h"
+#include "slider_attacks.h"
+#include "hash.h"
+#include "perf_counters.h"
+
+// Micro-benchmarks for the bitboard kernels.  Each kernel is calibrated so one sample takes at least
+// BENCH_MIN_SAMPLE_CYCLES, run for a few warmup samples, then timed over a number of samples.  The median and 95th
+// percentile per operation are reported in rdtsc ticks and ns.  Results can be saved to a baseline file and later runs
+// compared against it; a kernel whose median is more than --threshold percent slower than its baseline is flagged as a
+// regression and the program exits non-zero.
+//
+// Numbers from a build without NDEBUG include VALIDATE_BITBOARD_EACH_STEP and the asserts, so configure with
+// -DCMAKE_BUILD_TYPE=Release before comparing against anything.
+
+#define BENCH_DEFAULT_SAMPLES 31
+#define BENCH_DEFAULT_WARMUP 5
+#define BENCH_DEFAULT_THRESHOLD 5.0
+#define BENCH_MIN_SAMPLE_CYCLES 2000000ul
+#define BENCH_MAX_SAMPLES 1000
+#define BENCH_MAX_KERNELS 64
+
+#define FEN_OPENING "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define FEN_MIDDLEGAME "1r1q1rk1/2p1bppp/p5b1/3pP3/Bn1Pn3/2N1BN1P/1P2QPP1/R2R2K1 w - - 0 1"
+#define FEN_ENDGAME "r2r4/pp3p2/4bkpp/8/7P/3B1P2/PP4P1/1K1R3R b - - 0 1"
+#define FEN_IN_CHECK "rnbqkbnr/ppp2ppp/8/1B1pp3/4P3/8/PPPP1PPP/RNBQK1NR b KQkq - 1 3"
+#define FEN_PROMOTION "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1"
+#define FEN_KIWIPETE "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"
+
+// Each kernel runs its operation reps times against the board and returns how many operations that was.
+typedef long (*benchFunction)(struct bitChessBoard *pbb, long reps);
+
+typedef struct benchKernel {
+    const char *name;
+    const char *fen;
+    benchFunction run;
+} benchKernel;
+
+typedef struct benchResult {
+    char name[64];
+    long ops_per_sample;
+    double median_cycles;
+    double p95_cycles;
+    double median_ns;
+    double p95_ns;
+} benchResult;
+
+// results are folded into this so the compiler cannot throw the kernels away
+volatile uint_64 bench_sink;
+
+
+static inline uint_64 rdtsc() {
+    // copyright (C) AJ Siemelink
+    unsigned int hi, lo;
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((((uint_64)(hi))<<32)|lo);
+}
+
+static inline double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+static long bench_movegen(struct bitChessBoard *pbb, long reps)
+{
+    struct bitMoveList ml;
+    uint_64 sum = 0;
+    long i;
+
+    for (i = 0; i < reps; i++) {
+        generate_bb_move_list(pbb, &ml);
+        sum += ml.size;
+    }
+    bench_sink += sum;
+    return reps;
+}
+
+static long bench_make_unmake(struct bitChessBoard *pbb, long reps)
+{
+    struct bitMoveList ml;
+    struct bitChessBoardAttrs pa;
+    Move moves[MAX_MOVELIST_SIZE];
+    uint_64 sum = 0;
+    long i;
+    int j;
+
+    // expanded once up front, so only make and unmake are timed
+    generate_bb_move_list(pbb, &ml);
+    for (j = 0; j < ml.size; j++) {
+        moves[j] = expand_compact_move(pbb, ml.moves[j]);
+    }
+    for (i = 0; i < reps; i++) {
+        for (j = 0; j < ml.size; j++) {
+            store_bb_attrs(pbb, &pa);
+            apply_bb_move(pbb, moves[j]);
+            sum += pbb->piece_boards[ALL_PIECES];
+            undo_bb_move(pbb, moves[j], &pa);
+        }
+    }
+    bench_sink += sum;
+    return reps * ml.size;
+}
+
+// Plain perft without the perft cache - make, unmake and movegen together, as the search sees them.
+static uint_64 bench_perft_nodes(struct bitChessBoard *pbb, int depth)
+{
+    struct bitMoveList ml;
+    struct bitChessBoardAttrs pa;
+    uint_64 nodes = 0;
+    Move m;
+    int i;
+
+    generate_bb_move_list(pbb, &ml);
+    if (depth == 1) {
+        return ml.size;
+    }
+    for (i = 0; i < ml.size; i++) {
+        m = expand_compact_move(pbb, ml.moves[i]);
+        store_bb_attrs(pbb, &pa);
+        apply_bb_move(pbb, m);
+        nodes += bench_perft_nodes(pbb, depth - 1);
+        undo_bb_move(pbb, m, &pa);
+    }
+    return nodes;
+}
+
+static long bench_perft(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 sum = 0;
+    long i;
+
+    for (i = 0; i < reps; i++) {
+        sum += bench_perft_nodes(pbb, 3);
+    }
+    bench_sink += sum;
+    return reps;
+}
+
+static long bench_hash(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 sum = 0;
+    long i;
+
+    for (i = 0; i < reps; i++) {
+        sum ^= compute_bitboard_hash(pbb);
+    }
+    bench_sink += sum;
+    return reps;
+}
+
+// the occupancy is scrambled each pass so the lookups do not all hit the same table entries
+static long bench_rmagic(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 occupancy = pbb->piece_boards[ALL_PIECES];
+    uint_64 sum = 0;
+    long i;
+    int sq;
+
+    for (i = 0; i < reps; i++) {
+        for (sq = 0; sq < 64; sq++) {
+            sum ^= Rmagic(sq, occupancy);
+        }
+        occupancy ^= occupancy << 13;
+        occupancy ^= occupancy >> 7;
+        occupancy ^= occupancy << 17;
+    }
+    bench_sink += sum;
+    return reps * 64;
+}
+
+static long bench_bmagic(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 occupancy = pbb->piece_boards[ALL_PIECES];
+    uint_64 sum = 0;
+    long i;
+    int sq;
+
+    for (i = 0; i < reps; i++) {
+        for (sq = 0; sq < 64; sq++) {
+            sum ^= Bmagic(sq, occupancy);
+        }
+        occupancy ^= occupancy << 13;
+        occupancy ^= occupancy >> 7;
+        occupancy ^= occupancy << 17;
+    }
+    bench_sink += sum;
+    return reps * 64;
+}
+
+// Each lookup's occupancy depends on the previous result, so the lookups cannot overlap and the time per op is the
+// latency of one lookup rather than the throughput the two kernels above measure.
+static long bench_rmagic_latency(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 occupancy = pbb->piece_boards[ALL_PIECES];
+    long i;
+    int sq;
+
+    for (i = 0; i < reps; i++) {
+        for (sq = 0; sq < 64; sq++) {
+            occupancy ^= Rmagic(sq, occupancy) & 0x007e7e7e7e7e7e00ul;
+        }
+    }
+    bench_sink += occupancy;
+    return reps * 64;
+}
+
+static long bench_bmagic_latency(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 occupancy = pbb->piece_boards[ALL_PIECES];
+    long i;
+    int sq;
+
+    for (i = 0; i < reps; i++) {
+        for (sq = 0; sq < 64; sq++) {
+            occupancy ^= Bmagic(sq, occupancy) & 0x007e7e7e7e7e7e00ul;
+        }
+    }
+    bench_sink += occupancy;
+    return reps * 64;
+}
+
+static long bench_pinned_list(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 sum = 0;
+    long i;
+
+    for (i = 0; i < reps; i++) {
+        sum += generate_bb_pinned_list(pbb, pbb->wk_pos, WHITE, BLACK);
+        sum += generate_bb_pinned_list(pbb, pbb->bk_pos, BLACK, WHITE);
+    }
+    bench_sink += sum;
+    return reps * 2;
+}
+
+static long bench_attacked_squares(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 sum = 0;
+    long i;
+
+    for (i = 0; i < reps; i++) {
+        sum += get_bb_attacked_squares(pbb, WHITE);
+        sum += get_bb_attacked_squares(pbb, BLACK);
+    }
+    bench_sink += sum;
+    return reps * 2;
+}
+
+// the sliders of both sides, as get_bb_attacked_squares() would do them
+static long bench_slider_attacks_magic(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 occupied = pbb->piece_boards[ALL_PIECES];
+    uint_64 sum = 0;
+    long i;
+
+    for (i = 0; i < reps; i++) {
+        sum += bb_slider_attacks_magic(pbb->piece_boards[WR] | pbb->piece_boards[WQ], pbb->piece_boards[WB] | pbb->piece_boards[WQ], occupied);
+        sum += bb_slider_attacks_magic(pbb->piece_boards[BR] | pbb->piece_boards[BQ], pbb->piece_boards[BB] | pbb->piece_boards[BQ], occupied);
+    }
+    bench_sink += sum;
+    return reps * 2;
+}
+
+#ifdef __AVX2__
+static long bench_slider_attacks_avx2(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 occupied = pbb->piece_boards[ALL_PIECES];
+    uint_64 sum = 0;
+    long i;
+
+    for (i = 0; i < reps; i++) {
+        sum += bb_slider_attacks_avx2(pbb->piece_boards[WR] | pbb->piece_boards[WQ], pbb->piece_boards[WB] | pbb->piece_boards[WQ], occupied);
+        sum += bb_slider_attacks_avx2(pbb->piece_boards[BR] | pbb->piece_boards[BQ], pbb->piece_boards[BB] | pbb->piece_boards[BQ], occupied);
+    }
+    bench_sink += sum;
+    return reps * 2;
+}
+#endif
+
+static long bench_attackers_of_square(struct bitChessBoard *pbb, long reps)
+{
+    uint_64 sum = 0;
+    long i;
+    int sq;
+
+    for (i = 0; i < reps; i++) {
+        for (sq = 0; sq < 64; sq++) {
+            sum += get_bb_attackers_of_square(pbb, sq, WHITE);
+        }
+    }
+    bench_sink += sum;
+    return reps * 64;
+}
+
+static const struct benchKernel KERNELS[] = {
+    {"movegen_opening",         FEN_OPENING,    bench_movegen},
+    {"movegen_middlegame",      FEN_MIDDLEGAME, bench_movegen},
+    {"movegen_endgame",         FEN_ENDGAME,    bench_movegen},
+    {"movegen_in_check",        FEN_IN_CHECK,   bench_movegen},
+    {"movegen_promotion",       FEN_PROMOTION,  bench_movegen},
+    {"movegen_kiwipete",        FEN_KIWIPETE,   bench_movegen},
+    {"make_unmake_kiwipete",    FEN_KIWIPETE,   bench_make_unmake},
+    {"make_unmake_promotion",   FEN_PROMOTION,  bench_make_unmake},
+    {"perft3_opening",          FEN_OPENING,    bench_perft},
+    {"perft3_kiwipete",         FEN_KIWIPETE,   bench_perft},
+    {"compute_bitboard_hash",   FEN_MIDDLEGAME, bench_hash},
+    {"rmagic",                  FEN_MIDDLEGAME, bench_rmagic},
+    {"bmagic",                  FEN_MIDDLEGAME, bench_bmagic},
+    {"rmagic_latency",          FEN_MIDDLEGAME, bench_rmagic_latency},
+    {"bmagic_latency",          FEN_MIDDLEGAME, bench_bmagic_latency},
+    {"pinned_list",             FEN_KIWIPETE,   bench_pinned_list},
+    {"attacked_squares",        FEN_MIDDLEGAME, bench_attacked_squares},
+    {"slider_attacks_magic",    FEN_MIDDLEGAME, bench_slider_attacks_magic},
+    {"slider_attacks_magic_kp", FEN_KIWIPETE,   bench_slider_attacks_magic},
+#ifdef __AVX2__
+    {"slider_attacks_avx2",     FEN_MIDDLEGAME, bench_slider_attacks_avx2},
+    {"slider_attacks_avx2_kp",  FEN_KIWIPETE,   bench_slider_attacks_avx2},
+#endif
+    {"attackers_of_square",     FEN_MIDDLEGAME, bench_attackers_of_square},
+};
+#define NUM_KERNELS (int)(sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of a sorted array
+static double percentile(const double *sorted, int n, double pct)
+{
+    int rank = (int)(pct / 100.0 * n + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > n) {
+        rank = n;
+    }
+    return sorted[rank - 1];
+}
+
+static void run_kernel(const struct benchKernel *k, int samples, int warmup, struct benchResult *res)
+{
+    struct bitChessBoard bb;
+    double cycles[BENCH_MAX_SAMPLES], ns[BENCH_MAX_SAMPLES];
+    uint_64 start_ticks, stop_ticks;
+    double start_ns, stop_ns;
+    long reps = 1, ops = 0;
+    int i;
+
+    load_bitboard_from_fen(&bb, k->fen);
+
+    // calibrate - double the repetitions until one sample is long enough to time
+    for (;;) {
+        start_ticks = rdtsc();
+        ops = k->run(&bb, reps);
+        stop_ticks = rdtsc();
+        if (stop_ticks - start_ticks >= BENCH_MIN_SAMPLE_CYCLES) {
+            break;
+        }
+        reps *= 2;
+    }
+
+    for (i = 0; i < warmup; i++) {
+        k->run(&bb, reps);
+    }
+
+    PERF_COUNTERS_RESET();
+    for (i = 0; i < samples; i++) {
+        start_ns = now_ns();
+        start_ticks = rdtsc();
+        PERF_REGION_BEGIN(PERF_REGION_KERNEL);
+        k->run(&bb, reps);
+        PERF_REGION_END(PERF_REGION_KERNEL);
+        stop_ticks = rdtsc();
+        stop_ns = now_ns();
+        cycles[i] = (double)(stop_ticks - start_ticks) / ops;
+        ns[i] = (stop_ns - start_ns) / ops;
+    }
+
+    PERF_COUNTERS_REPORT(stderr, k->name, (uint_64) ops * samples);
+
+    qsort(cycles, samples, sizeof(double), compare_doubles);
+    qsort(ns, samples, sizeof(double), compare_doubles);
+
+    snprintf(res->name, sizeof(res->name), "%s", k->name);
+    res->ops_per_sample = ops;
+    res->median_cycles = percentile(cycles, samples, 50.0);
+    res->p95_cycles = percentile(cycles, samples, 95.0);
+    res->median_ns = percentile(ns, samples, 50.0);
+    res->p95_ns = percentile(ns, samples, 95.0);
+}
+
+// Baseline file: one line per kernel - name, median ticks, p95 ticks, median ns, p95 ns.  Lines starting with # are comments.
+static int load_baseline(const char *filename, struct benchResult *baseline)
+{
+    FILE *f;
+    char line[256];
+    int n = 0;
+
+    f = fopen(filename, "r");
+    if (!f) {
+        return -1;
+    }
+    while (n < BENCH_MAX_KERNELS && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%63s %lf %lf %lf %lf", baseline[n].name, &baseline[n].median_cycles, &baseline[n].p95_cycles,
+                   &baseline[n].median_ns, &baseline[n].p95_ns) == 5) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static bool save_baseline(const char *filename, const struct benchResult *results, int n)
+{
+    FILE *f;
+    int i;
+
+    f = fopen(filename, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "# kernel median_ticks p95_ticks median_ns p95_ns\n");
+    for (i = 0; i < n; i++) {
+        fprintf(f, "%s %.3f %.3f %.3f %.3f\n", results[i].name, results[i].median_cycles, results[i].p95_cycles,
+                results[i].median_ns, results[i].p95_ns);
+    }
+    fclose(f);
+    return true;
+}
+
+static const struct benchResult *find_baseline(const struct benchResult *baseline, int n, const char *name)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (!strcmp(baseline[i].name, name)) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  --samples N          timed samples per kernel (default %d, max %d)\n", BENCH_DEFAULT_SAMPLES, BENCH_MAX_SAMPLES);
+    printf("  --warmup N           untimed samples per kernel (default %d)\n", BENCH_DEFAULT_WARMUP);
+    printf("  --filter TEXT        only run kernels whose name contains TEXT\n");
+    printf("  --baseline FILE      compare against a saved baseline\n");
+    printf("  --save-baseline FILE write the results as a new baseline\n");
+    printf("  --threshold PCT      slowdown in the median that counts as a regression (default %.1f)\n", BENCH_DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"samples",       required_argument, NULL, 's'},
+        {"warmup",        required_argument, NULL, 'w'},
+        {"filter",        required_argument, NULL, 'f'},
+        {"baseline",      required_argument, NULL, 'b'},
+        {"save-baseline", required_argument, NULL, 'o'},
+        {"threshold",     required_argument, NULL, 't'},
+        {"help",          no_argument,       NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+    struct benchResult results[NUM_KERNELS];
+    struct benchResult baseline[BENCH_MAX_KERNELS];
+    const struct benchResult *base;
+    const char *filter = NULL, *baseline_file = NULL, *save_file = NULL;
+    int samples = BENCH_DEFAULT_SAMPLES, warmup = BENCH_DEFAULT_WARMUP;
+    double threshold = BENCH_DEFAULT_THRESHOLD, change;
+    int num_baseline = 0, num_results = 0, regressions = 0;
+    int c, i;
+
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (c) {
+            case 's':
+                samples = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'b':
+                baseline_file = optarg;
+                break;
+            case 'o':
+                save_file = optarg;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (samples < 1 || samples > BENCH_MAX_SAMPLES || warmup < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (baseline_file) {
+        num_baseline = load_baseline(baseline_file, baseline);
+        if (num_baseline < 0) {
+            fprintf(stderr, "Could not read baseline %s\n", baseline_file);
+            return 2;
+        }
+    }
+
+    PERF_COUNTERS_INIT();
+#ifndef NDEBUG
+    printf("NOTE: assertions and board validation are enabled, build with -DCMAKE_BUILD_TYPE=Release for real numbers\n");
+#endif
+
+    printf("slider backend %s, %zu KB of attack tables\n", SLIDER_BACKEND_NAME, SLIDER_TABLE_BYTES / 1024);
+    printf("%-24s %12s %12s %12s %12s %10s\n", "kernel", "med ticks", "p95 ticks", "med ns", "p95 ns", "vs base");
+    for (i = 0; i < NUM_KERNELS; i++) {
+        if (filter && !strstr(KERNELS[i].name, filter)) {
+            continue;
+        }
+        run_kernel(&KERNELS[i], samples, warmup, &results[num_results]);
+        printf("%-24s %12.2f %12.2f %12.2f %12.2f", results[num_results].name, results[num_results].median_cycles,
+               results[num_results].p95_cycles, results[num_results].median_ns, results[num_results].p95_ns);
+
+        base = find_baseline(baseline, num_baseline, results[num_results].name);
+        if (base && base->median_cycles > 0) {
+            change = (results[num_results].median_cycles / base->median_cycles - 1.0) * 100.0;
+            printf(" %+9.1f%%", change);
+            if (change > threshold) {
+                printf("  REGRESSION");
+                regressions++;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+        num_results++;
+    }
+
+    if (save_file && !save_baseline(save_file, results, num_results)) {
+        fprintf(stderr, "Could not write baseline %s\n", save_file);
+        return 2;
+    }
+    PERF_COUNTERS_DESTROY();
+    if (regressions) {
+        printf("%d kernel(s) regressed by more than %.1f%%\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -3,205 +3,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "hash.h"
-#include "magicmoves.h"
-
-// SQUARE_MASKS\[(\w*)\]
-// SQUARE_MASKS2($1)
-
-const uint_64 SQUARE_MASKS[64] = {
-        0x1ull, 0x2ull, 0x4ull, 0x8ull,
-        0x10ull, 0x20ull, 0x40ull, 0x80ull,
-        0x100ull, 0x200ull, 0x400ull, 0x800ull,
-        0x1000ull, 0x2000ull, 0x4000ull, 0x8000ull,
-        0x10000ull, 0x20000ull, 0x40000ull, 0x80000ull,
-        0x100000ull, 0x200000ull, 0x400000ull, 0x800000ull,
-        0x1000000ull, 0x2000000ull, 0x4000000ull, 0x8000000ull,
-        0x10000000ull, 0x20000000ull, 0x40000000ull, 0x80000000ull,
-        0x100000000ull, 0x200000000ull, 0x400000000ull, 0x800000000ull,
-        0x1000000000ull, 0x2000000000ull, 0x4000000000ull, 0x8000000000ull,
-        0x10000000000ull, 0x20000000000ull, 0x40000000000ull, 0x80000000000ull,
-        0x100000000000ull, 0x200000000000ull, 0x400000000000ull, 0x800000000000ull,
-        0x1000000000000ull, 0x2000000000000ull, 0x4000000000000ull, 0x8000000000000ull,
-        0x10000000000000ull, 0x20000000000000ull, 0x40000000000000ull, 0x80000000000000ull,
-        0x100000000000000ull, 0x200000000000000ull, 0x400000000000000ull, 0x800000000000000ull,
-        0x1000000000000000ull, 0x2000000000000000ull, 0x4000000000000000ull, 0x8000000000000000ull
-};
+#include "evaluate_board.h"
+#include "slider_attacks.h"
 
+// The masks, move tables, squares between and lines through are generated at build time, see
+// bitboard_constant_generation.c
+#include "bitboard_tables.h"
 
-const uint_64 NOT_MASKS[64] = {
-        0xfffffffffffffffeull, 0xfffffffffffffffdull, 0xfffffffffffffffbull, 0xfffffffffffffff7ull,
-        0xffffffffffffffefull, 0xffffffffffffffdfull, 0xffffffffffffffbfull, 0xffffffffffffff7full,
-        0xfffffffffffffeffull, 0xfffffffffffffdffull, 0xfffffffffffffbffull, 0xfffffffffffff7ffull,
-        0xffffffffffffefffull, 0xffffffffffffdfffull, 0xffffffffffffbfffull, 0xffffffffffff7fffull,
-        0xfffffffffffeffffull, 0xfffffffffffdffffull, 0xfffffffffffbffffull, 0xfffffffffff7ffffull,
-        0xffffffffffefffffull, 0xffffffffffdfffffull, 0xffffffffffbfffffull, 0xffffffffff7fffffull,
-        0xfffffffffeffffffull, 0xfffffffffdffffffull, 0xfffffffffbffffffull, 0xfffffffff7ffffffull,
-        0xffffffffefffffffull, 0xffffffffdfffffffull, 0xffffffffbfffffffull, 0xffffffff7fffffffull,
-        0xfffffffeffffffffull, 0xfffffffdffffffffull, 0xfffffffbffffffffull, 0xfffffff7ffffffffull,
-        0xffffffefffffffffull, 0xffffffdfffffffffull, 0xffffffbfffffffffull, 0xffffff7fffffffffull,
-        0xfffffeffffffffffull, 0xfffffdffffffffffull, 0xfffffbffffffffffull, 0xfffff7ffffffffffull,
-        0xffffefffffffffffull, 0xffffdfffffffffffull, 0xffffbfffffffffffull, 0xffff7fffffffffffull,
-        0xfffeffffffffffffull, 0xfffdffffffffffffull, 0xfffbffffffffffffull, 0xfff7ffffffffffffull,
-        0xffefffffffffffffull, 0xffdfffffffffffffull, 0xffbfffffffffffffull, 0xff7fffffffffffffull,
-        0xfeffffffffffffffull, 0xfdffffffffffffffull, 0xfbffffffffffffffull, 0xf7ffffffffffffffull,
-        0xefffffffffffffffull, 0xdfffffffffffffffull, 0xbfffffffffffffffull, 0x7fffffffffffffffull
-};
-
-
-// Masks to find the edges of the board, or squares not on a given edge.
-// Masks for 2 squares in from an edge, used to compute knight moves
-const uint_64 A_FILE = 0x101010101010101ul;
-const uint_64 B_FILE = 0x202020202020202ul;
-const uint_64 C_FILE = 0x404040404040404ul;
-const uint_64 D_FILE = 0x808080808080808ul;
-const uint_64 E_FILE = 0x1010101010101010ul;
-const uint_64 F_FILE = 0x2020202020202020ul;
-const uint_64 G_FILE = 0x4040404040404040ul;
-const uint_64 H_FILE = 0x8080808080808080ul;
-const uint_64 RANK_1 = 0xfful;
-const uint_64 RANK_2 = 0xff00ul;
-const uint_64 RANK_3 = 0xff0000ul;
-const uint_64 RANK_4 = 0xff000000ul;
-const uint_64 RANK_5 = 0xff00000000ul;
-const uint_64 RANK_6 = 0xff0000000000ul;
-const uint_64 RANK_7 = 0xff000000000000ul;
-const uint_64 RANK_8 = 0xff00000000000000ul;
-const uint_64 NOT_A_FILE = 0xfefefefefefefefeul;
-const uint_64 NOT_B_FILE = 0xfdfdfdfdfdfdfdfdul;
-const uint_64 NOT_G_FILE = 0xbfbfbfbfbfbfbfbful;
-const uint_64 NOT_H_FILE = 0x7f7f7f7f7f7f7f7ful;
-const uint_64 NOT_RANK_1 = 0xffffffffffffff00ul;
-const uint_64 NOT_RANK_2 = 0xffffffffffff00fful;
-const uint_64 NOT_RANK_7 = 0xff00fffffffffffful;
-const uint_64 NOT_RANK_8 = 0xfffffffffffffful;
-const uint_64 ON_AN_EDGE = 0xff818181818181fful;
-const uint_64 NOT_ANY_EDGE = 0x7e7e7e7e7e7e00ul;
 const uint_64 MOVE_CHECK_SHIFTED = 0x400000000000000ul;
 
-
-// Masks for use in move generation
-const uint_64 KNIGHT_MOVES[64] = {
-        0x20400ull, 0x50800ull, 0xa1100ull, 0x142200ull,
-        0x284400ull, 0x508800ull, 0xa01000ull, 0x402000ull,
-        0x2040004ull, 0x5080008ull, 0xa110011ull, 0x14220022ull,
-        0x28440044ull, 0x50880088ull, 0xa0100010ull, 0x40200020ull,
-        0x204000402ull, 0x508000805ull, 0xa1100110aull, 0x1422002214ull,
-        0x2844004428ull, 0x5088008850ull, 0xa0100010a0ull, 0x4020002040ull,
-        0x20400040200ull, 0x50800080500ull, 0xa1100110a00ull, 0x142200221400ull,
-        0x284400442800ull, 0x508800885000ull, 0xa0100010a000ull, 0x402000204000ull,
-        0x2040004020000ull, 0x5080008050000ull, 0xa1100110a0000ull, 0x14220022140000ull,
-        0x28440044280000ull, 0x50880088500000ull, 0xa0100010a00000ull, 0x40200020400000ull,
-        0x204000402000000ull, 0x508000805000000ull, 0xa1100110a000000ull, 0x1422002214000000ull,
-        0x2844004428000000ull, 0x5088008850000000ull, 0xa0100010a0000000ull, 0x4020002040000000ull,
-        0x400040200000000ull, 0x800080500000000ull, 0x1100110a00000000ull, 0x2200221400000000ull,
-        0x4400442800000000ull, 0x8800885000000000ull, 0x100010a000000000ull, 0x2000204000000000ull,
-        0x4020000000000ull, 0x8050000000000ull, 0x110a0000000000ull, 0x22140000000000ull,
-        0x44280000000000ull, 0x88500000000000ull, 0x10a00000000000ull, 0x20400000000000ull
-};
-
-
-const uint_64 KING_MOVES[64] = {
-        0x302ull, 0x705ull, 0xe0aull, 0x1c14ull,
-        0x3828ull, 0x7050ull, 0xe0a0ull, 0xc040ull,
-        0x30203ull, 0x70507ull, 0xe0a0eull, 0x1c141cull,
-        0x382838ull, 0x705070ull, 0xe0a0e0ull, 0xc040c0ull,
-        0x3020300ull, 0x7050700ull, 0xe0a0e00ull, 0x1c141c00ull,
-        0x38283800ull, 0x70507000ull, 0xe0a0e000ull, 0xc040c000ull,
-        0x302030000ull, 0x705070000ull, 0xe0a0e0000ull, 0x1c141c0000ull,
-        0x3828380000ull, 0x7050700000ull, 0xe0a0e00000ull, 0xc040c00000ull,
-        0x30203000000ull, 0x70507000000ull, 0xe0a0e000000ull, 0x1c141c000000ull,
-        0x382838000000ull, 0x705070000000ull, 0xe0a0e0000000ull, 0xc040c0000000ull,
-        0x3020300000000ull, 0x7050700000000ull, 0xe0a0e00000000ull, 0x1c141c00000000ull,
-        0x38283800000000ull, 0x70507000000000ull, 0xe0a0e000000000ull, 0xc040c000000000ull,
-        0x302030000000000ull, 0x705070000000000ull, 0xe0a0e0000000000ull, 0x1c141c0000000000ull,
-        0x3828380000000000ull, 0x7050700000000000ull, 0xe0a0e00000000000ull, 0xc040c00000000000ull,
-        0x203000000000000ull, 0x507000000000000ull, 0xa0e000000000000ull, 0x141c000000000000ull,
-        0x2838000000000000ull, 0x5070000000000000ull, 0xa0e0000000000000ull, 0x40c0000000000000ull
-};
-
-const uint_64 SLIDER_MOVES[64] = {
-        0x1010101010101feull, 0x2020202020202fdull, 0x4040404040404fbull, 0x8080808080808f7ull,
-        0x10101010101010efull, 0x20202020202020dfull, 0x40404040404040bfull, 0x808080808080807full,
-        0x10101010101fe01ull, 0x20202020202fd02ull, 0x40404040404fb04ull, 0x80808080808f708ull,
-        0x101010101010ef10ull, 0x202020202020df20ull, 0x404040404040bf40ull, 0x8080808080807f80ull,
-        0x101010101fe0101ull, 0x202020202fd0202ull, 0x404040404fb0404ull, 0x808080808f70808ull,
-        0x1010101010ef1010ull, 0x2020202020df2020ull, 0x4040404040bf4040ull, 0x80808080807f8080ull,
-        0x1010101fe010101ull, 0x2020202fd020202ull, 0x4040404fb040404ull, 0x8080808f7080808ull,
-        0x10101010ef101010ull, 0x20202020df202020ull, 0x40404040bf404040ull, 0x808080807f808080ull,
-        0x10101fe01010101ull, 0x20202fd02020202ull, 0x40404fb04040404ull, 0x80808f708080808ull,
-        0x101010ef10101010ull, 0x202020df20202020ull, 0x404040bf40404040ull, 0x8080807f80808080ull,
-        0x101fe0101010101ull, 0x202fd0202020202ull, 0x404fb0404040404ull, 0x808f70808080808ull,
-        0x1010ef1010101010ull, 0x2020df2020202020ull, 0x4040bf4040404040ull, 0x80807f8080808080ull,
-        0x1fe010101010101ull, 0x2fd020202020202ull, 0x4fb040404040404ull, 0x8f7080808080808ull,
-        0x10ef101010101010ull, 0x20df202020202020ull, 0x40bf404040404040ull, 0x807f808080808080ull,
-        0xfe01010101010101ull, 0xfd02020202020202ull, 0xfb04040404040404ull, 0xf708080808080808ull,
-        0xef10101010101010ull, 0xdf20202020202020ull, 0xbf40404040404040ull, 0x7f80808080808080ull
-};
-
-
-const uint_64 DIAGONAL_MOVES[64] = {
-        0x8040201008040200ull, 0x80402010080500ull, 0x804020110a00ull, 0x8041221400ull,
-        0x182442800ull, 0x10204885000ull, 0x102040810a000ull, 0x102040810204000ull,
-        0x4020100804020002ull, 0x8040201008050005ull, 0x804020110a000aull, 0x804122140014ull,
-        0x18244280028ull, 0x1020488500050ull, 0x102040810a000a0ull, 0x204081020400040ull,
-        0x2010080402000204ull, 0x4020100805000508ull, 0x804020110a000a11ull, 0x80412214001422ull,
-        0x1824428002844ull, 0x102048850005088ull, 0x2040810a000a010ull, 0x408102040004020ull,
-        0x1008040200020408ull, 0x2010080500050810ull, 0x4020110a000a1120ull, 0x8041221400142241ull,
-        0x182442800284482ull, 0x204885000508804ull, 0x40810a000a01008ull, 0x810204000402010ull,
-        0x804020002040810ull, 0x1008050005081020ull, 0x20110a000a112040ull, 0x4122140014224180ull,
-        0x8244280028448201ull, 0x488500050880402ull, 0x810a000a0100804ull, 0x1020400040201008ull,
-        0x402000204081020ull, 0x805000508102040ull, 0x110a000a11204080ull, 0x2214001422418000ull,
-        0x4428002844820100ull, 0x8850005088040201ull, 0x10a000a010080402ull, 0x2040004020100804ull,
-        0x200020408102040ull, 0x500050810204080ull, 0xa000a1120408000ull, 0x1400142241800000ull,
-        0x2800284482010000ull, 0x5000508804020100ull, 0xa000a01008040201ull, 0x4000402010080402ull,
-        0x2040810204080ull, 0x5081020408000ull, 0xa112040800000ull, 0x14224180000000ull,
-        0x28448201000000ull, 0x50880402010000ull, 0xa0100804020100ull, 0x40201008040201ull
-};
-
-const uint_64 WHITE_PAWN_ATTACKSTO[64] = {
-        0x0ull, 0x0ull, 0x0ull, 0x0ull,
-        0x0ull, 0x0ull, 0x0ull, 0x0ull,
-        0x0ull, 0x0ull, 0x0ull, 0x0ull,
-        0x0ull, 0x0ull, 0x0ull, 0x0ull,
-        0x200ull, 0x500ull, 0xa00ull, 0x1400ull,
-        0x2800ull, 0x5000ull, 0xa000ull, 0x4000ull,
-        0x20000ull, 0x50000ull, 0xa0000ull, 0x140000ull,
-        0x280000ull, 0x500000ull, 0xa00000ull, 0x400000ull,
-        0x2000000ull, 0x5000000ull, 0xa000000ull, 0x14000000ull,
-        0x28000000ull, 0x50000000ull, 0xa0000000ull, 0x40000000ull,
-        0x200000000ull, 0x500000000ull, 0xa00000000ull, 0x1400000000ull,
-        0x2800000000ull, 0x5000000000ull, 0xa000000000ull, 0x4000000000ull,
-        0x20000000000ull, 0x50000000000ull, 0xa0000000000ull, 0x140000000000ull,
-        0x280000000000ull, 0x500000000000ull, 0xa00000000000ull, 0x400000000000ull,
-        0x2000000000000ull, 0x5000000000000ull, 0xa000000000000ull, 0x14000000000000ull,
-        0x28000000000000ull, 0x50000000000000ull, 0xa0000000000000ull, 0x40000000000000ull
-};
-const uint_64 BLACK_PAWN_ATTACKSTO[64] = {
-        0x200ull, 0x500ull, 0xa00ull, 0x1400ull,
-        0x2800ull, 0x5000ull, 0xa000ull, 0x4000ull,
-        0x20000ull, 0x50000ull, 0xa0000ull, 0x140000ull,
-        0x280000ull, 0x500000ull, 0xa00000ull, 0x400000ull,
-        0x2000000ull, 0x5000000ull, 0xa000000ull, 0x14000000ull,
-        0x28000000ull, 0x50000000ull, 0xa0000000ull, 0x40000000ull,
-        0x200000000ull, 0x500000000ull, 0xa00000000ull, 0x1400000000ull,
-        0x2800000000ull, 0x5000000000ull, 0xa000000000ull, 0x4000000000ull,
-        0x20000000000ull, 0x50000000000ull, 0xa0000000000ull, 0x140000000000ull,
-        0x280000000000ull, 0x500000000000ull, 0xa00000000000ull, 0x400000000000ull,
-        0x2000000000000ull, 0x5000000000000ull, 0xa000000000000ull, 0x14000000000000ull,
-        0x28000000000000ull, 0x50000000000000ull, 0xa0000000000000ull, 0x40000000000000ull,
-        0x0ull, 0x0ull, 0x0ull, 0x0ull,
-        0x0ull, 0x0ull, 0x0ull, 0x0ull,
-        0x0ull, 0x0ull, 0x0ull, 0x0ull,
-        0x0ull, 0x0ull, 0x0ull, 0x0ull
-};
-
-// Given a From and a To location, identify all the squares between them, if the squares share a rank, file, diagonal, or anti-diagonal
-static uint_64 SQUARES_BETWEEN[64][64];  // too big to justify making a constant;
-// Given a From and To location, draw a line from edge to edge through those two squares, if the squares share rank, file, diag, or anti-diag
-static uint_64 LINES_THROUGH[64][64];
-
 // Idea taking from FRC-Perft - for each start square, we have the masks that we would apply to the castling
 // mask - makes it much easier to just do one operation as oppose to testing to see if King or Rook moved.
 // Concept - pbb->castling &= castle_move_mask[start].
@@ -219,170 +34,27 @@ static const int castle_move_mask[64] =
 
 // Similar - mask for the squares that need to be empty in order for castle to be valid, saves multiple adds/lookups at movegen time.
 // it is an 8 by 2 array, So we can use color_moving as the index (choices are 0 and 8).
-static uint_64 castle_empty_square_mask[9][2];
-static uint_64 castle_safe_square_mask[9][2];
+static const uint_64 castle_empty_square_mask[9][2] = {
+    [WHITE] = {(1ul << F1) | (1ul << G1), (1ul << B1) | (1ul << C1) | (1ul << D1)},
+    [BLACK] = {(1ul << F8) | (1ul << G8), (1ul << B8) | (1ul << C8) | (1ul << D8)}
+};
+static const uint_64 castle_safe_square_mask[9][2] = {
+    [WHITE] = {(1ul << E1) | (1ul << F1) | (1ul << G1), (1ul << E1) | (1ul << D1) | (1ul << C1)},
+    [BLACK] = {(1ul << E8) | (1ul << F8) | (1ul << G8), (1ul << E8) | (1ul << D8) | (1ul << C8)}
+};
 
-static uint_64 checkmask;
-static uint_64 notcheckmask;
+static const uint_64 checkmask = CREATE_BB_MOVE(0, 0, 0, 0, MOVE_CHECK);
 static const int opposite_color[9] = {BLACK,0,0,0,0,0,0,0,WHITE}; // quick lookup to get the other color, may be faster than color ^ BLACK;
-static uint_64 kcastle_move_masks[9][3];
-static uint_64 qcastle_move_masks[9][3];
-
-
-
-bool const_bitmask_init()
-{
-    int i,j, c;
-    uint_64 cursquare;
-
-    initmagicmoves();
-    // Most code moved to bitboard_constant_generation.c
-
-    checkmask = CREATE_BB_MOVE(0, 0, 0, 0, MOVE_CHECK);
-    notcheckmask = ~checkmask;
-
-
-    // TODO - we are only using the [1] of these, so get rid of the [0] and the [2] for memory optimization
-    memset(kcastle_move_masks, 0, sizeof(kcastle_move_masks));
-    memset(qcastle_move_masks, 0, sizeof(qcastle_move_masks));
-
-    kcastle_move_masks[WHITE][0] = SQUARE_MASKS[E1] | SQUARE_MASKS[G1];
-    kcastle_move_masks[WHITE][1] = SQUARE_MASKS[F1] | SQUARE_MASKS[H1];
-    kcastle_move_masks[WHITE][2] = kcastle_move_masks[WHITE][0] | kcastle_move_masks[WHITE][1];
-
-    kcastle_move_masks[BLACK][0] = SQUARE_MASKS[E8] | SQUARE_MASKS[G8];
-    kcastle_move_masks[BLACK][1] = SQUARE_MASKS[F8] | SQUARE_MASKS[H8];
-    kcastle_move_masks[BLACK][2] = kcastle_move_masks[BLACK][0] | kcastle_move_masks[BLACK][1];
-
-
-    qcastle_move_masks[WHITE][0] = SQUARE_MASKS[E1] | SQUARE_MASKS[C1];
-    qcastle_move_masks[WHITE][1] = SQUARE_MASKS[A1] | SQUARE_MASKS[D1];
-    qcastle_move_masks[WHITE][2] = qcastle_move_masks[WHITE][0] | qcastle_move_masks[WHITE][1];
-
-    qcastle_move_masks[BLACK][0] = SQUARE_MASKS[E8] | SQUARE_MASKS[C8];
-    qcastle_move_masks[BLACK][1] = SQUARE_MASKS[A8] | SQUARE_MASKS[D8];
-    qcastle_move_masks[BLACK][2] = qcastle_move_masks[BLACK][0] | qcastle_move_masks[BLACK][1];
-
-    castle_empty_square_mask[WHITE][0] = SQUARE_MASKS[F1] | SQUARE_MASKS[G1];
-    castle_empty_square_mask[WHITE][1] = SQUARE_MASKS[B1] | SQUARE_MASKS[C1] | SQUARE_MASKS[D1];
-    castle_empty_square_mask[BLACK][0] = SQUARE_MASKS[F8] | SQUARE_MASKS[G8];
-    castle_empty_square_mask[BLACK][1] = SQUARE_MASKS[B8] | SQUARE_MASKS[C8] | SQUARE_MASKS[D8];
-
-    castle_safe_square_mask[WHITE][0] = SQUARE_MASKS[E1] | SQUARE_MASKS[F1] | SQUARE_MASKS[G1];
-    castle_safe_square_mask[WHITE][1] = SQUARE_MASKS[E1] | SQUARE_MASKS[D1] | SQUARE_MASKS[C1];
-    castle_safe_square_mask[BLACK][0] = SQUARE_MASKS[E8] | SQUARE_MASKS[F8] | SQUARE_MASKS[G8];
-    castle_safe_square_mask[BLACK][1] = SQUARE_MASKS[E8] | SQUARE_MASKS[D8] | SQUARE_MASKS[C8];
-
-    uint_64 ranks[8] = {RANK_1, RANK_2, RANK_3, RANK_4, RANK_5, RANK_6, RANK_7, RANK_8};
-    uint_64 files[8] = {A_FILE, B_FILE, C_FILE, D_FILE, E_FILE, F_FILE, G_FILE, H_FILE};
-    uint_64 cur_diagonal, cur_antidiagonal;
-
-
-    for (i=0; i<64; i++){
-        for (j=0;j<64;j ++) {
-            SQUARES_BETWEEN[i][j] = 0; // initialize
-            LINES_THROUGH[j][i] = 0;
-        }
-    }
-
-    for (i=0; i<64; i++) {
-
-        if (i < 48) {
-            j = i + 16;
-            while (j < 64) {
-                for (c = i + 8; c < j; c += 8) {
-                    SQUARES_BETWEEN[i][j] |= SQUARE_MASKS[c];
-                    SQUARES_BETWEEN[j][i] |= SQUARE_MASKS[c];
-                }
-                j+=8;
-            }
-        }
-        if ((i % 8) <= 5) {
-            j = i + 2;
-            while ((j < 64) && (j%8 != 0)) {
-                for (c=i+1; c < j; c++) {
-                    SQUARES_BETWEEN[i][j] |= SQUARE_MASKS[c];
-                    SQUARES_BETWEEN[j][i] |= SQUARE_MASKS[c];
-                }
-                j++;
-            }
-        }
-        if (!(SQUARE_MASKS[i] & (G_FILE | H_FILE))) {
-            j = i + 18;
-            while((j<64) && (j%8 !=0)) {
-                for (c=i+9; c<j; c+=9) {
-                    SQUARES_BETWEEN[j][i] |= SQUARE_MASKS[c];
-                    SQUARES_BETWEEN[i][j] |= SQUARE_MASKS[c];
-                }
-                j+=9;
-            }
-        }
-        if (!(SQUARE_MASKS[i] & (A_FILE | B_FILE))) {
-            j = i + 14;
-            while((j<64) && (j%8 != 7)) {
-                for (c=i+7; c<j; c+=7) {
-                    SQUARES_BETWEEN[i][j] |= SQUARE_MASKS[c];
-                    SQUARES_BETWEEN[j][i] |= SQUARE_MASKS[c];
-                }
-                j+=7;
-            }
-
-        }
-    }
-
-    // TODO we never validated that this computes correctly
-    for (i=0; i<64; i++) {
-        // this is really slow - if I needed these out of this one loop I would define them as array of constants
-        cur_antidiagonal = 0;
-        cur_diagonal = 0;
-        //diagonals go NE-SW
-        cur_diagonal |= SQUARE_MASKS[i];
-        j = i;
-        while ((SQUARE_MASKS[j] & NOT_H_FILE) && (SQUARE_MASKS[j] & NOT_RANK_8)) {
-            j += 9;
-            cur_diagonal |= SQUARE_MASKS[j];
-        }
-        j = i;
-        while ((SQUARE_MASKS[j] & NOT_A_FILE) && (SQUARE_MASKS[j] & NOT_RANK_1)) {
-            j -= 9;
-            cur_diagonal |= SQUARE_MASKS[j];
-        }
-
-        cur_antidiagonal |= SQUARE_MASKS[i];
-        j = i;
-        while ((SQUARE_MASKS[j] & NOT_A_FILE) && (SQUARE_MASKS[j] & NOT_RANK_8)) {
-            j += 7;
-            cur_antidiagonal |= SQUARE_MASKS[j];
-        }
-        j = i;
-        while ((SQUARE_MASKS[j] & NOT_H_FILE) && (SQUARE_MASKS[j] & NOT_RANK_1)) {
-            j-=7;
-            cur_antidiagonal |= SQUARE_MASKS[j];
-        }
-
-        for (j=0; j<64; j++) {
-            if (i != j) {
-                for (c=0; c < 8; c++) {
-                    if ((SQUARE_MASKS[i] & ranks[c]) && (SQUARE_MASKS[j] & ranks[c])) {
-                        LINES_THROUGH[i][j] = ranks[c];
-                    } else if ((SQUARE_MASKS[i] & files[c]) && (SQUARE_MASKS[j] & files[c])) {
-                        LINES_THROUGH[i][j] = files[c];
-                    } else if ((SQUARE_MASKS[i] & cur_diagonal) && (SQUARE_MASKS[j] & cur_diagonal)) {
-                        LINES_THROUGH[i][j] = cur_diagonal;
-                    } else if ((SQUARE_MASKS[i] & cur_antidiagonal) && (SQUARE_MASKS[j] & cur_antidiagonal)) {
-                        LINES_THROUGH[i][j] = cur_antidiagonal;
-                    }
-                }
-            }
-        }
-    }
-
-
-
-    return true;
-}
-
 
+// [0] is the king's start and end squares, [1] the rook's, [2] both.  Only [1] is used.
+static const uint_64 kcastle_move_masks[9][3] = {
+    [WHITE] = {(1ul << E1) | (1ul << G1), (1ul << F1) | (1ul << H1), (1ul << E1) | (1ul << G1) | (1ul << F1) | (1ul << H1)},
+    [BLACK] = {(1ul << E8) | (1ul << G8), (1ul << F8) | (1ul << H8), (1ul << E8) | (1ul << G8) | (1ul << F8) | (1ul << H8)}
+};
+static const uint_64 qcastle_move_masks[9][3] = {
+    [WHITE] = {(1ul << E1) | (1ul << C1), (1ul << A1) | (1ul << D1), (1ul << E1) | (1ul << C1) | (1ul << A1) | (1ul << D1)},
+    [BLACK] = {(1ul << E8) | (1ul << C8), (1ul << A8) | (1ul << D8), (1ul << E8) | (1ul << C8) | (1ul << A8) | (1ul << D8)}
+};
 
 
 void debug_contents_of_bitboard_square(const struct bitChessBoard *pbb, int square)
@@ -407,7 +79,7 @@ void debug_contents_of_bitboard_square(const struct bitChessBoard *pbb, int squa
 struct bitChessBoard *new_bitboard()
 {
     struct bitChessBoard *ret;
-    ret = (struct bitChessBoard *) malloc (sizeof (bitChessBoard));
+    ret = (struct bitChessBoard *) aligned_alloc (64, sizeof (bitChessBoard));
     erase_bitboard(ret);
     return ret;
 }
@@ -424,8 +96,12 @@ void erase_bitboard(struct bitChessBoard *pbb)
     pbb->in_check = false;
     pbb->side_to_move = WHITE;
     pbb->hash = 0;
+    pbb->pawn_hash = 0;
     pbb->wk_pos = -1; // something in there to mean there is no piece of this type on the board.
     pbb->bk_pos = -1;
+    pbb->pst_mg = 0;
+    pbb->pst_eg = 0;
+    pbb->material_key = 0;
 #ifndef NO_STORE_HISTORY
     pbb->fullmove_number = 1;
     pbb->halfmoves_completed = 0;
@@ -474,43 +150,54 @@ int char_to_piece(char c)
 char bitsquare_to_char(const struct bitChessBoard *pbb, enum boardlayout square)
 {
     static char piecemap[15] = " PNBRQK  pnbrqk";
-    return piecemap[pbb->piece_squares[square]];
+    return piecemap[BB_PIECE_ON(pbb, square)];
 }
 
-static inline uint_64 white_pieces_attacking_square(const struct bitChessBoard *pbb, int square)
+// The move generators, apply/undo and the attack builders are instantiated once per color: the bodies take the color
+// as an argument, are always inlined, and are only ever called with WHITE or BLACK, so every color test, piece index
+// and shift below folds to a constant.  The public entry points test side_to_move once and call the right copy.
+//
+// A pawn of the color pushes PAWN_PUSH squares.  It captures PAWN_CAPTURE7 squares away unless it is on the file that
+// PAWN_CAPTURE7_FROM leaves out, likewise PAWN_CAPTURE9.  Negative is towards rank 1, see bb_shift().
+#define PAWN_PUSH(color) ((color) == WHITE ? 8 : -8)
+#define PAWN_CAPTURE7(color) ((color) == WHITE ? 7 : -7)
+#define PAWN_CAPTURE9(color) ((color) == WHITE ? 9 : -9)
+#define PAWN_CAPTURE7_FROM(color) ((color) == WHITE ? NOT_A_FILE : NOT_H_FILE)
+#define PAWN_CAPTURE9_FROM(color) ((color) == WHITE ? NOT_H_FILE : NOT_A_FILE)
+#define PAWN_ATTACKSTO(color) ((color) == WHITE ? WHITE_PAWN_ATTACKSTO : BLACK_PAWN_ATTACKSTO)
+#define PROMOTION_RANK(color) ((color) == WHITE ? RANK_8 : RANK_1)
+#define DOUBLE_PUSH_RANK(color) ((color) == WHITE ? RANK_3 : RANK_6)  // where a pawn's first single push lands
+#define KING_START(color) ((color) == WHITE ? E1 : E8)
+#define CASTLE_KING_RIGHT(color) ((color) == WHITE ? W_CASTLE_KING : B_CASTLE_KING)
+#define CASTLE_QUEEN_RIGHT(color) ((color) == WHITE ? W_CASTLE_QUEEN : B_CASTLE_QUEEN)
+#define KING_POS(pbb, color) ((color) == WHITE ? (pbb)->wk_pos : (pbb)->bk_pos)
+
+static inline __attribute__((always_inline)) uint_64 bb_shift(uint_64 bb, int n)
 {
-    uint_64 pawn_attacks, knight_attacks, diag_attacks, slide_attacks, king_attacks;
-
-    pawn_attacks = WHITE_PAWN_ATTACKSTO[square] & pbb->piece_boards[WP];
-    knight_attacks = KNIGHT_MOVES[square] & pbb->piece_boards[WN];
-    king_attacks = KING_MOVES[square] & pbb->piece_boards[WK];
-    diag_attacks = Bmagic(square, pbb->piece_boards[ALL_PIECES]) & (pbb->piece_boards[WB] | pbb->piece_boards[WQ]);
-    slide_attacks = Rmagic(square, pbb->piece_boards[ALL_PIECES]) & (pbb->piece_boards[WR] | pbb->piece_boards[WQ]);
-
-    return (pawn_attacks | knight_attacks | diag_attacks | slide_attacks | king_attacks);
+    return (n > 0) ? (bb << n) : (bb >> -n);
 }
 
-static inline uint_64 black_pieces_attacking_square(const struct bitChessBoard *pbb, int square)
+static inline __attribute__((always_inline)) uint_64 pieces_attacking_square(const struct bitChessBoard *pbb, int square, const int color)
 {
     uint_64 pawn_attacks, knight_attacks, diag_attacks, slide_attacks, king_attacks;
 
-    pawn_attacks = BLACK_PAWN_ATTACKSTO[square] & pbb->piece_boards[BP];
-    knight_attacks = KNIGHT_MOVES[square] & pbb->piece_boards[BN];
-    king_attacks = KING_MOVES[square] & pbb->piece_boards[BK];
-    diag_attacks = Bmagic(square, pbb->piece_boards[ALL_PIECES]) & (pbb->piece_boards[BB] | pbb->piece_boards[BQ]);
-    slide_attacks = Rmagic(square, pbb->piece_boards[ALL_PIECES]) & (pbb->piece_boards[BR] | pbb->piece_boards[BQ]);
+    pawn_attacks = PAWN_ATTACKSTO(color)[square] & pbb->piece_boards[PAWN + color];
+    knight_attacks = KNIGHT_MOVES[square] & pbb->piece_boards[KNIGHT + color];
+    king_attacks = KING_MOVES[square] & pbb->piece_boards[KING + color];
+    diag_attacks = Bmagic(square, pbb->piece_boards[ALL_PIECES]) & (pbb->piece_boards[BISHOP + color] | pbb->piece_boards[QUEEN + color]);
+    slide_attacks = Rmagic(square, pbb->piece_boards[ALL_PIECES]) & (pbb->piece_boards[ROOK + color] | pbb->piece_boards[QUEEN + color]);
 
     return (pawn_attacks | knight_attacks | diag_attacks | slide_attacks | king_attacks);
 }
 
 
 
-static inline bool side_is_in_check(const struct bitChessBoard *pbb, int color_defending)
+static inline __attribute__((always_inline)) bool side_is_in_check(const struct bitChessBoard *pbb, const int color_defending)
 {
     if (color_defending == WHITE) {
-        return black_pieces_attacking_square(pbb, pbb->wk_pos);
+        return pieces_attacking_square(pbb, pbb->wk_pos, BLACK);
     } else {
-        return white_pieces_attacking_square(pbb, pbb->bk_pos);
+        return pieces_attacking_square(pbb, pbb->bk_pos, WHITE);
     }
 }
 
@@ -546,7 +233,7 @@ bool load_bitboard_from_fen(struct bitChessBoard *pbb, const char *fen) {
                 return false;
             }
             pbb->piece_boards[piece] |= SQUARE_MASKS[cur_square];
-            pbb->piece_squares[cur_square] = piece;
+            BB_PUT_PIECE(pbb, cur_square, piece);
             if (piece == WK) {
                 pbb->wk_pos = cur_square;
                 got_wk = true;
@@ -650,6 +337,11 @@ bool load_bitboard_from_fen(struct bitChessBoard *pbb, const char *fen) {
     }
 
     pbb->hash = compute_bitboard_hash(pbb);
+    pbb->pawn_hash = compute_bitboard_pawn_hash(pbb);
+    compute_bb_eval_totals(pbb);
+#ifdef INCREMENTAL_ATTACKS
+    compute_bb_attacks(pbb);
+#endif
 
 
 #ifdef VALIDATE_BITBOARD_EACH_STEP
@@ -745,6 +437,61 @@ void set_bitboard_startpos(struct bitChessBoard *pbb)
 }
 
 
+void bit_movelist_remove(struct bitMoveList *ml, int position)
+{
+    int i;
+
+    assert(position < ml->size);
+    for (i = position; i < ml->size - 1; i++) {
+        ml->moves[i] = ml->moves[i + 1];
+    }
+    ml->size--;
+}
+
+void print_bb_move_list(const struct bitChessBoard *pbb, const struct bitMoveList *ml)
+{
+    char *movestr;
+    int i;
+
+    for (i = 0; i < ml->size; i++) {
+        movestr = pretty_print_bb_move(expand_compact_move(pbb, ml->moves[i]));
+        printf("%s\n", movestr);
+        free(movestr);
+    }
+}
+
+// The captured piece and the color of a promotion come from pbb, which has to be the position cm was generated for.
+Move expand_compact_move(const struct bitChessBoard *pbb, CompactMove cm)
+{
+    int end = CM_END(cm);
+    int kind = CM_KIND(cm);
+    int flags = (cm & CM_CHECK) ? MOVE_CHECK : 0;
+    int captured = BB_PIECE_ON(pbb, end);
+    int promoted_to = 0;
+
+    if (cm == NULL_COMPACT_MOVE) {
+        return NULL_MOVE;
+    }
+    switch (kind) {
+        case CM_NORMAL:
+            break;
+        case CM_DOUBLE_PAWN:
+            flags |= MOVE_DOUBLE_PAWN;
+            break;
+        case CM_CASTLE:
+            flags |= MOVE_CASTLE;
+            break;
+        case CM_EN_PASSANT:
+            flags |= MOVE_EN_PASSANT;
+            captured = PAWN + opposite_color[pbb->side_to_move];
+            break;
+        default:
+            promoted_to = CM_PROMOTED_TYPE(cm) + pbb->side_to_move;
+            break;
+    }
+    return CREATE_BB_MOVE(CM_START(cm), end, captured, promoted_to, flags);
+}
+
 uint_64 generate_bb_pinned_list(const struct bitChessBoard *pbb, int square, int color_of_blockers, int color_of_attackers)
 {
     uint_64 ret, unpinned_attacks, pinning_attackers;
@@ -766,129 +513,279 @@ uint_64 generate_bb_pinned_list(const struct bitChessBoard *pbb, int square, int
     return ret;
 }
 
-void generate_bb_ep_moves(struct bitChessBoard *pbb, struct MoveList *ml)
+// En passant is the one move that takes two pieces off one line at once, so the pin masks do not cover it.  Instead
+// both pawns are lifted off the occupancy, the capturing pawn is put on the target square, and the sliders are looked
+// up from each king through the result.  The board itself is never touched.
+static inline __attribute__((always_inline)) void generate_bb_ep_moves(const struct bitChessBoard *pbb, struct bitMoveList *ml, const int good_color)
 {
-    uint_64 capturemoves;
-    struct bitChessBoardAttrs a;
-    Move tmpMove;
+    uint_64 capturemoves, occupied;
+    uint_64 bad_pawns, bad_rooks, bad_bishops, good_rooks, good_bishops;
+    const int bad_color = good_color ^ BLACK;
+    const uint_64 *bad_pawn_attacks = PAWN_ATTACKSTO(bad_color), *good_pawn_attacks = PAWN_ATTACKSTO(good_color);
+    int kingpos = KING_POS(pbb, good_color), bad_kpos = KING_POS(pbb, bad_color);
+    int start, captured_square;
+
+    capturemoves = pbb->piece_boards[PAWN + good_color] & good_pawn_attacks[pbb->ep_target];
+    captured_square = pbb->ep_target - PAWN_PUSH(good_color);
+
+    bad_pawns = pbb->piece_boards[PAWN + bad_color] & NOT_MASKS[captured_square];
+    bad_rooks = pbb->piece_boards[ROOK + bad_color] | pbb->piece_boards[QUEEN + bad_color];
+    bad_bishops = pbb->piece_boards[BISHOP + bad_color] | pbb->piece_boards[QUEEN + bad_color];
+    good_rooks = pbb->piece_boards[ROOK + good_color] | pbb->piece_boards[QUEEN + good_color];
+    good_bishops = pbb->piece_boards[BISHOP + good_color] | pbb->piece_boards[QUEEN + good_color];
+
+    // In check, the capture must also deal with a knight or pawn giving it - which only taking the pawn that just
+    // moved does.
+    if ((KNIGHT_MOVES[kingpos] & pbb->piece_boards[KNIGHT + bad_color]) | (bad_pawn_attacks[kingpos] & bad_pawns)) {
+        return;
+    }
 
-    if (pbb->side_to_move == WHITE) {
-        capturemoves = pbb->piece_boards[WP] & WHITE_PAWN_ATTACKSTO[pbb->ep_target];
-        while (capturemoves) {
-            tmpMove = CREATE_BB_MOVE(pop_lsb(&capturemoves), pbb->ep_target, BP, 0, MOVE_EN_PASSANT);
-            store_bb_attrs(pbb, &a);
-            apply_bb_move(pbb, tmpMove);
-            // TODO try to simplify this calculation
-            if (!side_is_in_check(pbb, WHITE)) {
-                MOVELIST_ADD(ml, side_is_in_check(pbb, BLACK) ? tmpMove | MOVE_CHECK_SHIFTED : tmpMove);
-            }
-            undo_bb_move(pbb, tmpMove, &a);
-        }
-    } else {
-        capturemoves = pbb->piece_boards[BP] & BLACK_PAWN_ATTACKSTO[pbb->ep_target];
-        while (capturemoves) {
-            tmpMove = CREATE_BB_MOVE(pop_lsb(&capturemoves), pbb->ep_target, WP, 0, MOVE_EN_PASSANT);
-            store_bb_attrs(pbb, &a);
-            apply_bb_move(pbb, tmpMove);
-            if (!side_is_in_check(pbb, BLACK)) {
-                MOVELIST_ADD(ml, side_is_in_check(pbb, WHITE) ? tmpMove | MOVE_CHECK_SHIFTED : tmpMove);
-            }
-            undo_bb_move(pbb, tmpMove, &a);
+    while (capturemoves) {
+        start = pop_lsb(&capturemoves);
+        occupied = (pbb->piece_boards[ALL_PIECES] & NOT_MASKS[start] & NOT_MASKS[captured_square]) | SQUARE_MASKS[pbb->ep_target];
+        if ((Rmagic(kingpos, occupied) & bad_rooks) | (Bmagic(kingpos, occupied) & bad_bishops)) {
+            continue;
         }
+        MOVELIST_ADD(ml, CREATE_COMPACT_MOVE(start, pbb->ep_target, CM_EN_PASSANT,
+                                             (SQUARE_MASKS[pbb->ep_target] & good_pawn_attacks[bad_kpos]) |
+                                             (Rmagic(bad_kpos, occupied) & good_rooks) | (Bmagic(bad_kpos, occupied) & good_bishops)));
     }
 }
 
-// Generates all squares that white is attacking, through the black king.
-static inline uint_64 get_white_attacking_mask(const struct bitChessBoard *pbb)
+// Every square attacked by a set of rooks and a set of bishops (queens go in both), one lookup per piece.
+static inline uint_64 slider_attacks_magic(uint_64 rooks, uint_64 bishops, uint_64 occupied)
+{
+    uint_64 attackedMask = 0;
+
+    while(bishops) { attackedMask |= Bmagic(pop_lsb(&bishops), occupied); }
+    while(rooks) { attackedMask |= Rmagic(pop_lsb(&rooks), occupied); }
+    return attackedMask;
+}
+
+#ifdef __AVX2__
+// The same squares from Kogge-Stone occluded fills of the whole sets, with no loop over the pieces.  One register
+// fills north, east, north-east and north-west by shifting left, the other the four opposite directions by shifting
+// right.  The wrap masks keep the east and west fills from running off one side of the board onto the other.
+static inline uint_64 slider_attacks_avx2(uint_64 rooks, uint_64 bishops, uint_64 occupied)
+{
+    const __m256i shift = _mm256_setr_epi64x(8, 1, 9, 7);
+    const __m256i up_wrap = _mm256_setr_epi64x(~0l, NOT_A_FILE, NOT_A_FILE, NOT_H_FILE);
+    const __m256i down_wrap = _mm256_setr_epi64x(~0l, NOT_H_FILE, NOT_H_FILE, NOT_A_FILE);
+    __m256i empty = _mm256_set1_epi64x(~occupied);
+    __m256i up = _mm256_setr_epi64x(rooks, rooks, bishops, bishops);
+    __m256i down = up;
+    __m256i up_pro = _mm256_and_si256(empty, up_wrap);
+    __m256i down_pro = _mm256_and_si256(empty, down_wrap);
+    __m256i step = shift;
+    __m128i both;
+
+    up = _mm256_or_si256(up, _mm256_and_si256(up_pro, _mm256_sllv_epi64(up, step)));
+    down = _mm256_or_si256(down, _mm256_and_si256(down_pro, _mm256_srlv_epi64(down, step)));
+    up_pro = _mm256_and_si256(up_pro, _mm256_sllv_epi64(up_pro, step));
+    down_pro = _mm256_and_si256(down_pro, _mm256_srlv_epi64(down_pro, step));
+    step = _mm256_add_epi64(step, step);
+
+    up = _mm256_or_si256(up, _mm256_and_si256(up_pro, _mm256_sllv_epi64(up, step)));
+    down = _mm256_or_si256(down, _mm256_and_si256(down_pro, _mm256_srlv_epi64(down, step)));
+    up_pro = _mm256_and_si256(up_pro, _mm256_sllv_epi64(up_pro, step));
+    down_pro = _mm256_and_si256(down_pro, _mm256_srlv_epi64(down_pro, step));
+    step = _mm256_add_epi64(step, step);
+
+    up = _mm256_or_si256(up, _mm256_and_si256(up_pro, _mm256_sllv_epi64(up, step)));
+    down = _mm256_or_si256(down, _mm256_and_si256(down_pro, _mm256_srlv_epi64(down, step)));
+
+    // the fills hold the sliders and the empty squares they reach, one more step takes in the blockers
+    up = _mm256_and_si256(_mm256_sllv_epi64(up, shift), up_wrap);
+    down = _mm256_and_si256(_mm256_srlv_epi64(down, shift), down_wrap);
+    up = _mm256_or_si256(up, down);
+    both = _mm_or_si128(_mm256_castsi256_si128(up), _mm256_extracti128_si256(up, 1));
+    return (uint_64) (_mm_cvtsi128_si64(both) | _mm_extract_epi64(both, 1));
+}
+#endif
+
+#ifdef AVX2_ATTACKS
+#ifndef __AVX2__
+#error AVX2_ATTACKS needs a compiler targeting AVX2
+#endif
+#define slider_attacks slider_attacks_avx2
+#else
+#define slider_attacks slider_attacks_magic
+#endif
+
+// Generates all squares that color is attacking, through the other king.
+static inline __attribute__((always_inline)) uint_64 get_attacking_mask(const struct bitChessBoard *pbb, const int color)
 {
     uint_64 pieces;
     uint_64 attackedMask = 0;
-    uint_64 all_but_not_badk_mask = pbb->piece_boards[ALL_PIECES] ^ (pbb->piece_boards[BK]);  // allow us to attack "through" the bad king
+    uint_64 all_but_not_badk_mask = pbb->piece_boards[ALL_PIECES] ^ (pbb->piece_boards[KING + (color ^ BLACK)]);  // allow us to attack "through" the bad king
 
-    pieces = pbb->piece_boards[WN];
+    pieces = pbb->piece_boards[KNIGHT + color];
     while(pieces) { attackedMask |= KNIGHT_MOVES[pop_lsb(&pieces)]; }
 
-    pieces = pbb->piece_boards[WK];
+    pieces = pbb->piece_boards[KING + color];
     while(pieces) { attackedMask |= KING_MOVES[pop_lsb(&pieces)]; }
 
-    pieces = pbb->piece_boards[WB] | pbb->piece_boards[WQ];
-    while(pieces) { attackedMask |= Bmagic(pop_lsb(&pieces), all_but_not_badk_mask); }
-
-    pieces = pbb->piece_boards[WR] | pbb->piece_boards[WQ];
-    while(pieces) { attackedMask |= Rmagic(pop_lsb(&pieces), all_but_not_badk_mask); }
+    attackedMask |= slider_attacks(pbb->piece_boards[ROOK + color] | pbb->piece_boards[QUEEN + color],
+                                   pbb->piece_boards[BISHOP + color] | pbb->piece_boards[QUEEN + color], all_but_not_badk_mask);
 
-    attackedMask |= ((pbb->piece_boards[WP] & NOT_A_FILE) << 7);
-    attackedMask |= ((pbb->piece_boards[WP] & NOT_H_FILE) << 9);
+    attackedMask |= bb_shift(pbb->piece_boards[PAWN + color] & PAWN_CAPTURE7_FROM(color), PAWN_CAPTURE7(color));
+    attackedMask |= bb_shift(pbb->piece_boards[PAWN + color] & PAWN_CAPTURE9_FROM(color), PAWN_CAPTURE9(color));
     return attackedMask;
 }
 
-static inline uint_64 get_black_attacking_mask(const struct bitChessBoard *pbb)
+// Out-of-line entry points to the attack builders, so the benchmarks can time them.
+uint_64 bb_slider_attacks_magic(uint_64 rooks, uint_64 bishops, uint_64 occupied)
 {
-    uint_64 pieces;
-    uint_64 attackedMask = 0;
-    uint_64 all_but_not_badk_mask = pbb->piece_boards[ALL_PIECES] ^ (pbb->piece_boards[WK]);  // allow us to attack "through" the bad king
+    return slider_attacks_magic(rooks, bishops, occupied);
+}
 
-    pieces = pbb->piece_boards[BN];
-    while(pieces) { attackedMask |= KNIGHT_MOVES[pop_lsb(&pieces)]; }
+#ifdef __AVX2__
+uint_64 bb_slider_attacks_avx2(uint_64 rooks, uint_64 bishops, uint_64 occupied)
+{
+    return slider_attacks_avx2(rooks, bishops, occupied);
+}
+#endif
 
-    pieces = pbb->piece_boards[BK];
-    while(pieces) { attackedMask |= KING_MOVES[pop_lsb(&pieces)]; }
+uint_64 get_bb_attacked_squares(const struct bitChessBoard *pbb, int color_attacking)
+{
+#ifdef INCREMENTAL_ATTACKS
+    return pbb->attacked_by[color_attacking];
+#else
+    return (color_attacking == WHITE) ? get_attacking_mask(pbb, WHITE) : get_attacking_mask(pbb, BLACK);
+#endif
+}
 
-    pieces = pbb->piece_boards[BB] | pbb->piece_boards[BQ];
-    while(pieces) { attackedMask |= Bmagic(pop_lsb(&pieces), all_but_not_badk_mask); }
+uint_64 get_bb_attackers_of_square(const struct bitChessBoard *pbb, int square, int color_attacking)
+{
+    return (color_attacking == WHITE) ? pieces_attacking_square(pbb, square, WHITE) : pieces_attacking_square(pbb, square, BLACK);
+}
 
-    pieces = pbb->piece_boards[BR] | pbb->piece_boards[BQ];
-    while(pieces) { attackedMask |= Rmagic(pop_lsb(&pieces), all_but_not_badk_mask); }
+#ifdef INCREMENTAL_ATTACKS
+// The occupancy a side's sliders see - everything but the enemy king.
+#define BB_ATTACK_VIEW(pbb, color) ((pbb)->piece_boards[ALL_PIECES] ^ (pbb)->piece_boards[KING + opposite_color[color]])
 
-    attackedMask |= ((pbb->piece_boards[BP] & NOT_A_FILE) >> 9);
-    attackedMask |= ((pbb->piece_boards[BP] & NOT_H_FILE) >> 7);
-    return attackedMask;
+static inline uint_64 bb_piece_attacks(const struct bitChessBoard *pbb, int square, uint_64 white_view, uint_64 black_view)
+{
+    switch (BB_PIECE_ON(pbb, square)) {
+        // not the ATTACKSTO tables - they leave out the back ranks, where no pawn of that color can stand
+        case WP: return ((SQUARE_MASKS[square] & NOT_A_FILE) << 7) | ((SQUARE_MASKS[square] & NOT_H_FILE) << 9);
+        case BP: return ((SQUARE_MASKS[square] & NOT_A_FILE) >> 9) | ((SQUARE_MASKS[square] & NOT_H_FILE) >> 7);
+        case WN: case BN: return KNIGHT_MOVES[square];
+        case WK: case BK: return KING_MOVES[square];
+        case WB: return Bmagic(square, white_view);
+        case BB: return Bmagic(square, black_view);
+        case WR: return Rmagic(square, white_view);
+        case BR: return Rmagic(square, black_view);
+        case WQ: return Rmagic(square, white_view) | Bmagic(square, white_view);
+        case BQ: return Rmagic(square, black_view) | Bmagic(square, black_view);
+        default: return 0;
+    }
 }
 
-// if chkMask is true, typically because the pawn is creating a discovered check, then the moves created wil automatically be check moves, otherwise we will calculate.
-static inline void add_white_pawnmoves(const struct bitChessBoard *pbb, struct MoveList *ml, int start_delta, int dest, int piece_captured, uint_64 allMask, int bad_kpos, uint_64 chkMask)
+// Rebuilds the per side unions and the checkers from attacks_from.  Pawns are done in bulk by shifting.
+static inline void sum_bb_attacks(struct bitChessBoard *pbb)
 {
-    uint_64 tmpRmask, tmpBmask;
-    int start = dest + start_delta;
-    if (SQUARE_MASKS[dest] & RANK_8) {
-        tmpRmask = (Rmagic(dest, allMask & NOT_MASKS[start])) & SQUARE_MASKS[bad_kpos];
-        tmpBmask = (Bmagic(dest, allMask & NOT_MASKS[start])) & SQUARE_MASKS[bad_kpos];
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, WQ, chkMask | (tmpRmask | tmpBmask) ? MOVE_CHECK : 0));
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, WN,
-                                     chkMask | (KNIGHT_MOVES[dest] & SQUARE_MASKS[bad_kpos]) ? MOVE_CHECK : 0));
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, WR, chkMask | tmpRmask ? MOVE_CHECK : 0));
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, WB, chkMask | tmpBmask ? MOVE_CHECK : 0));
+    uint_64 pieces, checkers = 0;
+    uint_64 white_attacks = ((pbb->piece_boards[WP] & NOT_A_FILE) << 7) | ((pbb->piece_boards[WP] & NOT_H_FILE) << 9);
+    uint_64 black_attacks = ((pbb->piece_boards[BP] & NOT_A_FILE) >> 9) | ((pbb->piece_boards[BP] & NOT_H_FILE) >> 7);
+    int kingpos = (pbb->side_to_move == WHITE) ? pbb->wk_pos : pbb->bk_pos;
+    int sq;
+
+    pieces = pbb->piece_boards[WHITE] ^ pbb->piece_boards[WP];
+    while (pieces) {
+        sq = pop_lsb(&pieces);
+        white_attacks |= pbb->attacks_from[sq];
+        checkers |= ((pbb->attacks_from[sq] >> kingpos) & 1) << sq;
+    }
+    pieces = pbb->piece_boards[BLACK] ^ pbb->piece_boards[BP];
+    while (pieces) {
+        sq = pop_lsb(&pieces);
+        black_attacks |= pbb->attacks_from[sq];
+        checkers |= ((pbb->attacks_from[sq] >> kingpos) & 1) << sq;
     }
-    else {
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, 0, chkMask | (SQUARE_MASKS[dest] & WHITE_PAWN_ATTACKSTO[bad_kpos]) ? MOVE_CHECK : 0));
+    if (pbb->side_to_move == WHITE) {
+        checkers = (checkers & pbb->piece_boards[BLACK]) | (BLACK_PAWN_ATTACKSTO[kingpos] & pbb->piece_boards[BP]);
+    } else {
+        checkers = (checkers & pbb->piece_boards[WHITE]) | (WHITE_PAWN_ATTACKSTO[kingpos] & pbb->piece_boards[WP]);
     }
+    pbb->attacked_by[WHITE] = white_attacks;
+    pbb->attacked_by[BLACK] = black_attacks;
+    pbb->king_attackers = checkers;
 }
 
-static inline void add_black_pawnmoves(const struct bitChessBoard *pbb, struct MoveList *ml, int start_delta, int dest, int piece_captured, uint_64 allMask, int bad_kpos, uint_64 chkMask)
+void compute_bb_attacks(struct bitChessBoard *pbb)
+{
+    uint_64 white_view = BB_ATTACK_VIEW(pbb, WHITE);
+    uint_64 black_view = BB_ATTACK_VIEW(pbb, BLACK);
+    int sq;
+
+    for (sq = 0; sq < 64; sq++) {
+        pbb->attacks_from[sq] = bb_piece_attacks(pbb, sq, white_view, black_view);
+    }
+    sum_bb_attacks(pbb);
+}
+
+// After a move or its undo.  The squares whose piece changed get their attacks recomputed, and so do the sliders whose
+// stored attacks reach a square that was emptied or filled in the occupancy they see - nothing else can have changed.
+static inline void update_bb_attacks(struct bitChessBoard *pbb, uint_64 moved, uint_64 old_white_view, uint_64 old_black_view)
+{
+    uint_64 white_view = BB_ATTACK_VIEW(pbb, WHITE);
+    uint_64 black_view = BB_ATTACK_VIEW(pbb, BLACK);
+    uint_64 white_changed = white_view ^ old_white_view;
+    uint_64 black_changed = black_view ^ old_black_view;
+    uint_64 touched = moved | white_changed | black_changed;
+    uint_64 sliders;
+    int sq;
+
+    sliders = touched;
+    while (sliders) {
+        sq = pop_lsb(&sliders);
+        pbb->attacks_from[sq] = bb_piece_attacks(pbb, sq, white_view, black_view);
+    }
+
+    sliders = (pbb->piece_boards[WB] | pbb->piece_boards[WR] | pbb->piece_boards[WQ]) & ~touched;
+    while (sliders) {
+        sq = pop_lsb(&sliders);
+        if (pbb->attacks_from[sq] & white_changed) {
+            pbb->attacks_from[sq] = bb_piece_attacks(pbb, sq, white_view, black_view);
+        }
+    }
+    sliders = (pbb->piece_boards[BB] | pbb->piece_boards[BR] | pbb->piece_boards[BQ]) & ~touched;
+    while (sliders) {
+        sq = pop_lsb(&sliders);
+        if (pbb->attacks_from[sq] & black_changed) {
+            pbb->attacks_from[sq] = bb_piece_attacks(pbb, sq, white_view, black_view);
+        }
+    }
+
+    sum_bb_attacks(pbb);
+}
+#endif
+
+// if chkMask is true, typically because the pawn is creating a discovered check, then the moves created wil automatically be check moves, otherwise we will calculate.
+static inline __attribute__((always_inline)) void add_pawnmoves(const struct bitChessBoard *pbb, struct bitMoveList *ml, int start_delta, int dest, uint_64 allMask, int bad_kpos, uint_64 chkMask, const int good_color)
 {
     uint_64 tmpRmask, tmpBmask;
     int start = dest + start_delta;
-    if (SQUARE_MASKS[dest] & RANK_1) {
+    if (SQUARE_MASKS[dest] & PROMOTION_RANK(good_color)) {
         tmpRmask = (Rmagic(dest, allMask & NOT_MASKS[start])) & SQUARE_MASKS[bad_kpos];
         tmpBmask = (Bmagic(dest, allMask & NOT_MASKS[start])) & SQUARE_MASKS[bad_kpos];
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, BQ, chkMask | (tmpRmask | tmpBmask) ? MOVE_CHECK : 0));
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, BN,
-                                     chkMask | (KNIGHT_MOVES[dest] & SQUARE_MASKS[bad_kpos]) ? MOVE_CHECK : 0));
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, BR, chkMask | tmpRmask ? MOVE_CHECK : 0));
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, BB, chkMask | tmpBmask ? MOVE_CHECK : 0));
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, QUEEN + good_color, chkMask | (tmpRmask | tmpBmask) ? MOVE_CHECK : 0));
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, KNIGHT + good_color, chkMask | (KNIGHT_MOVES[dest] & SQUARE_MASKS[bad_kpos]) ? MOVE_CHECK : 0));
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, ROOK + good_color, chkMask | tmpRmask ? MOVE_CHECK : 0));
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, BISHOP + good_color, chkMask | tmpBmask ? MOVE_CHECK : 0));
     }
     else {
-        MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, piece_captured, 0, chkMask | (SQUARE_MASKS[dest] & BLACK_PAWN_ATTACKSTO[bad_kpos]) ? MOVE_CHECK : 0));
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, chkMask | (SQUARE_MASKS[dest] & PAWN_ATTACKSTO(good_color)[bad_kpos]) ? MOVE_CHECK : 0));
     }
 }
 
-void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *ml)
+static inline __attribute__((always_inline)) void generate_bb_evasions_for(struct bitChessBoard *pbb, struct bitMoveList *ml, const int good_color)
 {
     uint_64 moves, double_pushmoves;
     int kingpos, bad_kpos;
     int start, dest;
-    int good_color;  // the "good" team is the team moving.
-    int bad_color;
+    const int bad_color = good_color ^ BLACK;
     uint_64 piece_list;
     uint_64 bad_kmask;
     uint_64 bad_team_mask;
@@ -902,29 +799,21 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
 
     MOVELIST_CLEAR(ml);
 
-    good_color = pbb->side_to_move;
-    bad_color = opposite_color[good_color];
-
-
     bad_team_mask = pbb->piece_boards[bad_color];
     emptyMask = pbb->piece_boards[EMPTY_SQUARES];
     allMask = pbb->piece_boards[ALL_PIECES];
     not_good_team_mask = ~pbb->piece_boards[good_color];
 
-    // pawn moves and castling are moves that vary based on color, other moves are constant.  To limit branching we do all the color-specific moves first
-    if (good_color == WHITE) {
-        attackedMask = get_black_attacking_mask(pbb);
-        kingpos = pbb->wk_pos;
-        bad_kpos = pbb->bk_pos;
-        bad_kmask = pbb->piece_boards[BK];
-        checking_attackers_mask = black_pieces_attacking_square(pbb, kingpos);
-    } else {
-        attackedMask = get_white_attacking_mask(pbb);
-        kingpos = pbb->bk_pos;
-        bad_kpos = pbb->wk_pos;
-        bad_kmask = pbb->piece_boards[WK];
-        checking_attackers_mask = white_pieces_attacking_square(pbb, kingpos);
-    }
+    kingpos = KING_POS(pbb, good_color);
+    bad_kpos = KING_POS(pbb, bad_color);
+    bad_kmask = pbb->piece_boards[KING + bad_color];
+#ifdef INCREMENTAL_ATTACKS
+    attackedMask = pbb->attacked_by[bad_color];
+    checking_attackers_mask = pbb->king_attackers;
+#else
+    attackedMask = get_attacking_mask(pbb, bad_color);
+    checking_attackers_mask = pieces_attacking_square(pbb, kingpos, bad_color);
+#endif
 
     discovered_check_mask = generate_bb_pinned_list(pbb, bad_kpos, good_color, good_color);
 
@@ -933,7 +822,7 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
     while (moves) {
         dest = pop_lsb(&moves);
         if (!(attackedMask & SQUARE_MASKS[dest])) {
-            m = CREATE_MOVE(kingpos, dest, KING + good_color, pbb->piece_squares[dest], 0, 0);
+            m = CREATE_BB_MOVE(kingpos, dest, BB_PIECE_ON(pbb, dest), 0, 0);
 
             // king is only piece on the discovered_check_mask that could move in a way that moves the king out of check while not causing the discovered check to happen.
             // Example: Black Queen on E8.  Black king on A1, White King on E1, White Rook on H1.  King moves E1-D1 evading check, but not causing the discovered check
@@ -941,10 +830,10 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
             if (SQUARE_MASKS[kingpos] & discovered_check_mask) {
                 store_bb_attrs(pbb, &a);
                 apply_bb_move(pbb, m);
-                MOVELIST_ADD(ml, side_is_in_check(pbb, bad_color) ? m |  checkmask : m);
+                MOVELIST_ADD(ml, CREATE_COMPACT_MOVE(kingpos, dest, CM_NORMAL, side_is_in_check(pbb, bad_color)));
                 undo_bb_move(pbb, m, &a);
             } else {
-                MOVELIST_ADD(ml, m);
+                MOVELIST_ADD(ml, CREATE_COMPACT_MOVE(kingpos, dest, CM_NORMAL, 0));
             }
         }
     }
@@ -955,8 +844,6 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
         return;
     }
 
-    // these require the good/bad kpos to be set to be calculated.  If we need them before the above branch, then we need to move setting good/bad kpos so
-    // it doesn't require a branch.
     pinned_piece_mask = generate_bb_pinned_list(pbb, kingpos, good_color, bad_color);
     not_pinned_piece_mask = ~pinned_piece_mask;
 
@@ -973,72 +860,41 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
 
     valid_dest_squares_mask = SQUARE_MASKS[checking_attacker_pos] | SQUARES_BETWEEN[kingpos][checking_attacker_pos];
 
-    if (pbb->side_to_move == WHITE) {
-        // pawn moves
-        piece_list = pbb->piece_boards[WP] & not_pinned_piece_mask;
-        moves = (piece_list << 8) & emptyMask;
-        double_pushmoves = (((moves & RANK_3) << 8) & emptyMask) & valid_dest_squares_mask;
-        // The &= is done in this order because a single push for a given pawn may be invalid where a double push is valid
-        moves &= valid_dest_squares_mask;
+    // pawn moves
+    piece_list = pbb->piece_boards[PAWN + good_color] & not_pinned_piece_mask;
+    moves = bb_shift(piece_list, PAWN_PUSH(good_color)) & emptyMask;
+    double_pushmoves = (bb_shift(moves & DOUBLE_PUSH_RANK(good_color), PAWN_PUSH(good_color)) & emptyMask) & valid_dest_squares_mask;
+    // The &= is done in this order because a single push for a given pawn may be invalid where a double push is valid
+    moves &= valid_dest_squares_mask;
 
-        while(moves) {
-            dest = pop_lsb(&moves);
-            add_white_pawnmoves(pbb, ml, -8, dest, 0, allMask, bad_kpos, SQUARE_MASKS[dest-8] & discovered_check_mask);
-        }
-        while(double_pushmoves) {
-            dest = pop_lsb(&double_pushmoves);
-            MOVELIST_ADD(ml, CREATE_MOVE(dest-16, dest, WP, 0, 0, (SQUARE_MASKS[dest-16] & discovered_check_mask) | (SQUARE_MASKS[dest] & WHITE_PAWN_ATTACKSTO[bad_kpos]) ? MOVE_DOUBLE_PAWN | MOVE_CHECK : MOVE_DOUBLE_PAWN));
-        }
-
-
-        moves = (((piece_list & NOT_A_FILE) << 7) & bad_team_mask) & valid_dest_squares_mask;
-        while(moves) {
-            dest = pop_lsb(&moves);
-            add_white_pawnmoves(pbb, ml, -7, dest, pbb->piece_squares[dest], allMask, bad_kpos, (SQUARE_MASKS[dest-7] & discovered_check_mask));
-        }
-
-        moves = (((piece_list & NOT_H_FILE) << 9) & bad_team_mask) & valid_dest_squares_mask;
-        while(moves) {
-            dest = pop_lsb(&moves);
-            add_white_pawnmoves(pbb, ml, -9, dest, pbb->piece_squares[dest], allMask, bad_kpos, (SQUARE_MASKS[dest-9] & discovered_check_mask));
-        }
-
-
-
-    } else {
-
-        //pawn moves
-        piece_list = pbb->piece_boards[BP] & not_pinned_piece_mask;
-        moves = (piece_list >> 8) & emptyMask;
-        double_pushmoves = (((moves & RANK_6) >> 8) & emptyMask) & valid_dest_squares_mask;
-
-        // done in this order because a single push for a given pawn may be invalid where a double push is valid
-        moves &= valid_dest_squares_mask;
-        while(moves) {
-            dest = pop_lsb(&moves);
-            add_black_pawnmoves(pbb, ml, 8, dest, 0, allMask, bad_kpos,(SQUARE_MASKS[dest+8] & discovered_check_mask));
-        }
-        while(double_pushmoves) {
-            dest = pop_lsb(&double_pushmoves);
-            MOVELIST_ADD(ml, CREATE_MOVE(dest+16, dest, BP, 0, 0, ((SQUARE_MASKS[dest+16] & discovered_check_mask) | (SQUARE_MASKS[dest] & BLACK_PAWN_ATTACKSTO[bad_kpos])) ? MOVE_DOUBLE_PAWN | MOVE_CHECK : MOVE_DOUBLE_PAWN));
-        }
+    while(moves) {
+        dest = pop_lsb(&moves);
+        start = dest - PAWN_PUSH(good_color);
+        add_pawnmoves(pbb, ml, start - dest, dest, allMask, bad_kpos, SQUARE_MASKS[start] & discovered_check_mask, good_color);
+    }
+    while(double_pushmoves) {
+        dest = pop_lsb(&double_pushmoves);
+        start = dest - 2 * PAWN_PUSH(good_color);
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, (SQUARE_MASKS[start] & discovered_check_mask) | (SQUARE_MASKS[dest] & PAWN_ATTACKSTO(good_color)[bad_kpos]) ? MOVE_DOUBLE_PAWN | MOVE_CHECK : MOVE_DOUBLE_PAWN));
+    }
 
-        moves = (((piece_list & NOT_H_FILE) >> 7) & bad_team_mask) & valid_dest_squares_mask;
-        while (moves) {
-            dest = pop_lsb(&moves);
-            add_black_pawnmoves(pbb, ml, 7, dest, pbb->piece_squares[dest], allMask, bad_kpos,(SQUARE_MASKS[dest+7] & discovered_check_mask));
-        }
+    moves = (bb_shift(piece_list & PAWN_CAPTURE7_FROM(good_color), PAWN_CAPTURE7(good_color)) & bad_team_mask) & valid_dest_squares_mask;
+    while(moves) {
+        dest = pop_lsb(&moves);
+        start = dest - PAWN_CAPTURE7(good_color);
+        add_pawnmoves(pbb, ml, start - dest, dest, allMask, bad_kpos, (SQUARE_MASKS[start] & discovered_check_mask), good_color);
+    }
 
-        moves = (((piece_list & NOT_A_FILE) >> 9) & bad_team_mask) & valid_dest_squares_mask;
-        while (moves) {
-            dest = pop_lsb(&moves);
-            add_black_pawnmoves(pbb, ml, 9, dest, pbb->piece_squares[dest], allMask, bad_kpos,(SQUARE_MASKS[dest+9] & discovered_check_mask));
-        }
+    moves = (bb_shift(piece_list & PAWN_CAPTURE9_FROM(good_color), PAWN_CAPTURE9(good_color)) & bad_team_mask) & valid_dest_squares_mask;
+    while(moves) {
+        dest = pop_lsb(&moves);
+        start = dest - PAWN_CAPTURE9(good_color);
+        add_pawnmoves(pbb, ml, start - dest, dest, allMask, bad_kpos, (SQUARE_MASKS[start] & discovered_check_mask), good_color);
     }
 
-    // ep moves - super rare so no big hit by doing one potential extra branch to test color to move inside the pbb->eptarget.
+    // ep moves - super rare
     if_unlikely(pbb->ep_target) {
-        generate_bb_ep_moves(pbb, ml);
+        generate_bb_ep_moves(pbb, ml, good_color);
     }
 
     // generate bishop moves
@@ -1048,7 +904,7 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
         moves = ((Bmagic(start, pbb->piece_boards[ALL_PIECES])) & valid_dest_squares_mask) & not_good_team_mask;
         while (moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, (SQUARE_MASKS[start] & discovered_check_mask) | (Bmagic(dest, allMask) & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, (SQUARE_MASKS[start] & discovered_check_mask) | (Bmagic(dest, allMask) & bad_kmask) ? MOVE_CHECK : 0));
         }
     }
 
@@ -1060,7 +916,7 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
         moves = ((Rmagic(start, allMask)) & valid_dest_squares_mask) & not_good_team_mask;
         while (moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, (SQUARE_MASKS[start] & discovered_check_mask) | (Rmagic(dest, allMask) & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, (SQUARE_MASKS[start] & discovered_check_mask) | (Rmagic(dest, allMask) & bad_kmask) ? MOVE_CHECK : 0));
         }
     }
 
@@ -1071,7 +927,7 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
         moves = ((Rmagic(start, allMask) | Bmagic(start, allMask)) & valid_dest_squares_mask) & not_good_team_mask;
         while (moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, (SQUARE_MASKS[start] & discovered_check_mask) | ((Rmagic(dest, allMask) | (Bmagic(dest, allMask))) & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, (SQUARE_MASKS[start] & discovered_check_mask) | ((Rmagic(dest, allMask) | (Bmagic(dest, allMask))) & bad_kmask) ? MOVE_CHECK : 0));
         }
     }
 
@@ -1085,147 +941,153 @@ void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct MoveList *
         moves = (KNIGHT_MOVES[start] & valid_dest_squares_mask) & not_good_team_mask;
         while(moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, (SQUARE_MASKS[start] & discovered_check_mask) | (KNIGHT_MOVES[dest] & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, (SQUARE_MASKS[start] & discovered_check_mask) | (KNIGHT_MOVES[dest] & bad_kmask) ? MOVE_CHECK : 0));
         }
     }
 }
 
+void generate_bb_move_list_in_check(struct bitChessBoard *pbb, struct bitMoveList *ml)
+{
+    if (pbb->side_to_move == WHITE) {
+        generate_bb_evasions_for(pbb, ml, WHITE);
+    } else {
+        generate_bb_evasions_for(pbb, ml, BLACK);
+    }
+}
+
+
+// Kinds of move for generate_bb_moves_not_in_check().  Promotions count as captures, as they change the material.
+// BB_GEN_QUIET_CHECKS is the subset of BB_GEN_QUIETS that gives check, and is not combined with the others.
+#define BB_GEN_CAPTURES 1
+#define BB_GEN_QUIETS 2
+#define BB_GEN_ALL (BB_GEN_CAPTURES | BB_GEN_QUIETS)
+#define BB_GEN_QUIET_CHECKS 4
 
-void generate_bb_move_list_normal(struct bitChessBoard *pbb, struct MoveList *ml)
+// Always inlined so that each caller gets a copy with kinds folded away - the full generator costs the same as before
+// it learned to generate a subset.  Likewise for the masks, see generate_bb_moves_for() below.
+static inline __attribute__((always_inline)) void generate_bb_moves_with_masks(struct bitChessBoard *pbb, struct bitMoveList *ml, int kinds, const int good_color,
+                                                                             int kingpos, int bad_kpos, uint_64 pinned_piece_mask, uint_64 discovered_check_mask)
 {
     uint_64 double_pushmoves;
     uint_64 moves;
 
 
-    int kingpos, bad_kpos;
-    int start, dest, i;
-    int good_color;  // the "good" team is the team moving.
-    int bad_color;
-    uint_64 piece_list;
-    // TODO - see if keeping these 12 ints & 12 masks around is faster than recomputing each time we access the pbb->piece_boards array.
-    // TODO - an alternative would be an "if white" with mirrored "if black" code with the constants hardcoded in each one.
+    int start, dest, i, j;
+    const int bad_color = good_color ^ BLACK;
+    const int king_start = KING_START(good_color);
+    uint_64 piece_list, pinned_pawns, start_mask;
+    uint_64 push_pawns, capture7_pawns, capture9_pawns;
     uint_64 bad_kmask;
-    uint_64 bad_team_mask, not_good_team_mask;
-    uint_64 pinned_piece_mask, discovered_check_mask;
-    bool removed_move;
-    struct bitChessBoard tmp;
-    Move m;
-    uint_64 tmpRmask, tmpBmask, emptyMask, allMask, attackedMask;
+    uint_64 bad_team_mask;
+    uint_64 targets, push_targets, double_push_targets;
+    uint_64 knight_checks, bishop_checks, rook_checks;
+    uint_64 pin_line, discovery_squares;
+    uint_64 emptyMask, allMask, attackedMask;
 
     MOVELIST_CLEAR(ml);
 
-    good_color = pbb->side_to_move;
-    //bad_color = good_color ^ BLACK;
-    bad_color = opposite_color[good_color];
-
-
     bad_team_mask = pbb->piece_boards[bad_color];
-    not_good_team_mask = ~pbb->piece_boards[good_color];
 
     emptyMask = pbb->piece_boards[EMPTY_SQUARES];
     allMask = pbb->piece_boards[ALL_PIECES];
 
+    // where pieces other than pawns may land - for BB_GEN_ALL this is every square not holding one of our own pieces
+    targets = ((kinds & BB_GEN_CAPTURES) ? bad_team_mask : 0) | ((kinds & BB_GEN_QUIETS) ? emptyMask : 0);
+
+    bad_kmask = pbb->piece_boards[KING + bad_color];
+
+    // For quiet checks, each piece may only go to the empty squares from which it attacks the bad king - unless it is
+    // in the discovered check mask, when it may go anywhere and DISCOVERED_CHECK_SQUARES decides.
+    knight_checks = bishop_checks = rook_checks = 0;
+    if (kinds & BB_GEN_QUIET_CHECKS) {
+        knight_checks = KNIGHT_MOVES[bad_kpos] & emptyMask;
+        bishop_checks = Bmagic(bad_kpos, allMask) & emptyMask;
+        rook_checks = Rmagic(bad_kpos, allMask) & emptyMask;
+    }
+#define QUIET_CHECK_TARGETS(start, checks) ((kinds & BB_GEN_QUIET_CHECKS) ? \
+        ((SQUARE_MASKS[start] & discovered_check_mask) ? emptyMask : (checks)) : 0)
+
+    // Legality and discovered checks are settled as each piece's targets are built, so every move added is final:
+    // a pinned piece may only move along the line through it and the good king, and a piece in the discovered check
+    // mask gives check wherever it goes off the line through it and the bad king.
+#define PIN_LINE(start) (((pinned_piece_mask >> (start)) & 1) ? LINES_THROUGH[start][kingpos] : ~0ul)
+#define DISCOVERED_CHECK_SQUARES(start) (((discovered_check_mask >> (start)) & 1) ? ~LINES_THROUGH[start][bad_kpos] : 0)
+
+    // Pawns move in bulk, so instead each direction gets its own set of pawns that may move that way.  A pinned pawn
+    // may only if the square it moves to stays on its pin line.
+    pinned_pawns = pbb->piece_boards[PAWN + good_color] & pinned_piece_mask;
+    push_pawns = capture7_pawns = capture9_pawns = pbb->piece_boards[PAWN + good_color] & ~pinned_piece_mask;
+    while (pinned_pawns) {
+        start = pop_lsb(&pinned_pawns);
+        start_mask = SQUARE_MASKS[start];
+        pin_line = LINES_THROUGH[start][kingpos];
+        push_pawns |= bb_shift(bb_shift(start_mask, PAWN_PUSH(good_color)) & pin_line, -PAWN_PUSH(good_color));
+        capture7_pawns |= bb_shift(bb_shift(start_mask, PAWN_CAPTURE7(good_color)) & pin_line, -PAWN_CAPTURE7(good_color));
+        capture9_pawns |= bb_shift(bb_shift(start_mask, PAWN_CAPTURE9(good_color)) & pin_line, -PAWN_CAPTURE9(good_color));
+    }
+
+#ifdef INCREMENTAL_ATTACKS
+    attackedMask = pbb->attacked_by[bad_color];
+#else
+    attackedMask = get_attacking_mask(pbb, bad_color);
+#endif
 
-    // pawn moves and castling are moves that vary based on color, other moves are constant.  To limit branching we do all the color-specific moves first
-    if (good_color == WHITE) {
-        attackedMask = get_black_attacking_mask(pbb);
-
-        kingpos = pbb->wk_pos;
-        bad_kpos = pbb->bk_pos;
-        bad_kmask = pbb->piece_boards[BK];
-
-        // pawn moves
-        piece_list = pbb->piece_boards[WP];
-        moves = (piece_list << 8) & emptyMask;
-        double_pushmoves = ((moves & RANK_3) << 8) & emptyMask;
-
-        while(moves) {
-            add_white_pawnmoves(pbb, ml, -8, pop_lsb(&moves), 0, allMask, bad_kpos, 0);
-        }
-        while(double_pushmoves) {
-            dest = pop_lsb(&double_pushmoves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(dest-16, dest, 0, 0, SQUARE_MASKS[dest] & WHITE_PAWN_ATTACKSTO[bad_kpos] ? MOVE_DOUBLE_PAWN | MOVE_CHECK : MOVE_DOUBLE_PAWN));
-        }
-
-        moves = ((piece_list & NOT_A_FILE) << 7) & bad_team_mask;
-        while(moves) {
-            dest = pop_lsb(&moves);
-            add_white_pawnmoves(pbb, ml, -7, dest, pbb->piece_squares[dest], allMask, bad_kpos, 0);
-        }
+    // pawn moves
+    piece_list = pbb->piece_boards[PAWN + good_color];
+    push_targets = ((kinds & BB_GEN_CAPTURES) ? PROMOTION_RANK(good_color) : 0) | ((kinds & BB_GEN_QUIETS) ? ~PROMOTION_RANK(good_color) : 0);
+    double_push_targets = (kinds & BB_GEN_QUIETS) ? ~0ul : 0;
+    if (kinds & BB_GEN_QUIET_CHECKS) {
+        // a pushed pawn either attacks the king from its new square or uncovers an attack, which it may block again
+        // by staying on the line - those last are dropped at the end
+        push_targets = ~PROMOTION_RANK(good_color) & (PAWN_ATTACKSTO(good_color)[bad_kpos] | bb_shift(piece_list & discovered_check_mask, PAWN_PUSH(good_color)));
+        double_push_targets = PAWN_ATTACKSTO(good_color)[bad_kpos] | bb_shift(piece_list & discovered_check_mask, 2 * PAWN_PUSH(good_color));
+    }
+    moves = bb_shift(push_pawns, PAWN_PUSH(good_color)) & emptyMask;
+    double_pushmoves = bb_shift(moves & DOUBLE_PUSH_RANK(good_color), PAWN_PUSH(good_color)) & emptyMask & double_push_targets;
+    moves &= push_targets;
+
+    while(moves) {
+        dest = pop_lsb(&moves);
+        start = dest - PAWN_PUSH(good_color);
+        add_pawnmoves(pbb, ml, start - dest, dest, allMask, bad_kpos, (DISCOVERED_CHECK_SQUARES(start) >> dest) & 1, good_color);
+    }
+    while(double_pushmoves) {
+        dest = pop_lsb(&double_pushmoves);
+        start = dest - 2 * PAWN_PUSH(good_color);
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, (SQUARE_MASKS[dest] & (PAWN_ATTACKSTO(good_color)[bad_kpos] | DISCOVERED_CHECK_SQUARES(start))) ? MOVE_DOUBLE_PAWN | MOVE_CHECK : MOVE_DOUBLE_PAWN));
+    }
 
-        moves = ((piece_list & NOT_H_FILE) << 9) & bad_team_mask;
+    if (kinds & BB_GEN_CAPTURES) {
+        moves = bb_shift(capture7_pawns & PAWN_CAPTURE7_FROM(good_color), PAWN_CAPTURE7(good_color)) & bad_team_mask;
         while(moves) {
             dest = pop_lsb(&moves);
-            add_white_pawnmoves(pbb, ml, -9, dest, pbb->piece_squares[dest], allMask, bad_kpos, 0);
-        }
-
-        // castling
-        if (pbb->castling & W_CASTLE_KING) {
-            if ((!(allMask & castle_empty_square_mask[WHITE][0])) && (!(attackedMask & castle_safe_square_mask[WHITE][0]))) {
-                MOVELIST_ADD(ml, CREATE_BB_MOVE(E1, G1, 0, 0, (Rmagic(F1, allMask) & bad_kmask) ? MOVE_CHECK | MOVE_CASTLE: MOVE_CASTLE));
-            }
+            start = dest - PAWN_CAPTURE7(good_color);
+            add_pawnmoves(pbb, ml, start - dest, dest, allMask, bad_kpos, (DISCOVERED_CHECK_SQUARES(start) >> dest) & 1, good_color);
         }
-        if (pbb->castling & W_CASTLE_QUEEN) {
-            if ((!(allMask & castle_empty_square_mask[WHITE][1])) && (!(attackedMask & castle_safe_square_mask[WHITE][1]))) {
-                MOVELIST_ADD(ml, CREATE_BB_MOVE(E1, C1, 0, 0, (Rmagic(D1, allMask) & bad_kmask) ? MOVE_CHECK | MOVE_CASTLE: MOVE_CASTLE));
-            }
-        }
-
-
-
-    } else {
-        attackedMask = get_white_attacking_mask(pbb);
 
-        kingpos = pbb->bk_pos;
-        bad_kpos = pbb->wk_pos;
-        bad_kmask = pbb->piece_boards[WK];
-
-        //pawn moves
-        piece_list = pbb->piece_boards[BP];
-        moves = (piece_list >> 8) & emptyMask;
-        double_pushmoves = ((moves & RANK_6) >> 8) & emptyMask;
+        moves = bb_shift(capture9_pawns & PAWN_CAPTURE9_FROM(good_color), PAWN_CAPTURE9(good_color)) & bad_team_mask;
         while(moves) {
-            add_black_pawnmoves(pbb, ml, 8, pop_lsb(&moves), 0, allMask, bad_kpos, 0);
-        }
-        while(double_pushmoves) {
-            dest = pop_lsb(&double_pushmoves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(dest+16, dest, 0, 0, SQUARE_MASKS[dest] & BLACK_PAWN_ATTACKSTO[bad_kpos] ? MOVE_DOUBLE_PAWN | MOVE_CHECK : MOVE_DOUBLE_PAWN));
-        }
-
-        moves = ((piece_list & NOT_H_FILE) >> 7) & bad_team_mask;
-        while (moves) {
             dest = pop_lsb(&moves);
-            add_black_pawnmoves(pbb, ml, 7, dest, pbb->piece_squares[dest], allMask, bad_kpos, 0);
-        }
-
-        moves = ((piece_list & NOT_A_FILE) >> 9) & bad_team_mask;
-        while (moves) {
-            dest = pop_lsb(&moves);
-            add_black_pawnmoves(pbb, ml, 9, dest, pbb->piece_squares[dest], allMask, bad_kpos, 0);
+            start = dest - PAWN_CAPTURE9(good_color);
+            add_pawnmoves(pbb, ml, start - dest, dest, allMask, bad_kpos, (DISCOVERED_CHECK_SQUARES(start) >> dest) & 1, good_color);
         }
+    }
 
-        // castling
-        if (pbb->castling & B_CASTLE_KING) {
-            if ((!(allMask & castle_empty_square_mask[BLACK][0])) && (!(attackedMask & castle_safe_square_mask[BLACK][0]))) {
-                MOVELIST_ADD(ml, CREATE_BB_MOVE(E8, G8, 0, 0, (Rmagic(F8, allMask) & bad_kmask) ? MOVE_CHECK | MOVE_CASTLE: MOVE_CASTLE));
-            }
+    // castling - the king goes two squares from king_start, the rook lands on the square it crosses
+    if ((kinds & (BB_GEN_QUIETS | BB_GEN_QUIET_CHECKS)) && (pbb->castling & CASTLE_KING_RIGHT(good_color))) {
+        if ((!(allMask & castle_empty_square_mask[good_color][0])) && (!(attackedMask & castle_safe_square_mask[good_color][0]))) {
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(king_start, king_start + 2, 0, ((Rmagic(king_start + 1, allMask) & bad_kmask) | (SQUARE_MASKS[king_start + 2] & DISCOVERED_CHECK_SQUARES(king_start))) ? MOVE_CHECK | MOVE_CASTLE: MOVE_CASTLE));
         }
-        if (pbb->castling & B_CASTLE_QUEEN) {
-            if ((!(allMask & castle_empty_square_mask[BLACK][1])) && (!(attackedMask & castle_safe_square_mask[BLACK][1]))) {
-                MOVELIST_ADD(ml, CREATE_BB_MOVE(E8, C8, 0, 0, (Rmagic(D8, allMask) & bad_kmask) ? MOVE_CHECK | MOVE_CASTLE: MOVE_CASTLE));
-            }
+    }
+    if ((kinds & (BB_GEN_QUIETS | BB_GEN_QUIET_CHECKS)) && (pbb->castling & CASTLE_QUEEN_RIGHT(good_color))) {
+        if ((!(allMask & castle_empty_square_mask[good_color][1])) && (!(attackedMask & castle_safe_square_mask[good_color][1]))) {
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(king_start, king_start - 2, 0, ((Rmagic(king_start - 1, allMask) & bad_kmask) | (SQUARE_MASKS[king_start - 2] & DISCOVERED_CHECK_SQUARES(king_start))) ? MOVE_CHECK | MOVE_CASTLE: MOVE_CASTLE));
         }
     }
 
-    // these require the good/bad kpos to be set to be calculated.  If we need them before the above branch, then we need to move setting good/bad kpos so
-    // it doesn't require a branch.
-    pinned_piece_mask = generate_bb_pinned_list(pbb, kingpos, good_color, bad_color);
-    discovered_check_mask = generate_bb_pinned_list(pbb, bad_kpos, good_color, good_color);
-
-
-    // ep moves - super rare so no big hit by doing one potential extra branch to test color to move inside the pbb->eptarget.
-    if_unlikely(pbb->ep_target) {
-        generate_bb_ep_moves(pbb, ml);
+    // ep moves - super rare
+    if_unlikely((kinds & BB_GEN_CAPTURES) && pbb->ep_target) {
+        generate_bb_ep_moves(pbb, ml, good_color);
     }
 
 
@@ -1234,10 +1096,11 @@ void generate_bb_move_list_normal(struct bitChessBoard *pbb, struct MoveList *ml
     piece_list = pbb->piece_boards[BISHOP + good_color];
     while(piece_list) {
         start = pop_lsb(&piece_list);
-        moves = Bmagic(start, allMask) & not_good_team_mask;
+        moves = Bmagic(start, allMask) & (targets | QUIET_CHECK_TARGETS(start, bishop_checks)) & PIN_LINE(start);
+        discovery_squares = DISCOVERED_CHECK_SQUARES(start);
         while(moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, (Bmagic(dest, allMask) & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, ((Bmagic(dest, allMask) & bad_kmask) | ((discovery_squares >> dest) & 1)) ? MOVE_CHECK : 0));
         }
     }
 
@@ -1245,10 +1108,11 @@ void generate_bb_move_list_normal(struct bitChessBoard *pbb, struct MoveList *ml
     piece_list = pbb->piece_boards[ROOK + good_color];
     while(piece_list) {
         start = pop_lsb(&piece_list);
-        moves = Rmagic(start, allMask) & not_good_team_mask;
+        moves = Rmagic(start, allMask) & (targets | QUIET_CHECK_TARGETS(start, rook_checks)) & PIN_LINE(start);
+        discovery_squares = DISCOVERED_CHECK_SQUARES(start);
         while (moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, (Rmagic(dest, allMask) & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, ((Rmagic(dest, allMask) & bad_kmask) | ((discovery_squares >> dest) & 1)) ? MOVE_CHECK : 0));
         }
     }
 
@@ -1256,66 +1120,126 @@ void generate_bb_move_list_normal(struct bitChessBoard *pbb, struct MoveList *ml
     piece_list = pbb->piece_boards[QUEEN + good_color];
     while(piece_list) {
         start = pop_lsb(&piece_list);
-        moves = (Rmagic(start, allMask) | Bmagic(start, allMask)) & not_good_team_mask;
+        // a queen is never in the discovered check mask - it would already be giving check along that line
+        moves = (Rmagic(start, allMask) | Bmagic(start, allMask)) & (targets | QUIET_CHECK_TARGETS(start, bishop_checks | rook_checks)) & PIN_LINE(start);
         while (moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, ((Rmagic(dest, allMask) | (Bmagic(dest, allMask))) & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, ((Rmagic(dest, allMask) | (Bmagic(dest, allMask))) & bad_kmask) ? MOVE_CHECK : 0));
         }
     }
 
     // generate standard king moves
-    moves = KING_MOVES[kingpos] & not_good_team_mask;
+    moves = KING_MOVES[kingpos] & (targets | QUIET_CHECK_TARGETS(kingpos, 0)) & ~attackedMask;
+    discovery_squares = DISCOVERED_CHECK_SQUARES(kingpos);
     while (moves) {
         dest = pop_lsb(&moves);
-        if (!(attackedMask & SQUARE_MASKS[dest])) {
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(kingpos, dest, pbb->piece_squares[dest], 0, 0));
-        }
+        MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(kingpos, dest, 0, ((discovery_squares >> dest) & 1) ? MOVE_CHECK : 0));
     }
 
     // generate knight moves and captures
-    piece_list = pbb->piece_boards[KNIGHT + good_color];
+    // a pinned knight can never stay on its pin line
+    piece_list = pbb->piece_boards[KNIGHT + good_color] & ~pinned_piece_mask;
     while(piece_list) {
         start = pop_lsb(&piece_list);
-        moves = KNIGHT_MOVES[start] & not_good_team_mask;
+        moves = KNIGHT_MOVES[start] & (targets | QUIET_CHECK_TARGETS(start, knight_checks));
+        // and a knight in the discovered check mask always leaves its line
+        discovery_squares = ((discovered_check_mask >> start) & 1) ? ~0ul : 0;
         while(moves) {
             dest = pop_lsb(&moves);
-            MOVELIST_ADD(ml, CREATE_BB_MOVE(start, dest, pbb->piece_squares[dest], 0, (KNIGHT_MOVES[dest] & bad_kmask) ? MOVE_CHECK : 0));
+            MOVELIST_ADD(ml, CREATE_COMPACT_BB_MOVE(start, dest, 0, ((KNIGHT_MOVES[dest] & bad_kmask) | ((discovery_squares >> dest) & 1)) ? MOVE_CHECK : 0));
         }
     }
 
+    if (kinds & BB_GEN_QUIET_CHECKS) {
+        // castling, and pawns that stayed on the line they were blocking, were generated without knowing
+        for (i = j = 0; i < ml->size; i++) {
+            if (ml->moves[i] & CM_CHECK) {
+                ml->moves[j++] = ml->moves[i];
+            }
+        }
+        ml->size = j;
+    }
+#undef QUIET_CHECK_TARGETS
+#undef PIN_LINE
+#undef DISCOVERED_CHECK_SQUARES
+}
 
+// Most positions have neither pins nor discovered checks, and get a copy of the generator with both masks folded
+// away.
+static inline __attribute__((always_inline)) void generate_bb_moves_for(struct bitChessBoard *pbb, struct bitMoveList *ml, int kinds, const int good_color)
+{
+    int kingpos, bad_kpos;
+    uint_64 pinned_piece_mask, discovered_check_mask;
+
+    kingpos = KING_POS(pbb, good_color);
+    bad_kpos = KING_POS(pbb, good_color ^ BLACK);
+    pinned_piece_mask = generate_bb_pinned_list(pbb, kingpos, good_color, good_color ^ BLACK);
+    discovered_check_mask = generate_bb_pinned_list(pbb, bad_kpos, good_color, good_color);
+
+    if (pinned_piece_mask | discovered_check_mask) {
+        generate_bb_moves_with_masks(pbb, ml, kinds, good_color, kingpos, bad_kpos, pinned_piece_mask, discovered_check_mask);
+    } else {
+        generate_bb_moves_with_masks(pbb, ml, kinds, good_color, kingpos, bad_kpos, 0, 0);
+    }
+}
 
+static inline __attribute__((always_inline)) void generate_bb_moves_not_in_check(struct bitChessBoard *pbb, struct bitMoveList *ml, int kinds)
+{
+    if (pbb->side_to_move == WHITE) {
+        generate_bb_moves_for(pbb, ml, kinds, WHITE);
+    } else {
+        generate_bb_moves_for(pbb, ml, kinds, BLACK);
+    }
+}
 
+void generate_bb_move_list_normal(struct bitChessBoard *pbb, struct bitMoveList *ml)
+{
+    generate_bb_moves_not_in_check(pbb, ml, BB_GEN_ALL);
+}
 
-    // now we will remove any illegal moves due to illegally moving a pinned piece, and mark any moves that put the enemy in check.
+// Captures, en passant and promotions (including the underpromotions) - the first thing a staged move picker or a
+// quiescence search wants.  In check, the evasions that capture or promote.
+void generate_bb_captures(struct bitChessBoard *pbb, struct bitMoveList *ml)
+{
+    int i, j;
 
-    // TODO - decide if testing discovered check mask or pinned piece mask helps us or hurts us.
-    // run stats to see how often we go through this loop in games and in perft testing to see.
-    if (discovered_check_mask | pinned_piece_mask) {
-        for (i = ml->size - 1; i >= 0; i--) {
-            m = ml->moves[i];
-            start = GET_START(m);
-            removed_move = false;
-            if (SQUARE_MASKS[start] & pinned_piece_mask) {
-                // if the move does not end on the line between the current piece and the good king,
-                // the piece is putting the good king in check and it is an illegal move
-                if (! (SQUARE_MASKS[GET_END(m)] & LINES_THROUGH[start][kingpos])) {
-                    movelist_remove(ml, i);
-                    removed_move = true;
-                }
-            }
-            if ((!removed_move) && (SQUARE_MASKS[start] & discovered_check_mask)) {
-                //if the move takes the piece out of the line between current piece and bad king,
-                // the piece is putting the bad king in check.
-                if (! (SQUARE_MASKS[GET_END(m)] & LINES_THROUGH[start][bad_kpos])) {
-                    ml->moves[i] |= ((Move) (MOVE_CHECK) << MOVE_FLAGS_SHIFT);
-                }
+    if (pbb->in_check) {
+        // evasions are few, filtering them in one pass costs less than teaching the evasion generator about kinds
+        generate_bb_move_list_in_check(pbb, ml);
+        for (i = j = 0; i < ml->size; i++) {
+            if (BB_IS_CAPTURE_OR_PROMOTION(pbb, ml->moves[i])) {
+                ml->moves[j++] = ml->moves[i];
             }
         }
+        ml->size = j;
+    } else {
+        generate_bb_moves_not_in_check(pbb, ml, BB_GEN_CAPTURES);
     }
 }
 
-void generate_bb_move_list(struct bitChessBoard *pbb, MoveList *ml)
+// Non-capturing, non-promoting moves that give check, directly or by discovery, with the same MOVE_CHECK flags as
+// generate_bb_move_list().  Only for positions that are not in check.
+void generate_bb_quiet_checks(struct bitChessBoard *pbb, struct bitMoveList *ml)
+{
+    assert(!pbb->in_check);
+    generate_bb_moves_not_in_check(pbb, ml, BB_GEN_QUIET_CHECKS);
+}
+
+// All legal moves out of check.
+void generate_bb_evasions(struct bitChessBoard *pbb, struct bitMoveList *ml)
+{
+    assert(pbb->in_check);
+    generate_bb_move_list_in_check(pbb, ml);
+}
+
+// Everything generate_bb_captures() leaves out: non-capturing moves other than promotions, and castling.
+void generate_bb_quiets(struct bitChessBoard *pbb, struct bitMoveList *ml)
+{
+    assert(!pbb->in_check);
+    generate_bb_moves_not_in_check(pbb, ml, BB_GEN_QUIETS);
+}
+
+void generate_bb_move_list(struct bitChessBoard *pbb, struct bitMoveList *ml)
 {
     if (pbb->in_check) {
         generate_bb_move_list_in_check(pbb, ml);
@@ -1324,19 +1248,170 @@ void generate_bb_move_list(struct bitChessBoard *pbb, MoveList *ml)
     }
 }
 
-void apply_bb_move(struct bitChessBoard *pbb, Move m)
+// Like pieces_attacking_square(), but on a set of boards that has not been written back to a position.
+static inline uint_64 attackers_on_boards(const uint_64 *boards, uint_64 occupied, int square, int color_attacking)
 {
+    const uint_64 *pawn_attacks = (color_attacking == WHITE) ? WHITE_PAWN_ATTACKSTO : BLACK_PAWN_ATTACKSTO;
 
-    int start, end, piece_moving, piece_captured, promoted_to, move_flags, ep_target, color_moving;
+    return (pawn_attacks[square] & boards[PAWN + color_attacking]) |
+           (KNIGHT_MOVES[square] & boards[KNIGHT + color_attacking]) |
+           (KING_MOVES[square] & boards[KING + color_attacking]) |
+           (Bmagic(square, occupied) & (boards[BISHOP + color_attacking] | boards[QUEEN + color_attacking])) |
+           (Rmagic(square, occupied) & (boards[ROOK + color_attacking] | boards[QUEEN + color_attacking]));
+}
+
+// For moves that come from somewhere other than the generator for this position - the TT, or a killer found in a
+// sibling.  Returns the move as generate_bb_move_list() would have produced it here (captured piece and flags
+// recomputed), or NULL_MOVE if it is not legal here.  Never modifies the position.
+Move bb_validate_move(const struct bitChessBoard *pbb, Move m)
+{
+    uint_64 boards[16];
+    uint_64 start_mask, end_mask, occupied, rook_delta;
+    int start = GET_START(m);
+    int end = GET_END(m);
+    int promoted_to = GET_PROMOTED_TO(m);
+    int good_color = pbb->side_to_move;
+    int bad_color = opposite_color[good_color];
+    int piece, captured, captured_square, flags = 0, side, kingpos, sq;
+    int push = (good_color == WHITE) ? 8 : -8;
+    uint_64 safe;
+
+    if (m == NULL_MOVE || start > 63 || end > 63 || start == end) {
+        return NULL_MOVE;
+    }
+    start_mask = SQUARE_MASKS[start];
+    end_mask = SQUARE_MASKS[end];
+    piece = BB_PIECE_ON(pbb, start);
+    if (piece == EMPTY || (piece & BLACK) != good_color || (pbb->piece_boards[good_color] & end_mask)) {
+        return NULL_MOVE;
+    }
+    captured = BB_PIECE_ON(pbb, end);
+    captured_square = end;
+    occupied = pbb->piece_boards[ALL_PIECES];
+
+    if (PIECE_BITS(piece) == PAWN && (end_mask & (RANK_1 | RANK_8))) {
+        if (promoted_to < KNIGHT + good_color || promoted_to > QUEEN + good_color) {
+            return NULL_MOVE;
+        }
+    } else if (promoted_to) {
+        return NULL_MOVE;
+    }
+
+    switch (PIECE_BITS(piece)) {
+        case PAWN:
+            if (end == start + push && !captured) {
+                break;
+            } else if (end == start + 2 * push && !captured && !(occupied & SQUARE_MASKS[start + push]) &&
+                       (start_mask & (good_color == WHITE ? RANK_2 : RANK_7))) {
+                flags |= MOVE_DOUBLE_PAWN;
+                break;
+            } else if (start_mask & (good_color == WHITE ? WHITE_PAWN_ATTACKSTO : BLACK_PAWN_ATTACKSTO)[end]) {
+                if (captured) {
+                    break;
+                } else if (pbb->ep_target && end == pbb->ep_target) {
+                    flags |= MOVE_EN_PASSANT;
+                    captured = PAWN + bad_color;
+                    captured_square = end - push;
+                    break;
+                }
+            }
+            return NULL_MOVE;
+        case KNIGHT:
+            if (!(KNIGHT_MOVES[start] & end_mask)) {
+                return NULL_MOVE;
+            }
+            break;
+        case BISHOP:
+            if (!(Bmagic(start, occupied) & end_mask)) {
+                return NULL_MOVE;
+            }
+            break;
+        case ROOK:
+            if (!(Rmagic(start, occupied) & end_mask)) {
+                return NULL_MOVE;
+            }
+            break;
+        case QUEEN:
+            if (!((Rmagic(start, occupied) | Bmagic(start, occupied)) & end_mask)) {
+                return NULL_MOVE;
+            }
+            break;
+        case KING:
+            if (KING_MOVES[start] & end_mask) {
+                break;
+            }
+            // castling - the rights say the king and rook are home, the rest has to be checked
+            if (pbb->in_check || start != (good_color == WHITE ? E1 : E8)) {
+                return NULL_MOVE;
+            }
+            if (end == start + 2 && (pbb->castling & (good_color == WHITE ? W_CASTLE_KING : B_CASTLE_KING))) {
+                side = 0;
+            } else if (end == start - 2 && (pbb->castling & (good_color == WHITE ? W_CASTLE_QUEEN : B_CASTLE_QUEEN))) {
+                side = 1;
+            } else {
+                return NULL_MOVE;
+            }
+            if (occupied & castle_empty_square_mask[good_color][side]) {
+                return NULL_MOVE;
+            }
+            safe = castle_safe_square_mask[good_color][side];
+            while (safe) {
+                sq = pop_lsb(&safe);
+                if (attackers_on_boards(pbb->piece_boards, occupied, sq, bad_color)) {
+                    return NULL_MOVE;
+                }
+            }
+            flags |= MOVE_CASTLE;
+            break;
+        default:
+            return NULL_MOVE;
+    }
+    if (captured && PIECE_BITS(captured) == KING) {
+        return NULL_MOVE;
+    }
+
+    // play it on a copy of the bitboards to see whether our king is left attacked and theirs is attacked
+    memcpy(boards, pbb->piece_boards, sizeof(boards));
+    boards[piece] &= ~start_mask;
+    boards[promoted_to ? promoted_to : piece] |= end_mask;
+    boards[good_color] ^= start_mask | end_mask;
+    if (captured) {
+        boards[captured] &= NOT_MASKS[captured_square];
+        boards[bad_color] &= NOT_MASKS[captured_square];
+    }
+    if (flags & MOVE_CASTLE) {
+        rook_delta = (end > start) ? kcastle_move_masks[good_color][1] : qcastle_move_masks[good_color][1];
+        boards[ROOK + good_color] ^= rook_delta;
+        boards[good_color] ^= rook_delta;
+    }
+    occupied = boards[WHITE] | boards[BLACK];
+
+    kingpos = GET_LSB(boards[KING + good_color]);
+    if (attackers_on_boards(boards, occupied, kingpos, bad_color)) {
+        return NULL_MOVE;
+    }
+    if (attackers_on_boards(boards, occupied, GET_LSB(boards[KING + bad_color]), good_color)) {
+        flags |= MOVE_CHECK;
+    }
+    return CREATE_BB_MOVE(start, end, captured, promoted_to, flags);
+}
+
+static inline __attribute__((always_inline)) void apply_bb_move_for(struct bitChessBoard *pbb, Move m, const int color_moving)
+{
+
+    int start, end, piece_moving, piece_captured, promoted_to, move_flags, ep_target;
     uint_64 delta;
+#ifdef INCREMENTAL_ATTACKS
+    uint_64 old_white_view = BB_ATTACK_VIEW(pbb, WHITE);
+    uint_64 old_black_view = BB_ATTACK_VIEW(pbb, BLACK);
+#endif
 
     start = GET_START(m);
     end = GET_END(m);
     piece_captured = GET_PIECE_CAPTURED(m);
     promoted_to = GET_PROMOTED_TO(m);
-    piece_moving = pbb->piece_squares[start];
+    piece_moving = BB_PIECE_ON(pbb, start);
     move_flags = GET_FLAGS(m);
-    color_moving = pbb->side_to_move;
     delta = SQUARE_MASKS[start] | SQUARE_MASKS[end];
 
 #ifndef DISABLE_HASH
@@ -1344,10 +1419,16 @@ void apply_bb_move(struct bitChessBoard *pbb, Move m)
     pbb->hash ^= bb_hash_enpassanttarget[pbb->ep_target];
     pbb->hash ^= bb_piece_hash[piece_moving][start];
 #endif
+    if (piece_moving == PAWN + color_moving) {
+        pbb->pawn_hash ^= bb_piece_hash[piece_moving][start];
+        if (!promoted_to) {
+            pbb->pawn_hash ^= bb_piece_hash[piece_moving][end];
+        }
+    }
 
 
     pbb->ep_target = 0;  // cheaper to set once then have "else" conditions on 2 branches inside
-    pbb->piece_squares[start] = EMPTY;
+    BB_PUT_PIECE(pbb, start, EMPTY);
     pbb->castling &= castle_move_mask[start];
 
 
@@ -1356,14 +1437,17 @@ void apply_bb_move(struct bitChessBoard *pbb, Move m)
     if (promoted_to) {
         pbb->piece_boards[piece_moving] &= NOT_MASKS[start];
         pbb->piece_boards[promoted_to] |= SQUARE_MASKS[end];
-        pbb->piece_squares[end] = promoted_to;
+        BB_PUT_PIECE(pbb, end, promoted_to);
+        bb_pst_remove(pbb, piece_moving, start);
+        bb_pst_add(pbb, promoted_to, end);
+        pbb->material_key += MATERIAL_KEY_UNIT[promoted_to];
 #ifndef DISABLE_HASH
         pbb->hash ^= bb_piece_hash[promoted_to][end];
 #endif
     } else {
-        ;
         pbb->piece_boards[piece_moving] ^= delta;
-        pbb->piece_squares[end] = piece_moving;
+        BB_PUT_PIECE(pbb, end, piece_moving);
+        bb_pst_move(pbb, piece_moving, start, end);
 #ifndef DISABLE_HASH
         pbb->hash ^= bb_piece_hash[piece_moving][end];
 #endif
@@ -1374,49 +1458,36 @@ void apply_bb_move(struct bitChessBoard *pbb, Move m)
     if (piece_captured) {
         pbb->halfmove_clock = -1;  // will get bumped to zero when we increment below
         if_unlikely (move_flags & MOVE_EN_PASSANT) {
-            if (color_moving == WHITE) {
-                pbb->piece_boards[BP] &= NOT_MASKS[end-8];
-                pbb->piece_boards[BLACK] &= NOT_MASKS[end-8];
-                pbb->piece_squares[end-8] = EMPTY;
-#ifndef DISABLE_HASH
-                pbb->hash ^= bb_piece_hash[BP][end-8];
-#endif
-            } else {
-                pbb->piece_boards[WP] &= NOT_MASKS[end+8];
-                pbb->piece_boards[WHITE] &= NOT_MASKS[end+8];
-                pbb->piece_squares[end+8] = EMPTY;
+            int captured_square = end - PAWN_PUSH(color_moving);
+            pbb->piece_boards[PAWN + (color_moving ^ BLACK)] &= NOT_MASKS[captured_square];
+            pbb->piece_boards[color_moving ^ BLACK] &= NOT_MASKS[captured_square];
+            BB_PUT_PIECE(pbb, captured_square, EMPTY);
+            bb_pst_remove(pbb, PAWN + (color_moving ^ BLACK), captured_square);
+            pbb->pawn_hash ^= bb_piece_hash[PAWN + (color_moving ^ BLACK)][captured_square];
 #ifndef DISABLE_HASH
-                pbb->hash ^= bb_piece_hash[WP][end+8];
+            pbb->hash ^= bb_piece_hash[PAWN + (color_moving ^ BLACK)][captured_square];
 #endif
-            }
-
         } else {
             pbb->castling &= castle_move_mask[end]; // this catches rook captures
             pbb->piece_boards[piece_captured] &= NOT_MASKS[end];
             pbb->piece_boards[color_moving ^ BLACK] &= NOT_MASKS[end];
+            bb_pst_remove(pbb, piece_captured, end);
+            pbb->material_key -= MATERIAL_KEY_UNIT[piece_captured];
+            if (piece_captured == PAWN + (color_moving ^ BLACK)) {
+                pbb->pawn_hash ^= bb_piece_hash[piece_captured][end];
+            }
 
 #ifndef DISABLE_HASH
             pbb->hash ^= bb_piece_hash[piece_captured][end];
 #endif
         }
     } else if (move_flags & MOVE_DOUBLE_PAWN) {
-        if (color_moving == WHITE) {
-            ep_target = end-8;
-            if_unlikely(BLACK_PAWN_ATTACKSTO[ep_target] & pbb->piece_boards[BP]) {
-                pbb->ep_target = ep_target;
-#ifndef DISABLE_HASH
-                pbb->hash ^= bb_hash_enpassanttarget[ep_target];
-#endif
-            }
-
-        } else {
-            ep_target = end+8;
-            if_unlikely(WHITE_PAWN_ATTACKSTO[ep_target] & pbb->piece_boards[WP]) {
-                pbb->ep_target = ep_target;
+        ep_target = end - PAWN_PUSH(color_moving);
+        if_unlikely(PAWN_ATTACKSTO(color_moving ^ BLACK)[ep_target] & pbb->piece_boards[PAWN + (color_moving ^ BLACK)]) {
+            pbb->ep_target = ep_target;
 #ifndef DISABLE_HASH
-                pbb->hash ^= bb_hash_enpassanttarget[ep_target];
+            pbb->hash ^= bb_hash_enpassanttarget[ep_target];
 #endif
-            }
         }
     } else if (move_flags & MOVE_CASTLE) {
 
@@ -1424,8 +1495,9 @@ void apply_bb_move(struct bitChessBoard *pbb, Move m)
             // king side
             pbb->piece_boards[ROOK + color_moving] ^= kcastle_move_masks[color_moving][1];
             pbb->piece_boards[color_moving] ^= kcastle_move_masks[color_moving][1];
-            pbb->piece_squares[start+3] = EMPTY;
-            pbb->piece_squares[start+1] = ROOK + color_moving;
+            BB_PUT_PIECE(pbb, start+3, EMPTY);
+            BB_PUT_PIECE(pbb, start+1, ROOK + color_moving);
+            bb_pst_move(pbb, ROOK + color_moving, start+3, start+1);
 #ifndef DISABLE_HASH
             pbb->hash ^= bb_piece_hash[WR+color_moving][start+3];
             pbb->hash ^= bb_piece_hash[WR+color_moving][start+1];
@@ -1433,8 +1505,9 @@ void apply_bb_move(struct bitChessBoard *pbb, Move m)
         } else {
             pbb->piece_boards[ROOK + color_moving] ^= qcastle_move_masks[color_moving][1];
             pbb->piece_boards[color_moving] ^= qcastle_move_masks[color_moving][1];
-            pbb->piece_squares[start-4] = EMPTY;
-            pbb->piece_squares[start-1] = ROOK+color_moving;
+            BB_PUT_PIECE(pbb, start-4, EMPTY);
+            BB_PUT_PIECE(pbb, start-1, ROOK+color_moving);
+            bb_pst_move(pbb, ROOK + color_moving, start-4, start-1);
 #ifndef DISABLE_HASH
             pbb->hash ^= bb_piece_hash[WR + color_moving][start-1];
             pbb->hash ^= bb_piece_hash[WR + color_moving][start-4];
@@ -1456,6 +1529,9 @@ void apply_bb_move(struct bitChessBoard *pbb, Move m)
     // TODO validate that this performs better than "If piece_moving == WK then set wk_pos..."
     pbb->wk_pos = GET_LSB(pbb->piece_boards[WK]);
     pbb->bk_pos = GET_LSB(pbb->piece_boards[BK]);
+#ifdef INCREMENTAL_ATTACKS
+    update_bb_attacks(pbb, delta, old_white_view, old_black_view);
+#endif
 
 
 
@@ -1476,10 +1552,20 @@ void apply_bb_move(struct bitChessBoard *pbb, Move m)
     #ifndef DISABLE_HASH
         assert(pbb->hash == compute_bitboard_hash(pbb));
     #endif
+    assert(pbb->pawn_hash == compute_bitboard_pawn_hash(pbb));
 #endif
 
 }
 
+void apply_bb_move(struct bitChessBoard *pbb, Move m)
+{
+    if (pbb->side_to_move == WHITE) {
+        apply_bb_move_for(pbb, m, WHITE);
+    } else {
+        apply_bb_move_for(pbb, m, BLACK);
+    }
+}
+
 void debugprint_bb_move_history(const struct bitChessBoard *pbb) {
 
 #ifndef NO_STORE_HISTORY
@@ -1552,9 +1638,9 @@ bool validate_board_sanity(struct bitChessBoard *pbb)
     }
 
     for (i=1; i<64;i++) {
-        if (pbb->piece_squares[i] != EMPTY) {
-            if (!(SQUARE_MASKS[i] & pbb->piece_boards[pbb->piece_squares[i]])) {
-                printf("Piece Squares has %d on square %d but piece boards is empty.\n", (unsigned int)pbb->piece_squares[i], i);
+        if (BB_PIECE_ON(pbb, i) != EMPTY) {
+            if (!(SQUARE_MASKS[i] & pbb->piece_boards[BB_PIECE_ON(pbb, i)])) {
+                printf("Piece Squares has %d on square %d but piece boards is empty.\n", (unsigned int)BB_PIECE_ON(pbb, i), i);
                 ret = false;
             }
         }
@@ -1573,6 +1659,36 @@ bool validate_board_sanity(struct bitChessBoard *pbb)
         ret = false;
     }
 
+    {
+        struct bitChessBoard fresh = *pbb;
+
+        compute_bb_eval_totals(&fresh);
+        if (fresh.pst_mg != pbb->pst_mg || fresh.pst_eg != pbb->pst_eg || fresh.material_key != pbb->material_key) {
+            printf("Eval totals are %d/%d material %x, should be %d/%d material %x\n", pbb->pst_mg, pbb->pst_eg,
+                   pbb->material_key, fresh.pst_mg, fresh.pst_eg, fresh.material_key);
+            ret = false;
+        }
+    }
+
+#ifdef INCREMENTAL_ATTACKS
+    {
+        struct bitChessBoard fresh = *pbb;
+
+        compute_bb_attacks(&fresh);
+        for (i = 0; i < 64; i++) {
+            if (fresh.attacks_from[i] != pbb->attacks_from[i]) {
+                printf("Attacks from square %d are %lx, should be %lx\n", i, pbb->attacks_from[i], fresh.attacks_from[i]);
+                ret = false;
+            }
+        }
+        if (fresh.attacked_by[WHITE] != pbb->attacked_by[WHITE] || fresh.attacked_by[BLACK] != pbb->attacked_by[BLACK] ||
+            fresh.king_attackers != pbb->king_attackers) {
+            printf("Attacked squares or king attackers out of date\n");
+            ret = false;
+        }
+    }
+#endif
+
     if (!ret) {
         tmpstr = convert_bitboard_to_fen(pbb);
         printf("Above errors were for board: %s\n", tmpstr);
@@ -1589,21 +1705,29 @@ void store_bb_attrs(const struct bitChessBoard *pbb, struct bitChessBoardAttrs *
     pa->ep_target = pbb->ep_target;
     pa->halfmove_clock = pbb->halfmove_clock;
     pa->in_check = pbb->in_check;
+    pa->pst_mg = pbb->pst_mg;
+    pa->pst_eg = pbb->pst_eg;
+    pa->material_key = pbb->material_key;
+    pa->pawn_hash = pbb->pawn_hash;
 }
 
-void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardAttrs *pa)
+static inline __attribute__((always_inline)) void undo_bb_move_for(struct bitChessBoard *pbb, Move m, const struct bitChessBoardAttrs *pa, const int color_moving)
 {
-    int piece_moving, color_moving;
+    int piece_moving;
     int promoted_to = GET_PROMOTED_TO(m);
     int start = GET_START(m);
     int end = GET_END(m);
     uint_64 delta = SQUARE_MASKS[start] | SQUARE_MASKS[end];
     int piece_captured = GET_PIECE_CAPTURED(m);
     int move_flags = GET_FLAGS(m);
+#ifdef INCREMENTAL_ATTACKS
+    uint_64 old_white_view = BB_ATTACK_VIEW(pbb, WHITE);
+    uint_64 old_black_view = BB_ATTACK_VIEW(pbb, BLACK);
+#endif
 
 
 
-    color_moving = (pbb->side_to_move ^= BLACK);
+    pbb->side_to_move = color_moving;
 
     if (promoted_to) {
         piece_moving = PAWN + color_moving;
@@ -1613,14 +1737,14 @@ void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardA
         pbb->hash ^= bb_piece_hash[promoted_to][end];
 #endif
     } else {
-        piece_moving = pbb->piece_squares[end];
+        piece_moving = BB_PIECE_ON(pbb, end);
         pbb->piece_boards[piece_moving] ^= delta;
 #ifndef DISABLE_HASH
         pbb->hash ^= bb_piece_hash[piece_moving][end];
 #endif
     }
     pbb->piece_boards[color_moving] ^= delta;
-    pbb->piece_squares[start] = piece_moving;
+    BB_PUT_PIECE(pbb, start, piece_moving);
 
 #ifndef DISABLE_HASH
     pbb->hash ^= bb_hash_castling[pbb->castling];
@@ -1633,25 +1757,16 @@ void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardA
 
     if (piece_captured) {
         if_unlikely (move_flags & MOVE_EN_PASSANT) {
-            if (color_moving == WHITE) {
-                pbb->piece_boards[BP] |= SQUARE_MASKS[end-8];
-                pbb->piece_boards[BLACK] |= SQUARE_MASKS[end-8];
-                pbb->piece_squares[end-8] = BP;
-                pbb->piece_squares[end] = EMPTY;
+            int captured_square = end - PAWN_PUSH(color_moving);
+            pbb->piece_boards[PAWN + (color_moving ^ BLACK)] |= SQUARE_MASKS[captured_square];
+            pbb->piece_boards[color_moving ^ BLACK] |= SQUARE_MASKS[captured_square];
+            BB_PUT_PIECE(pbb, captured_square, PAWN + (color_moving ^ BLACK));
+            BB_PUT_PIECE(pbb, end, EMPTY);
 #ifndef DISABLE_HASH
-                pbb->hash ^= bb_piece_hash[BP][end-8];
+            pbb->hash ^= bb_piece_hash[PAWN + (color_moving ^ BLACK)][captured_square];
 #endif
-            } else {
-                pbb->piece_boards[WP] |= SQUARE_MASKS[end+8];
-                pbb->piece_boards[WHITE] |= SQUARE_MASKS[end+8];
-                pbb->piece_squares[end+8] = WP;
-                pbb->piece_squares[end] = EMPTY;
-#ifndef DISABLE_HASH
-                pbb->hash ^= bb_piece_hash[WP][end+8];
-#endif
-            }
         } else {
-            pbb->piece_squares[end] = piece_captured;
+            BB_PUT_PIECE(pbb, end, piece_captured);
             pbb->piece_boards[piece_captured] |= SQUARE_MASKS[end];
             pbb->piece_boards[color_moving ^ BLACK] |= SQUARE_MASKS[end];
 #ifndef DISABLE_HASH
@@ -1659,15 +1774,15 @@ void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardA
 #endif
         }
     } else {
-        pbb->piece_squares[end] = EMPTY;
+        BB_PUT_PIECE(pbb, end, EMPTY);
     }
 
     if (move_flags & MOVE_CASTLE) {
         if (end > start) {
             pbb->piece_boards[ROOK + color_moving] ^= kcastle_move_masks[color_moving][1];
             pbb->piece_boards[color_moving] ^= kcastle_move_masks[color_moving][1];
-            pbb->piece_squares[start+1] = EMPTY;
-            pbb->piece_squares[start+3] = ROOK + color_moving;
+            BB_PUT_PIECE(pbb, start+1, EMPTY);
+            BB_PUT_PIECE(pbb, start+3, ROOK + color_moving);
 #ifndef DISABLE_HASH
             pbb->hash ^= bb_piece_hash[WR+color_moving][start+3];
             pbb->hash ^= bb_piece_hash[WR+color_moving][start+1];
@@ -1675,8 +1790,8 @@ void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardA
         } else {
             pbb->piece_boards[ROOK + color_moving] ^= qcastle_move_masks[color_moving][1];
             pbb->piece_boards[color_moving] ^= qcastle_move_masks[color_moving][1];
-            pbb->piece_squares[start-4] = ROOK + color_moving;
-            pbb->piece_squares[start-1] = EMPTY;
+            BB_PUT_PIECE(pbb, start-4, ROOK + color_moving);
+            BB_PUT_PIECE(pbb, start-1, EMPTY);
 #ifndef DISABLE_HASH
             pbb->hash ^= bb_piece_hash[WR + color_moving][start-1];
             pbb->hash ^= bb_piece_hash[WR + color_moving][start-4];
@@ -1691,9 +1806,16 @@ void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardA
     pbb->castling = pa->castling;
     pbb->ep_target = pa->ep_target;
     pbb->halfmove_clock = pa->halfmove_clock;
+    pbb->pst_mg = pa->pst_mg;
+    pbb->pst_eg = pa->pst_eg;
+    pbb->material_key = pa->material_key;
+    pbb->pawn_hash = pa->pawn_hash;
     // TODO validate that this performs better than "If piece_moving == WK then set wk_pos..."
     pbb->wk_pos = GET_LSB(pbb->piece_boards[WK]);
     pbb->bk_pos = GET_LSB(pbb->piece_boards[BK]);
+#ifdef INCREMENTAL_ATTACKS
+    update_bb_attacks(pbb, delta, old_white_view, old_black_view);
+#endif
 
 
 
@@ -1715,5 +1837,16 @@ void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardA
     #ifndef DISABLE_HASH
     assert(pbb->hash == compute_bitboard_hash(pbb));
     #endif
+    assert(pbb->pawn_hash == compute_bitboard_pawn_hash(pbb));
 #endif
-}
\ No newline at end of file
+}
+
+void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardAttrs *pa)
+{
+    // side_to_move is still the side that replied to m
+    if (pbb->side_to_move == BLACK) {
+        undo_bb_move_for(pbb, m, pa, WHITE);
+    } else {
+        undo_bb_move_for(pbb, m, pa, BLACK);
+    }
+}
@@ -35,7 +35,7 @@ typedef enum boardlayout {
 } boardlayout;
 
 
-// NOTE: Below constants generated by bitboard_constant_generation.c and then pasted here for faster execution.
+// NOTE: Below constants are generated by bitboard_constant_generation.c at build time, into bitboard_tables.h.
 
 // Masks to find specific squares
 // Example: D1 is enum 3, so square_masks[3] would equal 2^3 - a bit mask that had one bit set for the corresponding square
@@ -102,23 +102,60 @@ extern const uint_64 BLACK_PAWN_ATTACKSTO[64];
 
 typedef struct bitChessBoard {
     uint_64 piece_boards[16];
-    unsigned char piece_squares[64];  // which piece is on which square
-    int ep_target;
-    int halfmove_clock;
-    int castling;
-    int side_to_move;  // 0 = WHITE, 8 = BLACK;
+#ifdef COPY_MAKE
+    unsigned char piece_squares[32];  // which piece is on which square, two squares a byte - use BB_PIECE_ON()
+#else
+    unsigned char piece_squares[64];  // which piece is on which square - use BB_PIECE_ON()
+#endif
+#ifndef DISABLE_HASH
+    uint_64 hash;
+#endif
+    uint_64 pawn_hash;      // the pawns' share of hash, the key to the pawn hash table in evaluate_board.c
+    unsigned short halfmove_clock;
+    unsigned char ep_target;
+    unsigned char castling;
+    unsigned char side_to_move;  // 0 = WHITE, 8 = BLACK;
     bool in_check;
-    int wk_pos;
-    int bk_pos;
+    signed char wk_pos;
+    signed char bk_pos;
+    short pst_mg;           // running eval totals, see evaluate_board.h
+    short pst_eg;
+    unsigned int material_key;  // the piece counts, less pawns and kings, see MATERIAL_KEY_UNIT in evaluate_board.h
 #ifndef NO_STORE_HISTORY
     unsigned char halfmoves_completed;
     int fullmove_number;
     Move move_history[MAX_MOVE_HISTORY];
 #endif
-#ifndef DISABLE_HASH
-    uint_64 hash;
+#ifdef INCREMENTAL_ATTACKS
+    // Kept up to date by apply_bb_move() and undo_bb_move() instead of being rebuilt by each generator call.  Sliders
+    // see through the enemy king, as the king may not step back along the ray it is attacked on.
+    uint_64 attacks_from[64];   // squares attacked by the piece on each square, 0 for an empty square
+    uint_64 attacked_by[9];     // [WHITE] and [BLACK] - every square the side attacks
+    uint_64 king_attackers;     // pieces giving check to the side to move
+#endif
+} __attribute__((aligned(64))) bitChessBoard;
+
+// Copy-make (see COPY_MAKE in CMakeLists.txt) copies the board whole at every ply, so there the squares are packed
+// two to a byte and the board is 192 bytes, three cache lines once aligned (more with INCREMENTAL_ATTACKS).
+// Make/unmake only touches the squares, which are cheaper to read and write a byte each, and the board is four cache
+// lines.  Heap copies need aligned_alloc(64, ...).
+#ifdef COPY_MAKE
+#define BB_PIECE_ON(pbb, sq) (((pbb)->piece_squares[(sq) >> 1] >> (((sq) & 1) << 2)) & 15)
+#define BB_PUT_PIECE(pbb, sq, piece) ((pbb)->piece_squares[(sq) >> 1] = ((pbb)->piece_squares[(sq) >> 1] & (0xf0 >> (((sq) & 1) << 2))) | ((piece) << (((sq) & 1) << 2)))
+#else
+#define BB_PIECE_ON(pbb, sq) ((pbb)->piece_squares[sq])
+#define BB_PUT_PIECE(pbb, sq, piece) ((pbb)->piece_squares[sq] = (piece))
 #endif
-} bitChessBoard;
+
+// Move list for the bitboard generators - compact moves, so a list is about 512 bytes against 2K for a MoveList.
+// The moves are only meaningful together with the position they were generated for.
+typedef struct bitMoveList {
+    int size;
+    CompactMove moves[MAX_MOVELIST_SIZE];
+} bitMoveList;
+
+// Whether a compact move generated for pbb takes a piece (en passant included) or promotes.
+#define BB_IS_CAPTURE_OR_PROMOTION(pbb, cm) (BB_PIECE_ON(pbb, CM_END(cm)) != EMPTY || CM_KIND(cm) >= CM_EN_PASSANT)
 
 // attributes that need to be restored when a move is undone.
 typedef struct bitChessBoardAttrs {
@@ -126,6 +163,10 @@ typedef struct bitChessBoardAttrs {
     int halfmove_clock;
     int castling;
     bool in_check;
+    int pst_mg;
+    int pst_eg;
+    unsigned int material_key;
+    uint_64 pawn_hash;
 } bitChessBoardHist;
 
 
@@ -192,7 +233,6 @@ static inline int pop_lsb(uint_64 *i)
 #endif
 #endif
 
-bool const_bitmask_init();
 
 struct bitChessBoard *new_bitboard();
 void debug_contents_of_bitboard_square(const struct bitChessBoard *pbb, int square);
@@ -203,8 +243,27 @@ void set_bitboard_startpos(struct bitChessBoard *pbb);
 bool load_bitboard_from_fen(struct bitChessBoard *pbb, const char *fen);
 char *convert_bitboard_to_fen(const struct bitChessBoard *pbb);
 uint_64 generate_bb_pinned_list(const struct bitChessBoard *pbb, int square, int color_of_blockers, int color_of_attackers);
+uint_64 get_bb_attacked_squares(const struct bitChessBoard *pbb, int color_attacking);
+// Squares attacked by the rooks and bishops (queens in both sets) given the occupancy.  get_bb_attacked_squares()
+// and the movegen use the AVX2 version when built with AVX2_ATTACKS, the magic one otherwise.
+uint_64 bb_slider_attacks_magic(uint_64 rooks, uint_64 bishops, uint_64 occupied);
+#ifdef __AVX2__
+uint_64 bb_slider_attacks_avx2(uint_64 rooks, uint_64 bishops, uint_64 occupied);
+#endif
+uint_64 get_bb_attackers_of_square(const struct bitChessBoard *pbb, int square, int color_attacking);
+#ifdef INCREMENTAL_ATTACKS
+void compute_bb_attacks(struct bitChessBoard *pbb);
+#endif
 
-void generate_bb_move_list(struct bitChessBoard *pbb, MoveList *ml);
+void bit_movelist_remove(struct bitMoveList *ml, int position);
+void print_bb_move_list(const struct bitChessBoard *pbb, const struct bitMoveList *ml);
+void generate_bb_move_list(struct bitChessBoard *pbb, struct bitMoveList *ml);
+void generate_bb_captures(struct bitChessBoard *pbb, struct bitMoveList *ml);
+void generate_bb_quiets(struct bitChessBoard *pbb, struct bitMoveList *ml);
+void generate_bb_quiet_checks(struct bitChessBoard *pbb, struct bitMoveList *ml);
+void generate_bb_evasions(struct bitChessBoard *pbb, struct bitMoveList *ml);
+Move expand_compact_move(const struct bitChessBoard *pbb, CompactMove cm);
+Move bb_validate_move(const struct bitChessBoard *pbb, Move m);
 void apply_bb_move(struct bitChessBoard *pbb, Move m);
 void store_bb_attrs(const struct bitChessBoard *pbb, struct bitChessBoardAttrs *pa);
 void undo_bb_move(struct bitChessBoard *pbb, Move m, const struct bitChessBoardAttrs *pa);
@@ -1,10 +1,26 @@
 /*
  * When I originally authored bitboard.h / bitboard.c I had arrays of unsigned longs that were computed.  However,
  * arrays of constant unsigned longs would perform faster.  So, the code that initialized the constants was moved here.
- * If you gcc this file, it will dump out test that you can then paste into bitboard.h to define the constants.
+ *
+ * The build runs this as the generate_tables target, and it writes every table the engine would otherwise build at
+ * startup as const data, so there is nothing left to initialize:
+ *     bitboard_tables.h   - the rank/file/edge masks, the move tables, squares between and lines through.  Included by
+ *                           bitboard.c only, so the compiler can fold the scalar masks.
+ *     generated_tables.c  - the slider attack tables for the configured SLIDER_BACKEND, the check tables and the
+ *                           bitboard Zobrist keys.
+ * It is built with TABLE_GENERATOR defined, which gives it magicmoves.c and check_tables.c with their run time
+ * initialization, and it copies out what they compute.
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "chess_constants.h"
+#include "magicmoves.h"
+#include "check_tables.h"
+#include "random.h"
+
 // Bitboard-based definition
 
 typedef unsigned long uint_64;
@@ -41,6 +57,8 @@ uint_64 B_FILE;
 uint_64 G_FILE;
 uint_64 RANK_2;
 uint_64 RANK_3;
+uint_64 RANK_4;
+uint_64 RANK_5;
 uint_64 RANK_6;
 uint_64 RANK_7;
 uint_64 NOT_B_FILE;
@@ -61,6 +79,7 @@ uint_64 WHITE_PAWN_ATTACKSTO[64];
 uint_64 BLACK_PAWN_ATTACKSTO[64];
 
 uint_64 SQUARES_BETWEEN[64][64];
+uint_64 LINES_THROUGH[64][64];
 
 void const_bitmask_init()
 {
@@ -106,6 +125,8 @@ void const_bitmask_init()
     for (i=A3; i<=H3; i++) {
         RANK_3 |= SQUARE_MASKS[i];
     }
+    RANK_4 = RANK_3 << 8;
+    RANK_5 = RANK_4 << 8;
     RANK_6 = 0;
     for (i=A6; i<=H6; i++) {
         RANK_6 |= SQUARE_MASKS[i];
@@ -318,12 +339,62 @@ void const_bitmask_init()
 
         }
     }
+
+    uint_64 ranks[8] = {RANK_1, RANK_2, RANK_3, RANK_4, RANK_5, RANK_6, RANK_7, RANK_8};
+    uint_64 files[8] = {A_FILE, B_FILE, C_FILE, D_FILE, E_FILE, F_FILE, G_FILE, H_FILE};
+    uint_64 cur_diagonal, cur_antidiagonal;
+
+    for (i=0; i<64; i++) {
+        cur_antidiagonal = 0;
+        cur_diagonal = 0;
+        //diagonals go NE-SW
+        cur_diagonal |= SQUARE_MASKS[i];
+        j = i;
+        while ((SQUARE_MASKS[j] & NOT_H_FILE) && (SQUARE_MASKS[j] & NOT_RANK_8)) {
+            j += 9;
+            cur_diagonal |= SQUARE_MASKS[j];
+        }
+        j = i;
+        while ((SQUARE_MASKS[j] & NOT_A_FILE) && (SQUARE_MASKS[j] & NOT_RANK_1)) {
+            j -= 9;
+            cur_diagonal |= SQUARE_MASKS[j];
+        }
+
+        cur_antidiagonal |= SQUARE_MASKS[i];
+        j = i;
+        while ((SQUARE_MASKS[j] & NOT_A_FILE) && (SQUARE_MASKS[j] & NOT_RANK_8)) {
+            j += 7;
+            cur_antidiagonal |= SQUARE_MASKS[j];
+        }
+        j = i;
+        while ((SQUARE_MASKS[j] & NOT_H_FILE) && (SQUARE_MASKS[j] & NOT_RANK_1)) {
+            j-=7;
+            cur_antidiagonal |= SQUARE_MASKS[j];
+        }
+
+        for (j=0; j<64; j++) {
+            LINES_THROUGH[i][j] = 0;
+            if (i != j) {
+                for (c=0; c < 8; c++) {
+                    if ((SQUARE_MASKS[i] & ranks[c]) && (SQUARE_MASKS[j] & ranks[c])) {
+                        LINES_THROUGH[i][j] = ranks[c];
+                    } else if ((SQUARE_MASKS[i] & files[c]) && (SQUARE_MASKS[j] & files[c])) {
+                        LINES_THROUGH[i][j] = files[c];
+                    } else if ((SQUARE_MASKS[i] & cur_diagonal) && (SQUARE_MASKS[j] & cur_diagonal)) {
+                        LINES_THROUGH[i][j] = cur_diagonal;
+                    } else if ((SQUARE_MASKS[i] & cur_antidiagonal) && (SQUARE_MASKS[j] & cur_antidiagonal)) {
+                        LINES_THROUGH[i][j] = cur_antidiagonal;
+                    }
+                }
+            }
+        }
+    }
 }
 
 void const_bitmask_verify() {
     int i, j;
 
-    uint_64 test, test2, test3;
+    uint_64 test;
 
     test = SQUARE_MASKS[A5] | SQUARE_MASKS[B5] | SQUARE_MASKS[C5] | SQUARE_MASKS[E5] | SQUARE_MASKS[F5] | SQUARE_MASKS[G5] | SQUARE_MASKS[H5];
     test |= (SQUARE_MASKS[D1] | SQUARE_MASKS[D2] | SQUARE_MASKS[D3] |SQUARE_MASKS[D4] | SQUARE_MASKS[D6] | SQUARE_MASKS[D7] |SQUARE_MASKS[D8]);
@@ -372,125 +443,342 @@ void const_bitmask_verify() {
 
 }
 
-void code_generator()
+
+
+static FILE *open_output(const char *dir, const char *name)
+{
+    char path[4096];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "// Generated at build time by generate_tables from bitboard_constant_generation.c, do not edit.\n\n");
+    return f;
+}
+
+static void write_scalar(FILE *f, const char *name, uint_64 value)
+{
+    fprintf(f, "const uint_64 %s = 0x%lxul;\n", name, value);
+}
+
+// the entries of an array initializer, four to a line.  U64 tables are passed in cast, both types are 64 bits here
+static void write_values(FILE *f, const uint_64 *values, int count, const char *indent)
 {
     int i;
 
-    printf ("const uint_64 A_FILE = 0x%lxul;\n", A_FILE);
-    printf ("const uint_64 B_FILE = 0x%lxul;\n", B_FILE);
-    printf ("const uint_64 C_FILE = 0x%lxul;\n", C_FILE);
-    printf ("const uint_64 D_FILE = 0x%lxul;\n", D_FILE);
-    printf ("const uint_64 E_FILE = 0x%lxul;\n", E_FILE);
-    printf ("const uint_64 F_FILE = 0x%lxul;\n", F_FILE);
-
-    printf ("const uint_64 G_FILE = 0x%lxul;\n", G_FILE);
-    printf ("const uint_64 H_FILE = 0x%lxul;\n", H_FILE);
-    printf ("const uint_64 RANK_1 = 0x%lxul;\n", RANK_1);
-    printf ("const uint_64 RANK_2 = 0x%lxul;\n", RANK_2);
-    printf ("const uint_64 RANK_3 = 0x%lxul;\n", RANK_3);
-    printf ("const uint_64 RANK_6 = 0x%lxul;\n", RANK_6);
-    printf ("const uint_64 RANK_7 = 0x%lxul;\n", RANK_7);
-    printf ("const uint_64 RANK_8 = 0x%lxul;\n", RANK_8);
-    printf ("const uint_64 NOT_A_FILE = 0x%lxul;\n", NOT_A_FILE);
-    printf ("const uint_64 NOT_B_FILE = 0x%lxul;\n", NOT_B_FILE);
-    printf ("const uint_64 NOT_G_FILE = 0x%lxul;\n", NOT_G_FILE);
-    printf ("const uint_64 NOT_H_FILE = 0x%lxul;\n", NOT_H_FILE);
-    printf ("const uint_64 NOT_RANK_1 = 0x%lxul;\n", NOT_RANK_1);
-    printf ("const uint_64 NOT_RANK_2 = 0x%lxul;\n", NOT_RANK_2);
-    printf ("const uint_64 NOT_RANK_7 = 0x%lxul;\n", NOT_RANK_7);
-    printf ("const uint_64 NOT_RANK_8 = 0x%lxul;\n", NOT_RANK_8);
-    printf ("const uint_64 ON_AN_EDGE = 0x%lxul;\n", ON_AN_EDGE);
-    printf ("const uint_64 NOT_ANY_EDGE = 0x%lxul;\n", NOT_ANY_EDGE);
-
-    printf ("\n\n");
-
-    printf("const uint_64 SQUARE_MASKS[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
-        }
-        printf("0x%lxull, ", SQUARE_MASKS[i]);
+    for (i = 0; i < count; i++) {
+        fprintf(f, "%s0x%lxul,%s", (i % 4 == 0) ? indent : " ", values[i], (i % 4 == 3 || i == count - 1) ? "\n" : "");
     }
-    printf ("0x%lxull\n};\n", SQUARE_MASKS[63]);
+}
 
+static void write_array(FILE *f, const char *decl, const uint_64 *values, int count)
+{
+    fprintf(f, "%s = {\n", decl);
+    write_values(f, values, count, "        ");
+    fprintf(f, "};\n\n");
+}
 
-    printf ("\n\n");
+static void write_array_64x64(FILE *f, const char *decl, uint_64 values[64][64])
+{
+    int i;
 
-    printf("const uint_64 NOT_MASKS[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
-        }
-        printf("0x%lxull, ", NOT_MASKS[i]);
+    fprintf(f, "%s = {\n", decl);
+    for (i = 0; i < 64; i++) {
+        fprintf(f, "    {\n");
+        write_values(f, values[i], 64, "        ");
+        fprintf(f, "    },\n");
     }
-    printf ("0x%lxull\n};\n", NOT_MASKS[63]);
+    fprintf(f, "};\n\n");
+}
 
-    printf ("\n\n");
+void write_bitboard_tables(const char *dir)
+{
+    FILE *f = open_output(dir, "bitboard_tables.h");
+
+    fprintf(f, "#pragma once\n\n");
+    fprintf(f, "// Masks to find the edges of the board, or squares not on a given edge.\n");
+    write_scalar(f, "A_FILE", A_FILE);
+    write_scalar(f, "B_FILE", B_FILE);
+    write_scalar(f, "C_FILE", C_FILE);
+    write_scalar(f, "D_FILE", D_FILE);
+    write_scalar(f, "E_FILE", E_FILE);
+    write_scalar(f, "F_FILE", F_FILE);
+    write_scalar(f, "G_FILE", G_FILE);
+    write_scalar(f, "H_FILE", H_FILE);
+    write_scalar(f, "RANK_1", RANK_1);
+    write_scalar(f, "RANK_2", RANK_2);
+    write_scalar(f, "RANK_3", RANK_3);
+    write_scalar(f, "RANK_4", RANK_4);
+    write_scalar(f, "RANK_5", RANK_5);
+    write_scalar(f, "RANK_6", RANK_6);
+    write_scalar(f, "RANK_7", RANK_7);
+    write_scalar(f, "RANK_8", RANK_8);
+    write_scalar(f, "NOT_A_FILE", NOT_A_FILE);
+    write_scalar(f, "NOT_B_FILE", NOT_B_FILE);
+    write_scalar(f, "NOT_G_FILE", NOT_G_FILE);
+    write_scalar(f, "NOT_H_FILE", NOT_H_FILE);
+    write_scalar(f, "NOT_RANK_1", NOT_RANK_1);
+    write_scalar(f, "NOT_RANK_2", NOT_RANK_2);
+    write_scalar(f, "NOT_RANK_7", NOT_RANK_7);
+    write_scalar(f, "NOT_RANK_8", NOT_RANK_8);
+    write_scalar(f, "ON_AN_EDGE", ON_AN_EDGE);
+    write_scalar(f, "NOT_ANY_EDGE", NOT_ANY_EDGE);
+    fprintf(f, "\n");
+
+    write_array(f, "const uint_64 SQUARE_MASKS[64]", SQUARE_MASKS, 64);
+    write_array(f, "const uint_64 NOT_MASKS[64]", NOT_MASKS, 64);
+
+    fprintf(f, "// Masks for use in move generation\n");
+    write_array(f, "const uint_64 KNIGHT_MOVES[64]", KNIGHT_MOVES, 64);
+    write_array(f, "const uint_64 KING_MOVES[64]", KING_MOVES, 64);
+    write_array(f, "const uint_64 SLIDER_MOVES[64]", SLIDER_MOVES, 64);
+    write_array(f, "const uint_64 DIAGONAL_MOVES[64]", DIAGONAL_MOVES, 64);
+    fprintf(f, "// the squares that pawns of the color are on if they attack this square\n");
+    write_array(f, "const uint_64 WHITE_PAWN_ATTACKSTO[64]", WHITE_PAWN_ATTACKSTO, 64);
+    write_array(f, "const uint_64 BLACK_PAWN_ATTACKSTO[64]", BLACK_PAWN_ATTACKSTO, 64);
+
+    fprintf(f, "// Given a From and a To location, identify all the squares between them, if the squares share a rank, file, "
+               "diagonal, or anti-diagonal\n");
+    write_array_64x64(f, "static const uint_64 SQUARES_BETWEEN[64][64]", SQUARES_BETWEEN);
+    fprintf(f, "// Given a From and To location, draw a line from edge to edge through those two squares, if the squares share "
+               "rank, file, diag, or anti-diag\n");
+    write_array_64x64(f, "static const uint_64 LINES_THROUGH[64][64]", LINES_THROUGH);
+
+    fclose(f);
+}
 
-    printf("const uint_64 KNIGHT_MOVES[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
-        }
-        printf("0x%lxull, ", KNIGHT_MOVES[i]);
+
+// The slider attack tables for the backend this tree is configured with, see slider_attacks.h.
+
+#if defined(SLIDER_MIN_MAGIC) || defined(SLIDER_FANCY_MAGIC)
+
+extern U64 magicmovesbdb[5248];
+extern U64 magicmovesrdb[102400];
+extern const U64* magicmoves_b_indices[64];
+extern const U64* magicmoves_r_indices[64];
+
+static void write_indices(FILE *f, const char *decl, const char *table, const U64 *base, const U64 **indices)
+{
+    int sq;
+
+    fprintf(f, "%s = {\n", decl);
+    for (sq = 0; sq < 64; sq++) {
+        fprintf(f, "%s%s+%ld,%s", (sq % 4 == 0) ? "    " : " ", table, (long) (indices[sq] - base), (sq % 4 == 3) ? "\n" : "");
     }
-    printf ("0x%lxull\n};\n", KNIGHT_MOVES[63]);
+    fprintf(f, "};\n\n");
+}
 
-    printf ("\n\n");
+#endif
 
-    printf("const uint_64 KING_MOVES[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
-        }
-        printf("0x%lxull, ", KING_MOVES[i]);
+#ifdef SLIDER_FANCY_MAGIC
+
+static void write_slider_squares(FILE *f, const char *name, const char *table, const U64 *masks, const U64 *magics,
+                                 const U64 *base, const U64 **indices, const unsigned int *shifts)
+{
+    int sq;
+
+    fprintf(f, "const sliderSquare %s[64] __attribute__((aligned(64))) = {\n", name);
+    for (sq = 0; sq < 64; sq++) {
+        fprintf(f, "    {0x%llxull, 0x%llxull, %s+%ld, %u},\n", masks[sq], magics[sq], table, (long) (indices[sq] - base), shifts[sq]);
     }
-    printf ("0x%lxull\n};\n", KING_MOVES[63]);
+    fprintf(f, "};\n\n");
+}
 
-    printf ("\n\n");
+#endif
 
-    printf("const uint_64 SLIDER_MOVES[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
-        }
-        printf("0x%lxull, ", SLIDER_MOVES[i]);
+#ifdef SLIDER_PEXT
+
+#define SLIDER_ROOK_ENTRIES 102400
+#define SLIDER_BISHOP_ENTRIES 5248
+
+U64 initmagicmoves_Rmoves(const int square, const U64 occ);
+U64 initmagicmoves_Bmoves(const int square, const U64 occ);
+
+static U64 pext_rook_table[SLIDER_ROOK_ENTRIES];
+static U64 pext_bishop_table[SLIDER_BISHOP_ENTRIES];
+static long pext_rook_offsets[64];
+static long pext_bishop_offsets[64];
+
+// Lays the squares out one after the other, 2^(bits in the mask) entries each.  The carry-rippler walks the subsets
+// of the mask in increasing order, which is the order pext numbers them, so no pext is needed here.
+static void fill_pext_table(const U64 *masks, U64 *table, long *offsets, int table_size, U64 (*attacks)(const int, const U64))
+{
+    long next = 0;
+    U64 subset;
+    int sq;
+
+    for (sq = 0; sq < 64; sq++) {
+        offsets[sq] = next;
+        subset = 0;
+        do {
+            table[next++] = attacks(sq, subset);
+            subset = (subset - masks[sq]) & masks[sq];
+        } while (subset);
+    }
+    if (next != table_size) {
+        fprintf(stderr, "pext table has %ld entries, expected %d\n", next, table_size);
+        exit(1);
     }
-    printf ("0x%lxull\n};\n", SLIDER_MOVES[63]);
+}
+
+static void write_pext_squares(FILE *f, const char *name, const char *table, const U64 *masks, const long *offsets)
+{
+    int sq;
 
-    printf ("\n\n");
+    fprintf(f, "const sliderSquare %s[64] __attribute__((aligned(64))) = {\n", name);
+    for (sq = 0; sq < 64; sq++) {
+        fprintf(f, "    {0x%llxull, 0, %s+%ld, 0},\n", masks[sq], table, offsets[sq]);
+    }
+    fprintf(f, "};\n\n");
+}
 
-    printf("const uint_64 DIAGONAL_MOVES[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
+#endif
+
+static void write_slider_tables(FILE *f)
+{
+#if defined(SLIDER_MIN_MAGIC)
+    initmagicmoves();
+    write_array(f, "static const U64 magicmovesbdb[5248]", (const uint_64 *) magicmovesbdb, 5248);
+    write_array(f, "static const U64 magicmovesrdb[102400]", (const uint_64 *) magicmovesrdb, 102400);
+    write_indices(f, "const U64* magicmoves_b_indices[64]", "magicmovesbdb", magicmovesbdb, magicmoves_b_indices);
+    write_indices(f, "const U64* magicmoves_r_indices[64]", "magicmovesrdb", magicmovesrdb, magicmoves_r_indices);
+#elif defined(SLIDER_PLAIN_MAGIC)
+    int sq;
+
+    initmagicmoves();
+    fprintf(f, "const U64 magicmovesbdb[64][1<<9] = {\n");
+    for (sq = 0; sq < 64; sq++) {
+        fprintf(f, "    {\n");
+        write_values(f, (const uint_64 *) magicmovesbdb[sq], 1 << 9, "        ");
+        fprintf(f, "    },\n");
+    }
+    fprintf(f, "};\n\n");
+    fprintf(f, "const U64 magicmovesrdb[64][1<<12] = {\n");
+    for (sq = 0; sq < 64; sq++) {
+        fprintf(f, "    {\n");
+        write_values(f, (const uint_64 *) magicmovesrdb[sq], 1 << 12, "        ");
+        fprintf(f, "    },\n");
+    }
+    fprintf(f, "};\n\n");
+#elif defined(SLIDER_FANCY_MAGIC)
+    // the attack sets are magicmoves' minimized tables, only the per-square lookup data is gathered into one place
+    initmagicmoves();
+    write_array(f, "static const U64 slider_bishop_table[SLIDER_BISHOP_ENTRIES]", (const uint_64 *) magicmovesbdb, 5248);
+    write_array(f, "static const U64 slider_rook_table[SLIDER_ROOK_ENTRIES]", (const uint_64 *) magicmovesrdb, 102400);
+    write_slider_squares(f, "slider_rook", "slider_rook_table", magicmoves_r_mask, magicmoves_r_magics, magicmovesrdb,
+                         magicmoves_r_indices, magicmoves_r_shift);
+    write_slider_squares(f, "slider_bishop", "slider_bishop_table", magicmoves_b_mask, magicmoves_b_magics, magicmovesbdb,
+                         magicmoves_b_indices, magicmoves_b_shift);
+#else // SLIDER_PEXT
+    fill_pext_table(magicmoves_r_mask, pext_rook_table, pext_rook_offsets, SLIDER_ROOK_ENTRIES, initmagicmoves_Rmoves);
+    fill_pext_table(magicmoves_b_mask, pext_bishop_table, pext_bishop_offsets, SLIDER_BISHOP_ENTRIES, initmagicmoves_Bmoves);
+    write_array(f, "static const U64 slider_rook_table[SLIDER_ROOK_ENTRIES]", (const uint_64 *) pext_rook_table, SLIDER_ROOK_ENTRIES);
+    write_array(f, "static const U64 slider_bishop_table[SLIDER_BISHOP_ENTRIES]", (const uint_64 *) pext_bishop_table, SLIDER_BISHOP_ENTRIES);
+    write_pext_squares(f, "slider_rook", "slider_rook_table", magicmoves_r_mask, pext_rook_offsets);
+    write_pext_squares(f, "slider_bishop", "slider_bishop_table", magicmoves_b_mask, pext_bishop_offsets);
+#endif
+}
+
+// only the rows with a check in them are written out, the rest are left to the zero fill
+static void write_check_table(FILE *f, const char *name, unsigned char table[120][36][3])
+{
+    int i, j;
+    bool used;
+
+    fprintf(f, "const unsigned char %s[120][36][3] = {\n", name);
+    for (i = 0; i < 120; i++) {
+        used = false;
+        for (j = 0; j < 36; j++) {
+            used |= (table[i][j][0] || table[i][j][1] || table[i][j][2]);
+        }
+        if (!used) {
+            continue;
         }
-        printf("0x%lxull, ", DIAGONAL_MOVES[i]);
+        fprintf(f, "    [%d] = {\n", i);
+        for (j = 0; j < 36; j++) {
+            fprintf(f, "%s{%d, %d, %d},%s", (j % 6 == 0) ? "        " : " ", table[i][j][0], table[i][j][1], table[i][j][2],
+                    (j % 6 == 5) ? "\n" : "");
+        }
+        fprintf(f, "    },\n");
     }
-    printf ("0x%lxull\n};\n", DIAGONAL_MOVES[63]);
+    fprintf(f, "};\n\n");
+}
 
-    printf("const uint_64 WHITE_PAWN_ATTACKSTO[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
+// The same keys, drawn from Random64 in the same order, that TT_init_bitboard() used to fill in at startup
+static void write_zobrist_keys(FILE *f)
+{
+    static const char *piece_names[15] = {NULL, "WP", "WN", "WB", "WR", "WQ", "WK", NULL,
+                                          NULL, "BP", "BN", "BB", "BR", "BQ", "BK"};
+    static const uc pieces[12] = {WP, WN, WB, WR, WQ, WK, BP, BN, BB, BR, BQ, BK};
+    uint_64 piece_hash[15][64] = {{0}};
+    uint_64 enpassanttarget[64] = {0};
+    uint_64 castling[16];
+    int rnd = 0;
+    int i, p;
+
+    for (i = 0; i < 64; i++) {
+        for (p = 0; p < 12; p++) {
+            piece_hash[pieces[p]][i] = Random64[rnd++];
+        }
+        if ((i >= 16 && i <= 23) || (i >= 40 && i <= 47)) {
+            enpassanttarget[i] = Random64[rnd++];
         }
-        printf("0x%lxull, ", WHITE_PAWN_ATTACKSTO[i]);
     }
-    printf ("0x%lxull\n};\n", WHITE_PAWN_ATTACKSTO[63]);
+    for (i = 0; i < 16; i++) {
+        castling[i] = Random64[rnd++];
+    }
 
-    printf("const uint_64 BLACK_PAWN_ATTACKSTO[64] = {");
-    for (i=0; i< 63; i++) {
-        if (i%4 == 0) {
-            printf ("\n");
+    fprintf(f, "const uint_64 bb_piece_hash[15][64] = {\n");
+    for (p = 0; p < 15; p++) {
+        if (piece_names[p]) {
+            fprintf(f, "    [%s] = {\n", piece_names[p]);
+            write_values(f, piece_hash[p], 64, "        ");
+            fprintf(f, "    },\n");
         }
-        printf("0x%lxull, ", BLACK_PAWN_ATTACKSTO[i]);
     }
-    printf ("0x%lxull\n};\n", BLACK_PAWN_ATTACKSTO[63]);
+    fprintf(f, "};\n\n");
+    write_array(f, "const uint_64 bb_hash_enpassanttarget[64]", enpassanttarget, 64);
+    write_array(f, "const uint_64 bb_hash_castling[16]", castling, 16);
+    write_scalar(f, "bb_hash_whitetomove", Random64[rnd++]);
+}
+
+void write_generated_tables(const char *dir)
+{
+    FILE *f = open_output(dir, "generated_tables.c");
+
+    fprintf(f, "#include \"slider_attacks.h\"\n");
+    fprintf(f, "#include \"check_tables.h\"\n");
+    fprintf(f, "#include \"hash.h\"\n\n");
+
+    write_slider_tables(f);
+
+    init_check_tables();
+    write_check_table(f, "WHITE_CHECK_TABLE", WHITE_CHECK_TABLE);
+    write_check_table(f, "BLACK_CHECK_TABLE", BLACK_CHECK_TABLE);
+
+    write_zobrist_keys(f);
+
+    fclose(f);
 }
 
-void main(void)
+int main(int argc, char **argv)
 {
+    if (argc == 2 && strcmp(argv[1], "--verify") == 0) {
+        const_bitmask_init();
+        const_bitmask_verify();
+        return 0;
+    }
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s output_directory\n       %s --verify\n", argv[0], argv[0]);
+        return 1;
+    }
+
     const_bitmask_init();
-    code_generator();
-    //const_bitmask_verify();
-}
\ No newline at end of file
+    write_bitboard_tables(argv[1]);
+    write_generated_tables(argv[1]);
+    return 0;
+}
@@ -1,7 +1,13 @@
 #pragma once
 
 
+// init_check_tables() only runs in the table generator, the engine links the tables in as const data
+#ifdef TABLE_GENERATOR
 extern unsigned char WHITE_CHECK_TABLE[120][36][3];
 extern unsigned char BLACK_CHECK_TABLE[120][36][3];
 
-void init_check_tables();
\ No newline at end of file
+void init_check_tables();
+#else
+extern const unsigned char WHITE_CHECK_TABLE[120][36][3];
+extern const unsigned char BLACK_CHECK_TABLE[120][36][3];
+#endif
\ No newline at end of file
@@ -2,20 +2,981 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <assert.h>
+#include <pthread.h>
 
 #include "hash.h"
 #include "chess_constants.h"
 #include "chessmove.h"
 #include "chessboard.h"
 #include "check_tables.h"
+#include "generate_moves.h"
+#include "bitboard.h"
+#include "search.h"
 #include "chess.h"
 
 
-int main()
+// Everything below the input lock is shared between the input thread and the main thread.
+static pthread_mutex_t INPUT_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t INPUT_READY = PTHREAD_COND_INITIALIZER;    // a line was queued, or stop / ponderhit arrived
+static pthread_cond_t INPUT_SPACE = PTHREAD_COND_INITIALIZER;    // the main thread took a line off a full queue
+static struct inputLine INPUT_QUEUE[INPUT_QUEUE_SIZE];
+static int INPUT_HEAD = 0;
+static int INPUT_COUNT = 0;
+static volatile int PROTOCOL = PROTOCOL_CONSOLE;
+static bool SEARCHING = false;
+static int PENDING_GO = 0;              // UCI go commands queued but not yet started
+static bool DISCARD_MOVE = false;       // xboard: the search was interrupted by new, force, undo... - don't play its move
+static unsigned long LAST_STOP_SEQ = 0;
+static unsigned long LAST_PONDERHIT_SEQ = 0;
+
+// stdout and the debug log are written from both threads
+static pthread_mutex_t OUTPUT_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static FILE *DEBUG_FILE = NULL;
+
+// main thread only
+static bool POST = false;
+static int THREADS = 1;
+static unsigned long LAST_SEQ = 0;
+static struct gameState GAME;
+static uint_64 GAME_HISTORY[MAX_GAME_HISTORY];
+
+static const char PIECE_CHARS[] = ".PNBRQK..pnbrqk.";
+
+
+static void send_line(const char *fmt, ...)
+{
+    va_list args;
+
+    pthread_mutex_lock(&OUTPUT_LOCK);
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    printf("\n");
+    fflush(stdout);
+    if (DEBUG_FILE) {
+        fprintf(DEBUG_FILE, "> ");
+        va_start(args, fmt);
+        vfprintf(DEBUG_FILE, fmt, args);
+        va_end(args);
+        fprintf(DEBUG_FILE, "\n");
+        fflush(DEBUG_FILE);
+    }
+    pthread_mutex_unlock(&OUTPUT_LOCK);
+}
+
+static void log_input(const char *line)
+{
+    pthread_mutex_lock(&OUTPUT_LOCK);
+    if (DEBUG_FILE) {
+        fprintf(DEBUG_FILE, "< %s\n", line);
+        fflush(DEBUG_FILE);
+    }
+    pthread_mutex_unlock(&OUTPUT_LOCK);
+}
+
+static void set_debug(bool on)
+{
+    pthread_mutex_lock(&OUTPUT_LOCK);
+    if (on && !DEBUG_FILE) {
+        DEBUG_FILE = fopen("chessdebug.txt", "w");
+    } else if (!on && DEBUG_FILE) {
+        fclose(DEBUG_FILE);
+        DEBUG_FILE = NULL;
+    }
+    pthread_mutex_unlock(&OUTPUT_LOCK);
+}
+
+static bool command_is(const char *line, const char *cmd)
+{
+    size_t len = strlen(cmd);
+
+    return strncmp(line, cmd, len) == 0 && (line[len] == '\0' || isspace((unsigned char) line[len]));
+}
+
+
+/* The input thread */
+
+// xboard has no stop command: these make the engine abandon its search, and the move it would have played.
+static bool is_xboard_interrupt(const char *line)
+{
+    return command_is(line, "new") || command_is(line, "force") || command_is(line, "setboard") || command_is(line, "undo") ||
+           command_is(line, "remove") || command_is(line, "result") || command_is(line, "edit");
+}
+
+static void enqueue_locked(const char *line, unsigned long seq)
+{
+    int tail;
+
+    while (INPUT_COUNT == INPUT_QUEUE_SIZE) {
+        pthread_cond_wait(&INPUT_SPACE, &INPUT_LOCK);
+    }
+    tail = (INPUT_HEAD + INPUT_COUNT) % INPUT_QUEUE_SIZE;
+    INPUT_QUEUE[tail].text = strdup(line);
+    assert(INPUT_QUEUE[tail].text);  // TODO: Real error handling
+    INPUT_QUEUE[tail].seq = seq;
+    INPUT_COUNT++;
+    pthread_cond_broadcast(&INPUT_READY);
+}
+
+// Commands that must take effect while the main thread is searching are acted on here; everything else is queued.
+// Returns false once there is nothing more to read.
+static bool handle_input(const char *line, unsigned long seq)
+{
+    bool more = true;
+    bool answer_ready = false;
+
+    pthread_mutex_lock(&INPUT_LOCK);
+    if (command_is(line, "uci")) {
+        PROTOCOL = PROTOCOL_UCI;
+    } else if (command_is(line, "xboard")) {
+        PROTOCOL = PROTOCOL_XBOARD;
+    }
+
+    if (command_is(line, "stop") || command_is(line, "?")) {
+        LAST_STOP_SEQ = seq;
+        if (SEARCHING) {
+            SEARCH_STOP_REQUESTED = true;
+        }
+        pthread_cond_broadcast(&INPUT_READY);
+    } else if (command_is(line, "ponderhit")) {
+        LAST_PONDERHIT_SEQ = seq;
+        if (SEARCHING) {
+            SEARCH_PONDERING = false;
+        }
+        pthread_cond_broadcast(&INPUT_READY);
+    } else if (command_is(line, "isready") && (SEARCHING || PENDING_GO)) {
+        answer_ready = true;
+    } else {
+        if (command_is(line, "quit")) {
+            LAST_STOP_SEQ = seq;
+            SEARCH_STOP_REQUESTED = true;
+            DISCARD_MOVE = true;
+            more = false;
+        } else if (PROTOCOL != PROTOCOL_UCI && SEARCHING && is_xboard_interrupt(line)) {
+            LAST_STOP_SEQ = seq;
+            SEARCH_STOP_REQUESTED = true;
+            DISCARD_MOVE = true;
+        } else if (PROTOCOL == PROTOCOL_UCI && command_is(line, "go")) {
+            PENDING_GO++;
+        }
+        enqueue_locked(line, seq);
+    }
+    pthread_mutex_unlock(&INPUT_LOCK);
+
+    if (answer_ready) {
+        send_line("readyok");
+    }
+    return more;
+}
+
+static void *input_thread(void *arg)
+{
+    char buf[INPUT_LINE_MAX];
+    char *line;
+    size_t len;
+    unsigned long seq = 0;
+    bool more = true;
+
+    (void) arg;
+    while (more) {
+        if (!fgets(buf, sizeof(buf), stdin)) {
+            strcpy(buf, "quit");
+        }
+        len = strlen(buf);
+        while (len > 0 && isspace((unsigned char) buf[len - 1])) {
+            buf[--len] = '\0';
+        }
+        line = buf;
+        while (isspace((unsigned char) *line)) {
+            line++;
+        }
+        if (*line == '\0') {
+            continue;
+        }
+        log_input(line);
+        more = handle_input(line, ++seq);
+    }
+    return NULL;
+}
+
+
+/* The game */
+
+static void new_game(struct gameState *gs, const struct bitChessBoard *start)
+{
+    gs->boards[0] = *start;
+    gs->plies = 0;
+    gs->game_over = false;
+}
+
+static void play_move(struct gameState *gs, Move m)
+{
+    // the oldest position can go, it is far beyond the 75 move rule
+    if (gs->plies == MAX_GAME_HISTORY) {
+        memmove(&gs->boards[0], &gs->boards[1], MAX_GAME_HISTORY * sizeof(struct bitChessBoard));
+        memmove(&gs->moves[0], &gs->moves[1], (MAX_GAME_HISTORY - 1) * sizeof(Move));
+        gs->plies--;
+    }
+    gs->boards[gs->plies + 1] = gs->boards[gs->plies];
+    apply_bb_move(&gs->boards[gs->plies + 1], m);
+    gs->moves[gs->plies] = m;
+    gs->plies++;
+}
+
+static bool take_back(struct gameState *gs, int plies)
+{
+    if (gs->plies < plies) {
+        return false;
+    }
+    gs->plies -= plies;
+    gs->game_over = false;
+    return true;
+}
+
+// Matches s against the legal moves in the current position.  Returns NULL_MOVE if it is not one of them.
+static Move find_legal_move(struct gameState *gs, const char *s)
+{
+    struct bitMoveList ml;
+    char buf[6];
+    Move m;
+    int i;
+
+    generate_bb_move_list(&gs->boards[gs->plies], &ml);
+    for (i = 0; i < ml.size; i++) {
+        m = expand_compact_move(&gs->boards[gs->plies], ml.moves[i]);
+        bb_move_to_uci(m, buf);
+        if (strcasecmp(buf, s) == 0) {
+            return m;
+        }
+    }
+    return NULL_MOVE;
+}
+
+static void square_name(int sq, char *s)
+{
+    s[0] = (char)('a' + sq % 8);
+    s[1] = (char)('1' + sq / 8);
+    s[2] = '\0';
+}
+
+static void print_bb_board(const struct bitChessBoard *pbb)
+{
+    char row[32];
+    int rank, file;
+
+    for (rank = 7; rank >= 0; rank--) {
+        sprintf(row, "%d ", rank + 1);
+        for (file = 0; file < 8; file++) {
+            row[2 + file * 2] = ' ';
+            row[3 + file * 2] = PIECE_CHARS[BB_PIECE_ON(pbb, rank * 8 + file) & 15];
+        }
+        row[18] = '\0';
+        send_line("%s", row);
+    }
+    send_line("   a b c d e f g h");
+    send_line("%s to move", pbb->side_to_move == WHITE ? "White" : "Black");
+}
+
+static void print_piece_positions(const struct bitChessBoard *pbb)
+{
+    static const int pieces[12] = {WP, WN, WB, WR, WQ, WK, BP, BN, BB, BR, BQ, BK};
+    char line[256], sq[3];
+    uint_64 squares;
+    int i;
+
+    for (i = 0; i < 12; i++) {
+        sprintf(line, "%c:", PIECE_CHARS[pieces[i]]);
+        squares = pbb->piece_boards[pieces[i]];
+        if (!squares) {
+            strcat(line, " [None]");
+        }
+        while (squares) {
+            square_name(pop_lsb(&squares), sq);
+            strcat(line, " ");
+            strcat(line, sq);
+        }
+        send_line("%s", line);
+    }
+}
+
+static void print_history(const struct gameState *gs)
+{
+    char line[MAX_GAME_HISTORY * 6 + 1];
+    char buf[6];
+    int i;
+
+    line[0] = '\0';
+    for (i = 0; i < gs->plies; i++) {
+        bb_move_to_uci(gs->moves[i], buf);
+        if (i) {
+            strcat(line, " ");
+        }
+        strcat(line, buf);
+    }
+    send_line("%s", line);
+}
+
+static void print_supported_commands()
+{
+    send_line("Sample move syntax:");
+    send_line("     e2e4  - regular move");
+    send_line("     a7a8q - promotion");
+    send_line("     e1g1  - castle");
+    send_line("");
+    send_line("Other commands:");
+    send_line("");
+    send_line("     both          - computer plays both sides - type ? to make it move now, force to stop");
+    send_line("     cores N       - search with N threads");
+    send_line("     debug         - toggle the chessdebug.txt log file");
+    send_line("     draw          - request draw due to 50 move rule");
+    send_line("     fen           - print the FEN of the current position");
+    send_line("     force         - human plays both white and black");
+    send_line("     go            - computer takes over for color currently on move");
+    send_line("     help          - this list");
+    send_line("     history       - print the game's move history");
+    send_line("     level MPS BASE INC - MPS moves in BASE minutes, plus INC seconds per move");
+    send_line("     new           - begin new game, computer black");
+    send_line("     nopost        - disable POST");
+    send_line("     ping TEXT     - reply with 'pong TEXT'");
+    send_line("     post          - see details on Bejola's thinking");
+    send_line("                   - format: PLY SCORE TIME NODES MOVE_TREE");
+    send_line("                   - where TIME is in centiseconds, and NODES is nodes searched. SCORE is for the side to move");
+    send_line("     print         - print the board to the terminal");
+    send_line("     printpos      - print a list of pieces and their current positions");
+    send_line("     quit          - exit game");
+    send_line("     remove        - go back a full move");
+    send_line("     resign        - resign your position");
+    send_line("     sd DEPTH      - set search depth to DEPTH plies.  Default is %d when there is no clock.", XBOARD_DEFAULT_DEPTH);
+    send_line("     setboard FEN  - set current position to the FEN that is specified");
+    send_line("     st TIME       - search TIME seconds per move");
+    send_line("     undo          - go back a half move (better: use 'remove' instead)");
+    send_line("     uci           - use the UCI protocol");
+    send_line("     xboard        - use xboard (GNU Chess) protocol");
+}
+
+// For xboard and the console, which expect the engine to adjudicate.  Returns true if the game is over.
+static bool test_for_end(struct gameState *gs)
+{
+    struct bitChessBoard *pbb = &gs->boards[gs->plies];
+    struct bitMoveList ml;
+    int i, repeats = 0;
+
+    generate_bb_move_list(pbb, &ml);
+    if (ml.size == 0) {
+        if (!pbb->in_check) {
+            send_line("1/2-1/2 {Stalemate}");
+        } else if (pbb->side_to_move == WHITE) {
+            send_line("0-1 {Black mates}");
+        } else {
+            send_line("1-0 {White mates}");
+        }
+        return true;
+    }
+    if (__builtin_popcountl(pbb->piece_boards[WHITE] | pbb->piece_boards[BLACK]) == 2) {
+        send_line("1/2-1/2 {Stalemate - insufficient material}");
+        return true;
+    }
+    if (pbb->halfmove_clock >= 150) {
+        send_line("1/2-1/2 {75 move rule}");
+        return true;
+    }
+    for (i = gs->plies - 2; i >= 0 && i >= gs->plies - pbb->halfmove_clock; i -= 2) {
+        if (gs->boards[i].hash == pbb->hash) {
+            repeats++;
+        }
+    }
+    if (repeats >= 2) {
+        send_line("1/2-1/2 {Draw by repetition}");
+        return true;
+    }
+    return false;
+}
+
+
+/* Searching */
+
+// Mate scores carry the depth remaining when the mate was found, see search.h.  Returns the moves until mate,
+// negative if the side to move is the one getting mated.
+static int mate_in_moves(const struct searchResult *sr)
+{
+    int plies = sr->depth - (abs(sr->score) - MATE_SCORE);
+
+    if (plies < 1) {
+        plies = 1;
+    }
+    return sr->score > 0 ? (plies + 1) / 2 : -(plies / 2);
+}
+
+static void append_pv(char *s, const struct searchResult *sr)
+{
+    char buf[6];
+    int i;
+
+    for (i = 0; i < sr->pv_length; i++) {
+        bb_move_to_uci(sr->pv[i], buf);
+        strcat(s, " ");
+        strcat(s, buf);
+    }
+}
+
+static void report_thinking(const struct searchResult *sr)
+{
+    char line[MAX_SEARCH_PLY * 6 + 256];
+    int score, mate;
+    uint_64 nps = (sr->nodes * 1000) / (sr->elapsed_ms > 0 ? (uint_64) sr->elapsed_ms : 1);
+
+    if (PROTOCOL == PROTOCOL_UCI) {
+        if (abs(sr->score) >= MATE_SCORE) {
+            sprintf(line, "info depth %d score mate %d nodes %lu nps %lu time %ld pv", sr->depth, mate_in_moves(sr), sr->nodes, nps, sr->elapsed_ms);
+        } else {
+            sprintf(line, "info depth %d score cp %d nodes %lu nps %lu time %ld pv", sr->depth, sr->score, sr->nodes, nps, sr->elapsed_ms);
+        }
+    } else if (POST) {
+        score = sr->score;
+        if (abs(score) >= MATE_SCORE) {
+            // xboard shows 100000 + N as mate in N
+            mate = mate_in_moves(sr);
+            score = mate > 0 ? 100000 + mate : -100000 + mate;
+        }
+        sprintf(line, "%d %d %ld %lu", sr->depth, score, sr->elapsed_ms / 10, sr->nodes);
+    } else {
+        return;
+    }
+    append_pv(line, sr);
+    send_line("%s", line);
+}
+
+// Called with the input lock held, so no stop or ponderhit can slip in between deciding and setting the flags.
+static void begin_search_locked(unsigned long seq, bool ponder)
+{
+    SEARCHING = true;
+    DISCARD_MOVE = false;
+    SEARCH_STOP_REQUESTED = LAST_STOP_SEQ > seq;
+    SEARCH_PONDERING = ponder && LAST_PONDERHIT_SEQ <= seq;
+}
+
+// UCI forbids sending bestmove during go infinite or go ponder until the GUI says stop or ponderhit, even if the
+// search has finished.  Returns true if the move should be thrown away.
+static bool end_search(bool infinite)
+{
+    bool discard;
+
+    pthread_mutex_lock(&INPUT_LOCK);
+    while (!SEARCH_STOP_REQUESTED && (infinite || SEARCH_PONDERING)) {
+        pthread_cond_wait(&INPUT_READY, &INPUT_LOCK);
+    }
+    SEARCHING = false;
+    SEARCH_PONDERING = false;
+    discard = DISCARD_MOVE;
+    DISCARD_MOVE = false;
+    pthread_mutex_unlock(&INPUT_LOCK);
+    return discard;
+}
+
+static void run_search(struct gameState *gs, struct searchLimits *limits, struct searchResult *sr)
+{
+    int i;
+
+    for (i = 0; i < gs->plies; i++) {
+        GAME_HISTORY[i] = gs->boards[i].hash;
+    }
+    limits->report = report_thinking;
+    limits->threads = THREADS;
+    search(&gs->boards[gs->plies], GAME_HISTORY, gs->plies, limits, sr);
+}
+
+static bool computer_to_move(const struct gameState *gs)
+{
+    if (gs->game_over) {
+        return false;
+    }
+    return gs->boards[gs->plies].side_to_move == WHITE ? gs->computer_white : gs->computer_black;
+}
+
+static void xboard_think_and_move(struct gameState *gs)
+{
+    struct searchLimits limits = {0};
+    struct searchResult sr;
+    char buf[6];
+    int engine_moves;
+
+    limits.depth = gs->xb_depth;
+    if (gs->xb_move_time) {
+        limits.movetime = gs->xb_move_time;
+    } else if (gs->xb_time > 0) {
+        if (gs->boards[gs->plies].side_to_move == WHITE) {
+            limits.wtime = gs->xb_time;
+            limits.btime = gs->xb_otime;
+        } else {
+            limits.btime = gs->xb_time;
+            limits.wtime = gs->xb_otime;
+        }
+        limits.winc = limits.binc = gs->xb_increment;
+        if (gs->xb_moves_per_period) {
+            engine_moves = gs->plies / 2;
+            limits.movestogo = gs->xb_moves_per_period - (engine_moves % gs->xb_moves_per_period);
+        }
+    } else if (!limits.depth) {
+        limits.depth = XBOARD_DEFAULT_DEPTH;
+    }
+
+    run_search(gs, &limits, &sr);
+    if (end_search(false)) {
+        return;
+    }
+    // mated or stalemated, the game is over even if it was never adjudicated
+    if (sr.best_move == NULL_MOVE) {
+        test_for_end(gs);
+        gs->game_over = true;
+        return;
+    }
+    play_move(gs, sr.best_move);
+    bb_move_to_uci(sr.best_move, buf);
+    send_line("move %s", buf);
+    if (PROTOCOL == PROTOCOL_CONSOLE) {
+        print_bb_board(&gs->boards[gs->plies]);
+    }
+    gs->game_over = test_for_end(gs);
+}
+
+
+/* UCI */
+
+static void set_threads(int n)
+{
+    if (n < 1 || n > MAX_SEARCH_THREADS) {
+        send_line("info string threads must be between 1 and %d", MAX_SEARCH_THREADS);
+        return;
+    }
+    THREADS = n;
+}
+
+static void uci_hello()
+{
+    send_line("id name Bejola C");
+    send_line("id author the Bejola authors");
+    send_line("option name Hash type spin default %d min 1 max 65536", TT_DEFAULT_MB);
+    send_line("option name Clear Hash type button");
+    send_line("option name Threads type spin default 1 min 1 max %d", MAX_SEARCH_THREADS);
+    send_line("option name Ponder type check default false");
+    send_line("uciok");
+}
+
+// setoption name <id> [value <x>] - names may contain spaces
+static void uci_setoption(char *args)
+{
+    char *name, *value;
+    int mb;
+
+    name = strstr(args, "name ");
+    if (!name) {
+        return;
+    }
+    name += 5;
+    value = strstr(name, " value ");
+    if (value) {
+        *value = '\0';
+        value += 7;
+    }
+    if (strcasecmp(name, "Hash") == 0 && value) {
+        mb = atoi(value);
+        if (mb < 1) {
+            send_line("info string invalid hash size %s", value);
+            return;
+        }
+        TT_resize_search(mb);
+    } else if (strcasecmp(name, "Clear Hash") == 0) {
+        TT_clear_search();
+    } else if (strcasecmp(name, "Threads") == 0 && value) {
+        set_threads(atoi(value));
+    }
+    // Ponder needs nothing from us, it only tells us the GUI may send go ponder
+}
+
+static bool load_moves(struct gameState *gs, char *moves)
+{
+    char *tok, *save;
+    Move m;
+
+    for (tok = strtok_r(moves, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        m = find_legal_move(gs, tok);
+        if (m == NULL_MOVE) {
+            send_line("info string illegal move %s", tok);
+            return false;
+        }
+        play_move(gs, m);
+    }
+    return true;
+}
+
+// position [startpos | fen <fen>] [moves <move1> ... <movei>]
+static void uci_position(struct gameState *gs, char *args)
+{
+    struct bitChessBoard start;
+    char *moves, *fen;
+
+    moves = strstr(args, "moves");
+    if (moves) {
+        moves[-1] = '\0';
+        moves += 5;
+    }
+    if (command_is(args, "startpos")) {
+        set_bitboard_startpos(&start);
+    } else if (command_is(args, "fen")) {
+        fen = args + 3;
+        while (isspace((unsigned char) *fen)) {
+            fen++;
+        }
+        if (!load_bitboard_from_fen(&start, fen)) {
+            send_line("info string invalid fen %s", fen);
+            return;
+        }
+    } else {
+        send_line("info string invalid position command");
+        return;
+    }
+    new_game(gs, &start);
+    if (moves) {
+        load_moves(gs, moves);
+    }
+}
+
+static void uci_go(struct gameState *gs, char *args, unsigned long seq)
+{
+    struct searchLimits limits = {0};
+    struct searchResult sr;
+    char *tok, *val, *save;
+    char best[6], ponder_move[6];
+    bool infinite = false, ponder = false;
+
+    for (tok = strtok_r(args, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        if (strcmp(tok, "infinite") == 0) {
+            infinite = true;
+            continue;
+        }
+        if (strcmp(tok, "ponder") == 0) {
+            ponder = true;
+            continue;
+        }
+        val = strtok_r(NULL, " \t", &save);
+        if (!val) {
+            break;
+        }
+        if (strcmp(tok, "wtime") == 0) {
+            limits.wtime = atol(val);
+        } else if (strcmp(tok, "btime") == 0) {
+            limits.btime = atol(val);
+        } else if (strcmp(tok, "winc") == 0) {
+            limits.winc = atol(val);
+        } else if (strcmp(tok, "binc") == 0) {
+            limits.binc = atol(val);
+        } else if (strcmp(tok, "movestogo") == 0) {
+            limits.movestogo = atoi(val);
+        } else if (strcmp(tok, "depth") == 0) {
+            limits.depth = atoi(val);
+        } else if (strcmp(tok, "nodes") == 0) {
+            limits.nodes = strtoul(val, NULL, 10);
+        } else if (strcmp(tok, "movetime") == 0) {
+            limits.movetime = atol(val);
+        }
+        // searchmoves and mate are not supported, their arguments are skipped like any other
+    }
+
+    pthread_mutex_lock(&INPUT_LOCK);
+    PENDING_GO--;
+    begin_search_locked(seq, ponder);
+    pthread_mutex_unlock(&INPUT_LOCK);
+
+    run_search(gs, &limits, &sr);
+    end_search(infinite);
+
+    if (sr.pawn_hash_probes) {
+        send_line("info string pawn hash hits %lu of %lu (%.1f%%)", sr.pawn_hash_hits, sr.pawn_hash_probes,
+                  100.0 * sr.pawn_hash_hits / sr.pawn_hash_probes);
+    }
+    bb_move_to_uci(sr.best_move, best);
+    if (sr.pv_length >= 2) {
+        bb_move_to_uci(sr.pv[1], ponder_move);
+        send_line("bestmove %s ponder %s", best, ponder_move);
+    } else {
+        send_line("bestmove %s", best);
+    }
+}
+
+
+/* xboard and the console */
+
+static void xboard_features()
+{
+    send_line("feature myname=\"Bejola C\"");
+    send_line("feature ping=1");
+    send_line("feature setboard=1");
+    send_line("feature san=0");
+    send_line("feature sigint=0");
+    send_line("feature sigterm=1");
+    send_line("feature reuse=1");
+    send_line("feature time=1");
+    send_line("feature usermove=0");
+    send_line("feature colors=0");
+    send_line("feature memory=1");
+    send_line("feature smp=1");
+    send_line("feature nps=0");
+    send_line("feature debug=1");
+    send_line("feature analyze=0");
+    send_line("feature done=1");
+}
+
+// level MPS BASE INC - BASE is minutes or minutes:seconds, INC is seconds
+static void xboard_level(struct gameState *gs, const char *args)
+{
+    int mps, minutes, seconds = 0;
+    double inc;
+    char base[32];
+
+    if (sscanf(args, "%d %31s %lf", &mps, base, &inc) != 3) {
+        send_line("Error (invalid level): %s", args);
+        return;
+    }
+    if (sscanf(base, "%d:%d", &minutes, &seconds) < 1) {
+        send_line("Error (invalid level): %s", args);
+        return;
+    }
+    gs->xb_moves_per_period = mps;
+    gs->xb_increment = (long)(inc * 1000);
+    gs->xb_time = gs->xb_otime = (minutes * 60L + seconds) * 1000;
+    gs->xb_move_time = 0;
+}
+
+static void xboard_new(struct gameState *gs)
+{
+    struct bitChessBoard start;
+
+    set_bitboard_startpos(&start);
+    new_game(gs, &start);
+    gs->computer_white = false;
+    gs->computer_black = true;
+    gs->xb_depth = 0;
+    TT_clear_search_lazy();
+    gs->game_over = test_for_end(gs);
+}
+
+static void xboard_user_move(struct gameState *gs, const char *s)
+{
+    Move m = find_legal_move(gs, s);
+
+    if (m == NULL_MOVE) {
+        send_line("Illegal move: %s", s);
+        return;
+    }
+    play_move(gs, m);
+    gs->game_over = test_for_end(gs);
+}
+
+static void xboard_draw(struct gameState *gs)
 {
-    init_check_tables();
-    TT_init(0);
+    // FIDE rule 9.3 - at move 50 without pawn move or capture, either side can claim a draw.  Move 50 = half-move 100.
+    if (gs->boards[gs->plies].halfmove_clock >= 100) {
+        if (PROTOCOL == PROTOCOL_XBOARD) {
+            send_line("offer draw");
+        } else {
+            send_line("Draw claimed under 50-move rule.");
+        }
+        gs->game_over = true;
+    } else if (PROTOCOL != PROTOCOL_XBOARD) {
+        send_line("Draw invalid - halfmove clock only at: %d", gs->boards[gs->plies].halfmove_clock);
+    }
+}
+
+
+/* The main loop */
+
+// Returns false on quit.
+static bool process_command(struct gameState *gs, char *line, unsigned long seq)
+{
+    struct bitChessBoard start;
+    char *args, *fen;
+    int n;
+
+    args = line;
+    while (*args && !isspace((unsigned char) *args)) {
+        args++;
+    }
+    while (isspace((unsigned char) *args)) {
+        args++;
+    }
+
+    if (command_is(line, "quit")) {
+        return false;
+    } else if (command_is(line, "uci")) {
+        gs->computer_white = gs->computer_black = false;
+        uci_hello();
+    } else if (command_is(line, "isready")) {
+        send_line("readyok");
+    } else if (command_is(line, "setoption")) {
+        uci_setoption(args);
+    } else if (command_is(line, "ucinewgame")) {
+        TT_clear_search_lazy();
+    } else if (command_is(line, "position")) {
+        uci_position(gs, args);
+    } else if (command_is(line, "go")) {
+        if (PROTOCOL == PROTOCOL_UCI) {
+            uci_go(gs, args, seq);
+        } else {
+            gs->computer_white = gs->boards[gs->plies].side_to_move == WHITE;
+            gs->computer_black = !gs->computer_white;
+        }
+    } else if (command_is(line, "debug")) {
+        if (strcmp(args, "on") == 0) {
+            set_debug(true);
+        } else if (strcmp(args, "off") == 0) {
+            set_debug(false);
+        } else {
+            set_debug(DEBUG_FILE == NULL);
+        }
+    } else if (command_is(line, "xboard")) {
+        // the input thread has already switched protocols, there is no reply
+    } else if (command_is(line, "protover")) {
+        xboard_features();
+    } else if (command_is(line, "ping")) {
+        send_line("pong %s", args);
+    } else if (command_is(line, "new")) {
+        xboard_new(gs);
+    } else if (command_is(line, "force")) {
+        gs->computer_white = gs->computer_black = false;
+    } else if (command_is(line, "both")) {
+        gs->computer_white = gs->computer_black = true;
+    } else if (command_is(line, "setboard")) {
+        fen = args;
+        if (!load_bitboard_from_fen(&start, fen)) {
+            send_line("tellusererror Illegal position");
+        } else {
+            new_game(gs, &start);
+            gs->game_over = test_for_end(gs);
+        }
+    } else if (command_is(line, "undo")) {
+        take_back(gs, 1);
+    } else if (command_is(line, "remove")) {
+        take_back(gs, 2);
+    } else if (command_is(line, "sd")) {
+        n = atoi(args);
+        if (n < 1) {
+            send_line("Invalid search depth: %s", args);
+        } else {
+            gs->xb_depth = n;
+        }
+    } else if (command_is(line, "st")) {
+        gs->xb_move_time = atol(args) * 1000;
+    } else if (command_is(line, "level")) {
+        xboard_level(gs, args);
+    } else if (command_is(line, "time")) {
+        gs->xb_time = atol(args) * 10;
+    } else if (command_is(line, "otim")) {
+        gs->xb_otime = atol(args) * 10;
+    } else if (command_is(line, "memory")) {
+        n = atoi(args);
+        if (n > 0) {
+            TT_resize_search(n);
+        }
+    } else if (command_is(line, "cores")) {
+        set_threads(atoi(args));
+    } else if (command_is(line, "draw")) {
+        xboard_draw(gs);
+    } else if (command_is(line, "history")) {
+        print_history(gs);
+    } else if (command_is(line, "result") || command_is(line, "resign")) {
+        gs->game_over = true;
+        gs->computer_white = gs->computer_black = false;
+    } else if (command_is(line, "post")) {
+        POST = true;
+    } else if (command_is(line, "nopost")) {
+        POST = false;
+    } else if (command_is(line, "fen")) {
+        fen = convert_bitboard_to_fen(&gs->boards[gs->plies]);
+        send_line("%s", fen);
+        free(fen);
+    } else if (command_is(line, "help")) {
+        print_supported_commands();
+    } else if (command_is(line, "print")) {
+        print_bb_board(&gs->boards[gs->plies]);
+    } else if (command_is(line, "printpos")) {
+        print_piece_positions(&gs->boards[gs->plies]);
+    } else if (command_is(line, "usermove")) {
+        xboard_user_move(gs, args);
+    } else if (command_is(line, "stop") || command_is(line, "ponderhit") || command_is(line, "?") || command_is(line, "random") ||
+               command_is(line, "hint") || command_is(line, "hard") || command_is(line, "easy") || command_is(line, "computer") ||
+               command_is(line, "name") || command_is(line, "rating") || command_is(line, "accepted") || command_is(line, "rejected") ||
+               command_is(line, "register")) {
+        // handled by the input thread, or no-ops
+    } else if (PROTOCOL == PROTOCOL_UCI) {
+        send_line("info string unknown command %s", line);
+    } else if (strlen(line) >= 4 && strlen(line) <= 5 && isdigit((unsigned char) line[1]) && isdigit((unsigned char) line[3])) {
+        xboard_user_move(gs, line);
+    } else {
+        send_line("Error (unknown command): %s", line);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    struct bitChessBoard start;
+    struct inputLine line;
+    pthread_t reader;
+    bool running = true;
+    int i;
+
+    TT_init_search(TT_DEFAULT_MB);
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--debug") == 0) {
+            set_debug(true);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            set_threads(atoi(argv[++i]));
+        } else {
+            printf("Usage: %s [--debug] [--threads N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the console plays black until told otherwise, as the Python version does
+    set_bitboard_startpos(&start);
+    new_game(&GAME, &start);
+    GAME.computer_black = true;
+
+    if (pthread_create(&reader, NULL, input_thread, NULL) != 0) {
+        printf("Could not start the input thread\n");
+        return 1;
+    }
+
+    while (running) {
+        pthread_mutex_lock(&INPUT_LOCK);
+        while (INPUT_COUNT == 0 && !computer_to_move(&GAME)) {
+            pthread_cond_wait(&INPUT_READY, &INPUT_LOCK);
+        }
+        if (INPUT_COUNT == 0) {
+            begin_search_locked(LAST_SEQ, false);
+            pthread_mutex_unlock(&INPUT_LOCK);
+            xboard_think_and_move(&GAME);
+            continue;
+        }
+        line = INPUT_QUEUE[INPUT_HEAD];
+        INPUT_HEAD = (INPUT_HEAD + 1) % INPUT_QUEUE_SIZE;
+        INPUT_COUNT--;
+        pthread_cond_signal(&INPUT_SPACE);
+        pthread_mutex_unlock(&INPUT_LOCK);
+
+        LAST_SEQ = line.seq;
+        running = process_command(&GAME, line.text, line.seq);
+        free(line.text);
+    }
 
-    TT_destroy();
+    pthread_join(reader, NULL);
+    set_debug(false);
+    TT_destroy_search();
     return 0;
 }
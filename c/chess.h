@@ -1,2 +1,45 @@
-/* place holder for now */
+#pragma once
 
+#include <stdbool.h>
+#include "bitboard.h"
+#include "search.h"
+
+// The chess binary is an engine process speaking UCI or xboard (or a bare console protocol for humans, which is the
+// xboard command set plus a board printout).  A dedicated thread reads stdin so that stop, ?, ponderhit, isready and
+// quit are acted on while the main thread is searching; everything else is queued and run in order by the main thread.
+
+#define INPUT_LINE_MAX 8192
+#define INPUT_QUEUE_SIZE 256
+
+// Depth used by xboard and the console when there is neither a clock (level/time) nor a fixed time per move (st).
+#define XBOARD_DEFAULT_DEPTH 6
+
+enum engineProtocol {
+    PROTOCOL_CONSOLE = 0,
+    PROTOCOL_XBOARD,
+    PROTOCOL_UCI
+};
+
+// A line of input and its position in the input stream.  The sequence number lets a stop that was read before a
+// search started be told apart from one that was meant for an earlier search.
+typedef struct inputLine {
+    char *text;
+    unsigned long seq;
+} inputLine;
+
+// boards[plies] is the current position, boards[0 .. plies-1] the game before it, which search() needs for
+// repetition detection and undo/remove need to take moves back.
+typedef struct gameState {
+    struct bitChessBoard boards[MAX_GAME_HISTORY + 1];
+    Move moves[MAX_GAME_HISTORY];
+    int plies;
+    bool computer_white;
+    bool computer_black;
+    bool game_over;
+    int xb_depth;           // sd, 0 = no limit
+    long xb_move_time;      // st, in ms
+    int xb_moves_per_period;  // level MPS, 0 = the whole game
+    long xb_increment;      // level INC, in ms
+    long xb_time;           // time, our clock in ms
+    long xb_otime;          // otim, the opponent's clock in ms
+} gameState;
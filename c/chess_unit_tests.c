@@ -9,6 +9,9 @@
 #include "generate_moves.h"
 #include "evaluate_board.h"
 #include "hash.h"
+#include "perft.h"
+#include "search.h"
+#include "move_picker.h"
 
 void movelist_sort_alpha(struct MoveList *ml, bool is_classic)
 {
@@ -36,6 +39,25 @@ void movelist_sort_alpha(struct MoveList *ml, bool is_classic)
     }
 }
 
+// The bitboard generators produce compact moves, which the tests mostly want back as Moves.
+void expand_bb_move_list(const struct bitChessBoard *pbb, const struct bitMoveList *bml, struct MoveList *ml)
+{
+    int i;
+
+    for (i = 0; i < bml->size; i++) {
+        ml->moves[i] = expand_compact_move(pbb, bml->moves[i]);
+    }
+    ml->size = bml->size;
+}
+
+void generate_bb_moves_expanded(struct bitChessBoard *pbb, void (*generator)(struct bitChessBoard *, struct bitMoveList *), struct MoveList *ml)
+{
+    struct bitMoveList bml;
+
+    generator(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, ml);
+}
+
 int gen_capture_differential(uc piece_moving, uc piece_captured)
 {
     return(piece_value(piece_captured) - piece_value(piece_moving));
@@ -720,16 +742,7 @@ void calc_moves_bitboard(struct bitChessBoard *pbb, int depth, bool divide)
 
 
 
-    MOVELIST_CLEAR(&ml);
-
-#ifndef DISABLE_HASH
-    if (!TT_probe_bb(pbb, &ml)) {
-#endif
-        generate_bb_move_list(pbb, &ml);
-#ifndef DISABLE_HASH
-        TT_insert_bb(pbb, &ml);
-    }
-#endif
+    generate_bb_moves_expanded(pbb, generate_bb_move_list, &ml);
 
 
     if (divide) {
@@ -851,7 +864,15 @@ bool perft_bitboard(char *fen, int depth, struct perft_list pl, bool divide, boo
     start = clock();
     _startticks = rdtsc();
 
-    calc_moves_bitboard(pbb, depth, divide);
+    if (divide) {
+        calc_moves_bitboard(pbb, depth, divide);
+    } else {
+        // perft_counts[depth] holds the count for depth 1, perft_counts[1] the count for the full depth.  The perft
+        // cache holds leaf counts only, so each depth is its own perft.
+        for (i = 1; i <= depth; i++) {
+            perft_counts[depth - i + 1] = perft_bb_nodes(pbb, i);
+        }
+    }
 
     _stopticks = rdtsc();
     stop = clock();
@@ -1057,6 +1078,856 @@ int perft_tests(bool include_extended_list, int *s, int *f, bool divide, bool us
     return 0;
 }
 
+bool parallel_perft(const char *fen, int depth, int num_threads, uint_64 expected)
+{
+    struct bitChessBoard *pbb;
+    uint_64 serial, parallel;
+    bool ret = true;
+
+    pbb = new_bitboard();
+    if (!load_bitboard_from_fen(pbb, fen)) {
+        printf("Invalid FEN %s in parallel perft \n", fen);
+        free(pbb);
+        return false;
+    }
+
+    parallel = perft_bb_parallel(pbb, depth, num_threads);
+    serial = perft_bb_nodes(pbb, depth);
+    if (parallel != expected || serial != expected) {
+        printf("FAILED parallel perft %s depth %d threads %d: parallel %lu serial %lu expected %lu\n", fen, depth, num_threads, parallel, serial, expected);
+        ret = false;
+    }
+    free(pbb);
+    return ret;
+}
+
+bool divide_perft(const char *fen, int depth, int num_threads, uint_64 expected)
+{
+    struct bitChessBoard *pbb;
+    struct bitChessBoardAttrs pa;
+    struct bitMoveList ml;
+    uint_64 root_nodes[MAX_MOVELIST_SIZE];
+    Move m;
+    uint_64 total, sum = 0;
+    bool ret = true;
+    int i;
+
+    pbb = new_bitboard();
+    if (!load_bitboard_from_fen(pbb, fen)) {
+        printf("Invalid FEN %s in divide perft \n", fen);
+        free(pbb);
+        return false;
+    }
+
+    total = perft_bb_divide(pbb, depth, num_threads, &ml, root_nodes);
+    for (i = 0; i < ml.size; i++) {
+        sum += root_nodes[i];
+        m = expand_compact_move(pbb, ml.moves[i]);
+        store_bb_attrs(pbb, &pa);
+        apply_bb_move(pbb, m);
+        if (root_nodes[i] != perft_bb_nodes(pbb, depth - 1)) {
+            printf("FAILED divide perft %s depth %d: wrong count below root move %d\n", fen, depth, i);
+            ret = false;
+        }
+        undo_bb_move(pbb, m, &pa);
+    }
+    if (total != expected || sum != expected) {
+        printf("FAILED divide perft %s depth %d threads %d: total %lu sum %lu expected %lu\n", fen, depth, num_threads, total, sum, expected);
+        ret = false;
+    }
+    free(pbb);
+    return ret;
+}
+
+int perft_parallel_tests(int *s, int *f)
+{
+    int success = 0;
+    int fail = 0;
+
+    // 20 root moves - split at the root
+    parallel_perft("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4, 4, 197281) ? success++ : fail++;
+    parallel_perft("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 3, 97862) ? success++ : fail++;
+    // 14 and 6 root moves - too few for 4 threads, so these split at the second ply
+    parallel_perft("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 4, 674624) ? success++ : fail++;
+    parallel_perft("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 4, 422333) ? success++ : fail++;
+    // one thread falls back to the serial path
+    parallel_perft("n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1", 4, 1, 182838) ? success++ : fail++;
+    // the divide totals must match, whether the split was at the root or the second ply
+    divide_perft("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 3, 4, 8902) ? success++ : fail++;
+    divide_perft("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 4, 43238) ? success++ : fail++;
+    divide_perft("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 1, 1, 14) ? success++ : fail++;
+
+    *s = *s + success;
+    *f = *f + fail;
+    printf("Parallel perft_tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+
+bool search_test(const char *fen, int depth, Move expected_move, int min_score, int max_score)
+{
+    struct bitChessBoard *pbb;
+    struct bitChessBoardAttrs pa;
+    struct searchResult sr;
+    struct searchLimits limits = {0};
+    struct MoveList ml;
+    bool ret = true;
+    bool found;
+    int i, j;
+    char *s;
+
+    pbb = new_bitboard();
+    if (!load_bitboard_from_fen(pbb, fen)) {
+        printf("Invalid FEN %s in search test \n", fen);
+        free(pbb);
+        return false;
+    }
+
+    TT_clear_search();
+    limits.depth = depth;
+    search(pbb, NULL, 0, &limits, &sr);
+    if (sr.best_move != expected_move || sr.score < min_score || sr.score > max_score) {
+        s = pretty_print_bb_move(sr.best_move);
+        printf("FAILED search %s depth %d: best move %s score %d\n", fen, depth, s, sr.score);
+        free(s);
+        ret = false;
+    }
+
+    // every move of the principal variation has to be legal in turn
+    for (i = 0; i < sr.pv_length && ret; i++) {
+        generate_bb_moves_expanded(pbb, generate_bb_move_list, &ml);
+        found = false;
+        for (j = 0; j < ml.size; j++) {
+            if (ml.moves[j] == sr.pv[i]) {
+                found = true;
+            }
+        }
+        if (!found) {
+            printf("FAILED search %s depth %d: PV move %d is not legal\n", fen, depth, i);
+            ret = false;
+        } else {
+            store_bb_attrs(pbb, &pa);
+            apply_bb_move(pbb, sr.pv[i]);
+        }
+    }
+    free(pbb);
+    return ret;
+}
+
+static int search_test_iterations;
+
+static void search_test_report(const struct searchResult *sr)
+{
+    (void) sr;
+    search_test_iterations++;
+}
+
+bool search_limits_test()
+{
+    struct bitChessBoard *pbb;
+    struct searchResult sr;
+    struct searchLimits limits = {0};
+    bool ret = true;
+    long start;
+
+    pbb = new_bitboard();
+    load_bitboard_from_fen(pbb, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+
+    // fixed depth reports every iteration
+    TT_clear_search();
+    search_test_iterations = 0;
+    limits.depth = 3;
+    limits.report = search_test_report;
+    search(pbb, NULL, 0, &limits, &sr);
+    if (search_test_iterations != 3 || sr.depth != 3 || sr.best_move == NULL_MOVE) {
+        printf("FAILED search limits: depth 3 gave %d iterations, depth %d\n", search_test_iterations, sr.depth);
+        ret = false;
+    }
+
+    // a node budget stops mid-iteration and keeps the last completed depth
+    TT_clear_search();
+    memset(&limits, 0, sizeof(limits));
+    limits.nodes = 20000;
+    search(pbb, NULL, 0, &limits, &sr);
+    if (sr.nodes > limits.nodes || sr.best_move == NULL_MOVE || sr.depth < 1) {
+        printf("FAILED search limits: node budget %lu searched %lu nodes to depth %d\n", limits.nodes, sr.nodes, sr.depth);
+        ret = false;
+    }
+
+    // a budget too small to finish depth 1 still has to come back with a legal move
+    TT_clear_search();
+    limits.nodes = 5;
+    search(pbb, NULL, 0, &limits, &sr);
+    if (sr.best_move == NULL_MOVE) {
+        printf("FAILED search limits: no move from a 5 node search\n");
+        ret = false;
+    }
+
+    // 1 second left with 10 moves to go - the search must stop well inside the clock
+    TT_clear_search();
+    memset(&limits, 0, sizeof(limits));
+    limits.wtime = 1000;
+    limits.btime = 1000;
+    limits.movestogo = 10;
+    start = search_now_ms();
+    search(pbb, NULL, 0, &limits, &sr);
+    if (search_now_ms() - start > 500 || sr.best_move == NULL_MOVE) {
+        printf("FAILED search limits: clock search took %ld ms\n", search_now_ms() - start);
+        ret = false;
+    }
+
+    // Lazy SMP - helpers must stop with the main thread, and their nodes are counted
+    TT_clear_search();
+    memset(&limits, 0, sizeof(limits));
+    limits.depth = 4;
+    limits.threads = 4;
+    search(pbb, NULL, 0, &limits, &sr);
+    if (sr.depth != 4 || sr.best_move == NULL_MOVE || sr.nodes == 0) {
+        printf("FAILED search limits: 4 threads reached depth %d\n", sr.depth);
+        ret = false;
+    }
+    TT_clear_search();
+    limits.depth = 0;
+    limits.movetime = 200;
+    start = search_now_ms();
+    search(pbb, NULL, 0, &limits, &sr);
+    if (search_now_ms() - start > 400 || sr.best_move == NULL_MOVE) {
+        printf("FAILED search limits: 4 thread movetime 200 search took %ld ms\n", search_now_ms() - start);
+        ret = false;
+    }
+
+    free(pbb);
+    return ret;
+}
+
+// Walk every line to the given depth, the running eval totals and the pawn hash have to match a fresh count after
+// each apply and undo.
+bool eval_totals_walk(struct bitChessBoard *pbb, int depth)
+{
+    struct bitMoveList ml;
+    struct bitChessBoard fresh;
+    struct bitChessBoardAttrs pa;
+    Move m;
+    int i;
+    bool ret = true;
+
+    fresh = *pbb;
+    compute_bb_eval_totals(&fresh);
+    if (fresh.pst_mg != pbb->pst_mg || fresh.pst_eg != pbb->pst_eg || fresh.material_key != pbb->material_key ||
+        pbb->pawn_hash != compute_bitboard_pawn_hash(pbb)) {
+        char *s = convert_bitboard_to_fen(pbb);
+        printf("FAILED eval totals %d/%d material %x pawn hash %lx, should be %d/%d material %x pawn hash %lx: %s\n",
+               pbb->pst_mg, pbb->pst_eg, pbb->material_key, pbb->pawn_hash, fresh.pst_mg, fresh.pst_eg, fresh.material_key,
+               compute_bitboard_pawn_hash(pbb), s);
+        free(s);
+        return false;
+    }
+    if (depth == 0) {
+        return true;
+    }
+
+    generate_bb_move_list(pbb, &ml);
+    for (i = 0; i < ml.size && ret; i++) {
+        m = expand_compact_move(pbb, ml.moves[i]);
+        store_bb_attrs(pbb, &pa);
+        apply_bb_move(pbb, m);
+        ret = eval_totals_walk(pbb, depth - 1);
+        undo_bb_move(pbb, m, &pa);
+    }
+    return ret;
+}
+
+bool eval_test(const char *fen, int expected_score)
+{
+    struct bitChessBoard *pbb;
+    int score;
+
+    pbb = new_bitboard();
+    load_bitboard_from_fen(pbb, fen);
+    score = evaluate_bb_board(pbb);
+    free(pbb);
+    if (score != expected_score) {
+        printf("FAILED eval %s: score %d, should be %d\n", fen, score, expected_score);
+        return false;
+    }
+    return true;
+}
+
+int eval_score(const char *fen)
+{
+    struct bitChessBoard *pbb;
+    int score;
+
+    pbb = new_bitboard();
+    load_bitboard_from_fen(pbb, fen);
+    score = evaluate_bb_board(pbb);
+    free(pbb);
+    return score;
+}
+
+struct bitChessBoard *load_test_board(struct bitChessBoard *pbb, const char *fen)
+{
+    load_bitboard_from_fen(pbb, fen);
+    return pbb;
+}
+
+bool material_test(unsigned int material_key, int white_pawns, int black_pawns, int phase, int imbalance)
+{
+    struct materialEntry me;
+
+    evaluate_material(material_key | ((uint_64) white_pawns << 32) | ((uint_64) black_pawns << 36), &me);
+    if (me.phase != phase || me.imbalance != imbalance || me.evaluate) {
+        printf("FAILED material %x %d %d: phase %d imbalance %d, should be %d %d\n", material_key, white_pawns,
+               black_pawns, me.phase, me.imbalance, phase, imbalance);
+        return false;
+    }
+    return true;
+}
+
+bool pawn_structure_test(uint_64 white_pawns, uint_64 black_pawns, int mg, int eg, uint_64 white_passed, uint_64 black_passed)
+{
+    struct pawnHashEntry pe;
+
+    evaluate_pawn_structure(white_pawns, black_pawns, &pe);
+    if (pe.mg != mg || pe.eg != eg || pe.passed[0] != white_passed || pe.passed[1] != black_passed) {
+        printf("FAILED pawn structure %lx %lx: %d/%d passed %lx %lx, should be %d/%d passed %lx %lx\n", white_pawns,
+               black_pawns, pe.mg, pe.eg, pe.passed[0], pe.passed[1], mg, eg, white_passed, black_passed);
+        return false;
+    }
+    return true;
+}
+
+int eval_tests(int *s, int *f)
+{
+    static const char *walk_fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R2Pp1k/8/6P1/8 b - e3 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "n1n5/PPPk4/8/8/8/8/4Kp1p/5b1N w - - 0 2",
+    };
+    struct bitChessBoard *pbb;
+    struct pawnHashEntry pe;
+    uint_64 probes, hits, probes_after, hits_after;
+    int success = 0;
+    int fail = 0;
+    int i;
+
+    pbb = new_bitboard();
+
+    // the scores of chessboard.py's evaluate_board() with the C piece values - the starting position is even, and a
+    // position scores the same as its color-flipped twin
+    eval_test("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 0) ? success++ : fail++;
+    eval_test("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 105) ? success++ : fail++;
+    eval_test("r3k2r/pppbbppp/2n2q1P/1P2p3/3pn3/BN2PNP1/P1PPQPB1/R3K2R b KQkq - 0 1", 105) ? success++ : fail++;
+    // kings and pawns only is all endgame: the e2 pawn is 100 - 20, isolated (-15) and passed (+10), a7 is 100 + 5,
+    // isolated and passed, and the kings cancel out
+    eval_test("4k3/p7/8/8/8/8/4P3/4K3 w - - 0 1", -25) ? success++ : fail++;
+    eval_test("4k3/p7/8/8/8/8/4P3/4K3 b - - 0 1", 25) ? success++ : fail++;
+    // the king on e4 is 40 and on one of e2's key squares
+    eval_test("4k3/8/8/8/4K3/8/P3P3/8 w - - 0 1", 80 + 105 - 5 - 5 + 40 + 30 + 75) ? success++ : fail++;
+    // phase 2 of 24: the king on g1 is 30 in the middlegame and -30 in the endgame like the one on e8, the pawns cancel
+    // out, and a rook with one pawn is worth 48 more than with five
+    eval_test("4k3/4p3/8/8/8/8/4P3/3R2K1 w - - 0 1", 555) ? success++ : fail++;
+    eval_test("rnbqk1r1/pppppppp/8/8/8/8/PPPPPPPP/RNBQ1RK1 w q - 0 1", 25) ? success++ : fail++;
+
+    // the endings the material table recognizes: the dead draws and KNNK, KPK won on a key square or outside the
+    // square of the pawn and not otherwise, and KXK, all from white's point of view
+    eval_test("8/8/4k3/8/8/3BK3/8/8 w - - 0 1", 0) ? success++ : fail++;
+    eval_test("8/8/4k3/8/8/4K3/8/8 b - - 0 1", 0) ? success++ : fail++;
+    eval_test("8/8/3nk3/8/8/4K3/8/8 w - - 0 1", 0) ? success++ : fail++;
+    eval_test("8/8/4k3/8/8/2NNK3/8/8 b - - 0 1", 0) ? success++ : fail++;
+    eval_test("4k3/8/8/8/4K3/8/4P3/8 w - - 0 1", KNOWN_WIN + PAWN_VALUE + 10) ? success++ : fail++;
+    eval_test("6k1/8/8/8/8/8/P7/K7 w - - 0 1", KNOWN_WIN + PAWN_VALUE + 10) ? success++ : fail++;
+    eval_test("6k1/8/8/8/8/8/P7/K7 b - - 0 1", -(PAWN_VALUE / 4 + 5 + 5 * 5)) ? success++ : fail++;
+    eval_test("4k3/8/8/8/8/8/4P3/4K3 w - - 0 1", PAWN_VALUE / 4 + 5 + 5 * 5) ? success++ : fail++;
+    eval_test("4k3/8/8/8/8/8/8/3RK3 b - - 0 1", -(KNOWN_WIN + ROOK_VALUE + 60)) ? success++ : fail++;
+    // KBNK: the light squared bishop on f1 wants the king in a8 or h1, and the dark squared one on g1 in a1 or h8
+    eval_score("7k/8/5K2/8/8/8/8/1N3B2 w - - 0 1") < eval_score("k7/8/2K5/8/8/8/8/1N3B2 w - - 0 1") ? success++ : fail++;
+    eval_score("7k/8/5K2/8/8/8/8/1N4B1 w - - 0 1") > eval_score("k7/8/2K5/8/8/8/8/1N4B1 w - - 0 1") ? success++ : fail++;
+    // a rook against a bishop is scaled most of the way to a draw
+    abs(eval_score("4k3/8/8/8/8/8/8/R3K1b1 w - - 0 1")) < PAWN_VALUE ? success++ : fail++;
+    material_test(MATERIAL_KEY(WB, 2) + MATERIAL_KEY(BN, 2), 5, 5, 4, 40) ? success++ : fail++;
+    material_test(MATERIAL_KEY(WR, 1) + MATERIAL_KEY(BR, 1) + MATERIAL_KEY(BN, 1), 8, 7, 5, -36 - (-24 + 12)) ? success++ : fail++;
+    // the search has nothing to look for with one minor piece left, but KNNK can still be mated with help
+    BB_IS_DEAD_DRAW(load_test_board(pbb, "8/8/4k3/8/8/3BK3/8/8 w - - 0 1")) ? success++ : fail++;
+    !BB_IS_DEAD_DRAW(load_test_board(pbb, "8/8/4k3/8/8/2NNK3/8/8 b - - 0 1")) ? success++ : fail++;
+    !BB_IS_DEAD_DRAW(load_test_board(pbb, "8/8/4k3/8/8/3BK3/7P/8 w - - 0 1")) ? success++ : fail++;
+
+    // e3 is backward and d4 passed, f5 isolated and backward
+    pawn_structure_test((1ul << D4) | (1ul << E3), 1ul << F5, 20, 40, 1ul << D4, 0) ? success++ : fail++;
+    pawn_structure_test(1ul << F4, (1ul << D5) | (1ul << E6), -20, -40, 0, 1ul << D5) ? success++ : fail++;
+    // a2 and a3 are both isolated, a2 is doubled, and only the front one is passed
+    pawn_structure_test((1ul << A2) | (1ul << A3), 0, -25, -35, 1ul << A3, 0) ? success++ : fail++;
+    // the rook pawns' key squares are the two in front of the promotion square on the neighboring file
+    evaluate_pawn_structure(1ul << A2, 1ul << H7, &pe);
+    if (pe.key_squares[0] == ((1ul << B7) | (1ul << B8)) && pe.key_squares[1] == ((1ul << G2) | (1ul << G1))) {
+        success++;
+    } else {
+        printf("FAILED rook pawn key squares %lx %lx\n", pe.key_squares[0], pe.key_squares[1]);
+        fail++;
+    }
+
+    // the second probe of a position finds the first one's entry
+    load_bitboard_from_fen(pbb, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    evaluate_bb_board(pbb);
+    pawn_hash_stats(&probes, &hits);
+    evaluate_bb_board(pbb);
+    pawn_hash_stats(&probes_after, &hits_after);
+    (probes_after == probes + 1 && hits_after == hits + 1) ? success++ : fail++;
+
+    for (i = 0; i < (int) (sizeof(walk_fens) / sizeof(walk_fens[0])); i++) {
+        load_bitboard_from_fen(pbb, walk_fens[i]);
+        eval_totals_walk(pbb, 3) ? success++ : fail++;
+    }
+    free(pbb);
+
+    *s = *s + success;
+    *f = *f + fail;
+    printf("Eval tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+
+int search_tests(int *s, int *f)
+{
+    int success = 0;
+    int fail = 0;
+
+    TT_init_search(16);
+
+    // back rank mate in one - iterative deepening stops at the first iteration that sees it, so the score is
+    // MATE_SCORE + the depth left over after the mate, which is 0 in the depth 1 iteration
+    search_test("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", 3, CREATE_BB_MOVE(A1, A8, 0, 0, MOVE_CHECK), MATE_SCORE, MATE_SCORE) ? success++ : fail++;
+    // scholar's mate
+    search_test("r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4", 4, CREATE_BB_MOVE(H5, F7, BP, 0, MOVE_CHECK), MATE_SCORE, MATE_SCORE) ? success++ : fail++;
+    // black is stalemated - no move and a draw score
+    search_test("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", 2, NULL_MOVE, 0, 0) ? success++ : fail++;
+    // free queen, which leaves a won KRK
+    search_test("4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1", 3, CREATE_BB_MOVE(D2, D5, BQ, 0, 0), KNOWN_WIN + ROOK_VALUE, KNOWN_WIN + ROOK_VALUE + 200) ? success++ : fail++;
+    // white's only move walks into Ra1 mate
+    search_test("6k1/8/8/8/8/r7/1r6/7K w - - 0 1", 4, CREATE_BB_MOVE(H1, G1, 0, 0, 0), -MATE_SCORE - 2, -MATE_SCORE - 2) ? success++ : fail++;
+
+    search_limits_test() ? success++ : fail++;
+
+    TT_destroy_search();
+
+    *s = *s + success;
+    *f = *f + fail;
+    printf("Search tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+
+int uci_move_tests(int *s, int *f)
+{
+    int success = 0;
+    int fail = 0;
+    char buf[6];
+
+    bb_move_to_uci(CREATE_BB_MOVE(E2, E4, 0, 0, MOVE_DOUBLE_PAWN), buf);
+    strcmp(buf, "e2e4") == 0 ? success++ : fail++;
+    bb_move_to_uci(CREATE_BB_MOVE(E1, G1, 0, 0, MOVE_CASTLE), buf);
+    strcmp(buf, "e1g1") == 0 ? success++ : fail++;
+    bb_move_to_uci(CREATE_BB_MOVE(B7, A8, BR, WQ, 0), buf);
+    strcmp(buf, "b7a8q") == 0 ? success++ : fail++;
+    bb_move_to_uci(CREATE_BB_MOVE(H2, H1, 0, BN, 0), buf);
+    strcmp(buf, "h2h1n") == 0 ? success++ : fail++;
+    bb_move_to_uci(NULL_MOVE, buf);
+    strcmp(buf, "0000") == 0 ? success++ : fail++;
+
+    *s = *s + success;
+    *f = *f + fail;
+    printf("UCI move tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+
+static int find_bb_move(const struct MoveList *ml, Move m)
+{
+    int i;
+
+    for (i = 0; i < ml->size; i++) {
+        if (SAME_BB_MOVE(ml->moves[i], m)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// bb_validate_move() has to give back every generated move exactly and refuse every other from/to pair, the capture
+// and quiet generators have to split the full list between them, and the move picker has to return the full list
+// once each no matter which moves it is told to try first.
+bool move_picker_test(const char *fen)
+{
+    struct bitChessBoard *pbb;
+    struct MoveList full, captures, quiets;
+    struct movePicker mp;
+    int history[16][64] = {{0}};
+    int seen[MAX_MOVELIST_SIZE] = {0};
+    Move killers[2], m;
+    int i, start, end, count = 0;
+    bool ret = true;
+
+    pbb = new_bitboard();
+    if (!load_bitboard_from_fen(pbb, fen)) {
+        printf("Invalid FEN %s in move picker test \n", fen);
+        free(pbb);
+        return false;
+    }
+    generate_bb_moves_expanded(pbb, generate_bb_move_list, &full);
+
+    for (i = 0; i < full.size; i++) {
+        if (bb_validate_move(pbb, full.moves[i]) != (full.moves[i] & ~PIECE_MOVING)) {
+            printf("FAILED %s: bb_validate_move changed generated move %lx\n", fen, full.moves[i]);
+            ret = false;
+        }
+    }
+    for (start = 0; start < 64; start++) {
+        for (end = 0; end < 64; end++) {
+            m = CREATE_BB_MOVE(start, end, 0, 0, 0);
+            if (find_bb_move(&full, m) < 0 && bb_validate_move(pbb, m) != NULL_MOVE) {
+                printf("FAILED %s: bb_validate_move accepted %lx\n", fen, m);
+                ret = false;
+            }
+        }
+    }
+
+    if (!pbb->in_check) {
+        generate_bb_moves_expanded(pbb, generate_bb_captures, &captures);
+        generate_bb_moves_expanded(pbb, generate_bb_quiets, &quiets);
+        if (captures.size + quiets.size != full.size) {
+            printf("FAILED %s: %d captures + %d quiets != %d moves\n", fen, captures.size, quiets.size, full.size);
+            ret = false;
+        }
+        for (i = 0; i < captures.size; i++) {
+            if (find_bb_move(&full, captures.moves[i]) < 0 || !(GET_PIECE_CAPTURED(captures.moves[i]) || GET_PROMOTED_TO(captures.moves[i]))) {
+                ret = false;
+            }
+        }
+        for (i = 0; i < quiets.size; i++) {
+            if (find_bb_move(&full, quiets.moves[i]) < 0 || GET_PIECE_CAPTURED(quiets.moves[i]) || GET_PROMOTED_TO(quiets.moves[i])) {
+                ret = false;
+            }
+        }
+    }
+
+    // the last generated move as the TT move, a quiet or capturing first move as a killer, and a killer that is not
+    // even pseudo-legal
+    killers[0] = full.size ? full.moves[0] : NULL_MOVE;
+    killers[1] = CREATE_BB_MOVE(A1, H8, 0, 0, 0);
+    move_picker_init(&mp, pbb, NULL_MOVE, full.size ? full.moves[full.size - 1] : NULL_MOVE, killers, (const int (*)[64]) history);
+    while ((m = move_picker_next(&mp)) != NULL_MOVE) {
+        i = find_bb_move(&full, m);
+        if (i < 0 || seen[i]) {
+            printf("FAILED %s: move picker returned %lx %s\n", fen, m, i < 0 ? "which is not legal" : "twice");
+            ret = false;
+            break;
+        }
+        seen[i] = 1;
+        count++;
+    }
+    if (count != full.size) {
+        printf("FAILED %s: move picker returned %d of %d moves\n", fen, count, full.size);
+        ret = false;
+    }
+
+    free(pbb);
+    return ret;
+}
+
+int move_picker_tests(int *s, int *f)
+{
+    int success = 0;
+    int fail = 0;
+
+    move_picker_test("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1") ? success++ : fail++;
+    move_picker_test("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1") ? success++ : fail++;
+    move_picker_test("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R4K1R b kq - 0 1") ? success++ : fail++;
+    move_picker_test("rnQq1k1r/pp2bppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R b KQ - 1 8") ? success++ : fail++;
+    move_picker_test("8/8/3p4/1Pp4r/KR3p1k/8/4P1P1/8 w - c6 0 1") ? success++ : fail++;
+    move_picker_test("rnb2k1r/pp1Pbppp/2p5/q7/2B5/P7/1PP1NnPP/RNBQK2R w KQ - 1 8") ? success++ : fail++;
+    move_picker_test("8/2p5/3p4/KP5r/1R4Pk/5p2/4P3/8 w - - 0 1") ? success++ : fail++;
+    move_picker_test("n1n5/PPP5/2k5/8/8/8/4Kppp/5N1N w - - 0 1") ? success++ : fail++;
+    move_picker_test("8/2p5/3p4/KP5r/1R2Pp1k/8/6P1/8 b - e3 0 1") ? success++ : fail++;
+    move_picker_test("8/8/8/3k4/r3Pp1K/8/8/8 b - e3 0 1") ? success++ : fail++;
+    move_picker_test("8/8/8/5k2/4Pp2/8/8/4KR2 b - e3 0 1") ? success++ : fail++;
+    move_picker_test("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1") ? success++ : fail++;
+    move_picker_test("r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10") ? success++ : fail++;
+    // castling through an attacked square, and black stalemated
+    move_picker_test("r3k2r/8/8/8/8/8/8/R3K1r1 w Qkq - 0 1") ? success++ : fail++;
+    move_picker_test("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1") ? success++ : fail++;
+
+    *s = *s + success;
+    *f = *f + fail;
+    printf("Move picker tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+
+// The selective generators against the subset of generate_bb_move_list() they are meant to produce - the same moves
+// and the same flags, MOVE_CHECK included.
+static bool same_bb_move_lists(const char *fen, const char *what, const struct MoveList *expected, const struct MoveList *actual)
+{
+    int i, j;
+    bool found;
+
+    if (expected->size != actual->size) {
+        printf("FAILED %s: %s gave %d moves instead of %d\n", fen, what, actual->size, expected->size);
+        return false;
+    }
+    for (i = 0; i < actual->size; i++) {
+        found = false;
+        for (j = 0; j < expected->size && !found; j++) {
+            found = (actual->moves[i] & ~PIECE_MOVING) == (expected->moves[j] & ~PIECE_MOVING);
+        }
+        if (!found) {
+            printf("FAILED %s: %s gave %lx\n", fen, what, actual->moves[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool selective_movegen_test(const char *fen)
+{
+    struct bitChessBoard *pbb;
+    struct MoveList full, expected, actual;
+    Move m;
+    int i;
+    bool ret = true;
+
+    pbb = new_bitboard();
+    if (!load_bitboard_from_fen(pbb, fen)) {
+        printf("Invalid FEN %s in selective movegen test \n", fen);
+        free(pbb);
+        return false;
+    }
+    generate_bb_moves_expanded(pbb, generate_bb_move_list, &full);
+
+    MOVELIST_CLEAR(&expected);
+    for (i = 0; i < full.size; i++) {
+        if (GET_PIECE_CAPTURED(full.moves[i]) || GET_PROMOTED_TO(full.moves[i])) {
+            MOVELIST_ADD(&expected, full.moves[i]);
+        }
+    }
+    generate_bb_moves_expanded(pbb, generate_bb_captures, &actual);
+    ret = same_bb_move_lists(fen, "generate_bb_captures", &expected, &actual) && ret;
+
+    if (pbb->in_check) {
+        generate_bb_moves_expanded(pbb, generate_bb_evasions, &actual);
+        ret = same_bb_move_lists(fen, "generate_bb_evasions", &full, &actual) && ret;
+    } else {
+        MOVELIST_CLEAR(&expected);
+        for (i = 0; i < full.size; i++) {
+            m = full.moves[i];
+            if (!GET_PIECE_CAPTURED(m) && !GET_PROMOTED_TO(m) && (GET_FLAGS(m) & MOVE_CHECK)) {
+                MOVELIST_ADD(&expected, m);
+            }
+        }
+        generate_bb_moves_expanded(pbb, generate_bb_quiet_checks, &actual);
+        ret = same_bb_move_lists(fen, "generate_bb_quiet_checks", &expected, &actual) && ret;
+    }
+
+    free(pbb);
+    return ret;
+}
+
+int selective_movegen_tests(int *s, int *f)
+{
+    static const char *fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R4K1R b kq - 0 1",
+        "rnQq1k1r/pp2bppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R b KQ - 1 8",
+        "8/8/3p4/1Pp4r/KR3p1k/8/4P1P1/8 w - c6 0 1",
+        "rnb2k1r/pp1Pbppp/2p5/q7/2B5/P7/1PP1NnPP/RNBQK2R w KQ - 1 8",
+        "r1b2rk1/2p2ppp/p7/1p6/3P3q/1BP3bP/PP3QP1/RNB1R1K1 w - - 1 0",
+        "8/2p5/3p4/KP5r/1R4Pk/5p2/4P3/8 w - - 0 1",
+        "n1n5/PPP5/2k5/8/8/8/4Kppp/5N1N w - - 0 1",
+        "8/2p5/3p4/KP5r/1R2Pp1k/8/6P1/8 b - e3 0 1",
+        "8/8/8/3k4/r3Pp1K/8/8/8 b - e3 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        // discovered checks by a pawn that stays on the line, a knight, a pawn leaving a diagonal and the king
+        "4k3/8/8/8/4P3/8/8/4R1K1 w - - 0 1",
+        "4k3/8/8/8/4N3/8/8/4R1K1 w - - 0 1",
+        "7k/8/8/8/8/2P5/1B6/K7 w - - 0 1",
+        "7k/8/8/8/3K4/8/1B6/8 w - - 0 1",
+        // checks by castling and by a double push, and a pinned piece that would otherwise check
+        "5k2/8/8/8/8/8/8/4K2R w K - 0 1",
+        "8/8/8/3k4/8/8/4P3/4K3 w - - 0 1",
+        "8/8/8/8/4k3/8/8/rN2K3 w - - 0 1",
+    };
+    int success = 0;
+    int fail = 0;
+    int i;
+
+    for (i = 0; i < (int) (sizeof(fens) / sizeof(fens[0])); i++) {
+        selective_movegen_test(fens[i]) ? success++ : fail++;
+    }
+
+    *s = *s + success;
+    *f = *f + fail;
+    printf("Selective movegen tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+
+#ifdef __AVX2__
+// The AVX2 fills must agree with the magic lookups, on random occupancies with random sliders among the pieces.
+int slider_attack_tests(int *s, int *f)
+{
+    uint_64 x = 0x9e3779b97f4a7c15ul;
+    uint_64 occupied, rooks, bishops;
+    int success = 0;
+    int fail = 0;
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        occupied = x & (x >> 3);
+        rooks = occupied & (x >> 11) & (x >> 23);
+        bishops = occupied & (x >> 19) & (x >> 31);
+        if (bb_slider_attacks_avx2(rooks, bishops, occupied) == bb_slider_attacks_magic(rooks, bishops, occupied)) {
+            success++;
+        } else {
+            printf("slider attacks differ: rooks %lx bishops %lx occupied %lx\n", rooks, bishops, occupied);
+            fail++;
+        }
+    }
+    // full sets reach every edge, so a wrap around the board would show up here
+    bb_slider_attacks_avx2(~0ul, ~0ul, 0) == bb_slider_attacks_magic(~0ul, ~0ul, 0) ? success++ : fail++;
+    bb_slider_attacks_avx2(0x8100000000000081ul, 0, 0) == bb_slider_attacks_magic(0x8100000000000081ul, 0, 0) ? success++ : fail++;
+
+    // one pass or fail for the whole lot, they are not worth 10000 lines of the total
+    *s = *s + (fail == 0);
+    *f = *f + (fail != 0);
+    printf("Slider attack tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+#endif
+
+int search_tt_tests(int *s, int *f)
+{
+    int success = 0;
+    int fail = 0;
+    int i;
+    struct ttData td;
+    uint_64 base = 0x123456ul;
+    CompactMove m = CREATE_COMPACT_MOVE(E2, E4, CM_DOUBLE_PAWN, 0);
+    CompactMove promo = CREATE_COMPACT_MOVE(B7, A8, CM_PROMOTE_QUEEN, 1);
+
+    TT_init_search(1);
+
+    TT_store_search(base, m, -100005, 7, TT_BOUND_EXACT);
+    if (TT_probe_search(base, &td) && td.move == m && td.score == -100005 && td.depth == 7 && td.bound == TT_BOUND_EXACT) {
+        success++;
+    } else {
+        printf("Search TT round trip failed\n");
+        fail++;
+    }
+
+    TT_store_search(base + 1, promo, 250, 3, TT_BOUND_LOWER);
+    if (TT_probe_search(base + 1, &td) && td.move == promo && td.score == 250 && td.bound == TT_BOUND_LOWER) {
+        success++;
+    } else {
+        printf("Search TT promotion move round trip failed\n");
+        fail++;
+    }
+
+    // storing again without a move keeps the move we already had
+    TT_store_search(base, NULL_COMPACT_MOVE, 12, 8, TT_BOUND_UPPER);
+    if (TT_probe_search(base, &td) && td.move == m && td.score == 12 && td.depth == 8) {
+        success++;
+    } else {
+        printf("Search TT lost the best move on a move-less store\n");
+        fail++;
+    }
+
+    // Fill one bucket with deep entries (hashes that differ only above the mask), then store a shallow one.  The
+    // shallowest resident should be the one replaced.
+    TT_clear_search();
+    for (i = 0; i < TT_BUCKET_SIZE; i++) {
+        TT_store_search(base | ((uint_64)(i + 1) << 48), m, 0, 10 + i, TT_BOUND_EXACT);
+    }
+    TT_store_search(base | (9ul << 48), m, 0, 1, TT_BOUND_EXACT);
+    if (!TT_probe_search(base | (1ul << 48), &td) && TT_probe_search(base | (2ul << 48), &td) && TT_probe_search(base | (9ul << 48), &td)) {
+        success++;
+    } else {
+        printf("Search TT did not replace the shallowest entry in the bucket\n");
+        fail++;
+    }
+
+    // after enough new searches, even the deepest stale entry loses to a shallow current one
+    for (i = 0; i < 2; i++) {
+        TT_new_search();
+    }
+    TT_store_search(base | (10ul << 48), m, 0, 1, TT_BOUND_EXACT);
+    TT_store_search(base | (11ul << 48), m, 0, 1, TT_BOUND_EXACT);
+    if (TT_probe_search(base | (9ul << 48), &td) || TT_probe_search(base | (2ul << 48), &td)) {
+        printf("Search TT kept stale entries over current ones\n");
+        fail++;
+    } else {
+        success++;
+    }
+
+    // a lazy clear invalidates everything without touching the table, and new stores still work afterwards
+    TT_store_search(base, m, 5, 5, TT_BOUND_EXACT);
+    TT_clear_search_lazy();
+    if (TT_probe_search(base, &td) || TT_probe_search(base | (10ul << 48), &td)) {
+        printf("Search TT lazy clear left entries visible\n");
+        fail++;
+    } else {
+        success++;
+    }
+    TT_store_search(base, m, 6, 6, TT_BOUND_EXACT);
+    if (TT_probe_search(base, &td) && td.score == 6) {
+        success++;
+    } else {
+        printf("Search TT store after lazy clear failed\n");
+        fail++;
+    }
+
+    // resize, then fill and clear with several threads
+    TT_resize_search(16);
+    if (TT_search_size_mb() == 16 && !TT_probe_search(base, &td)) {
+        success++;
+    } else {
+        printf("Search TT resize failed - %d MB\n", TT_search_size_mb());
+        fail++;
+    }
+    // 20 MB rounds down to the 16 MB table there is, which is kept with its entries
+    TT_store_search(base, m, 7, 7, TT_BOUND_EXACT);
+    TT_resize_search(20);
+    if (TT_search_size_mb() == 16 && TT_probe_search(base, &td) && td.score == 7) {
+        success++;
+    } else {
+        printf("Search TT resize to the same rounded size reallocated\n");
+        fail++;
+    }
+    for (i = 0; i < 100000; i++) {
+        TT_store_search(base * (i + 1), m, i, 4, TT_BOUND_EXACT);
+    }
+    TT_CLEAR_THREADS = 4;
+    TT_clear_search();
+    TT_CLEAR_THREADS = 0;
+    for (i = 0; i < 100000; i++) {
+        if (TT_probe_search(base * (i + 1), &td)) {
+            break;
+        }
+    }
+    if (i == 100000) {
+        success++;
+    } else {
+        printf("Search TT parallel clear missed entry %d\n", i);
+        fail++;
+    }
+
+    TT_destroy_search();
+
+    *s = *s + success;
+    *f = *f + fail;
+    printf("Search TT tests result:  Success: %d,  Failure: %d\n", success, fail);
+    return 0;
+}
+
 bool test_a_pinned_piece_position_bb(const char *fen, bool for_defense, struct SquareList answers, int pos) {
     struct bitChessBoard *pbb;
     struct SquareList tests, realanswers;
@@ -1415,6 +2286,7 @@ void bitboard_movegen_tests(int *s, int *f)
 
     struct bitChessBoard *pbb;
     struct MoveList ml;
+    struct bitMoveList bml;
 
 
     printf("\n\n");
@@ -1424,8 +2296,9 @@ void bitboard_movegen_tests(int *s, int *f)
     load_bitboard_from_fen(pbb, "8/8/8/4k3/3n1r2/4K3/8/2N5 w - - 0 1");
     printf("Moves for 8/8/8/4k3/3n1r2/4K3/8/2N5 w - - 0 1\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     movelist_sort_alpha(&ml, true);
     free(pbb);;
 
@@ -1437,8 +2310,9 @@ void bitboard_movegen_tests(int *s, int *f)
     load_bitboard_from_fen(pbb, "8/7P/6k1/1pP5/2P2P1P/8/P7/K7 w - b6 0 1");
     printf("8/7P/6k1/1pP5/2P2P1P/8/P7/K7 w - b6 0 1\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     free(pbb);
 
     printf("\n\n");
@@ -1447,8 +2321,9 @@ void bitboard_movegen_tests(int *s, int *f)
     load_bitboard_from_fen(pbb, "k7/7P/8/8/8/8/P7/K7 w - - 0 1");
     printf("k7/7P/8/8/8/8/P7/K7 w - - 0 1\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     free(pbb);
 
     printf("\n\n");
@@ -1457,8 +2332,9 @@ void bitboard_movegen_tests(int *s, int *f)
     load_bitboard_from_fen(pbb, "k7/1n6/2P5/8/8/8/8/K7 w - - 0 1");
     printf("k7/1n6/2P5/8/8/8/8/K7 w - - 0 1\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     free(pbb);
 
     printf("\n\n");
@@ -1467,8 +2343,9 @@ void bitboard_movegen_tests(int *s, int *f)
     load_bitboard_from_fen(pbb, "k7/1n6/2P5/5pP1/8/8/8/K7 w - f6 0 1");
     printf("moves for k7/1n6/2P5/5pP1/8/8/8/K7 w - f6 0 1\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     free(pbb);
 
     printf("\n\n");
@@ -1477,8 +2354,9 @@ void bitboard_movegen_tests(int *s, int *f)
     load_bitboard_from_fen(pbb, "k7/p7/8/8/4Pp2/6p1/5Q2/7K b - e3 0 1");
     printf("moves for k7/p7/8/8/4Pp2/6p1/5Q2/7K b - e3 0 1\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     free(pbb);
 
 
@@ -1489,8 +2367,9 @@ void bitboard_movegen_tests(int *s, int *f)
     set_bitboard_startpos(pbb);
     printf("moves for startpos\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     free(pbb);
 
     MOVELIST_CLEAR(&ml);
@@ -1498,8 +2377,9 @@ void bitboard_movegen_tests(int *s, int *f)
     load_bitboard_from_fen(pbb, "k7/8/6Q1/8/8/3r4/8/7K w - - 0 1");
     printf("Moves for k7/8/6Q1/8/8/3r4/8/7K w - - 0 1\n");
 
-    generate_bb_move_list(pbb, &ml);
-    print_bb_move_list(&ml);
+    generate_bb_move_list(pbb, &bml);
+    print_bb_move_list(pbb, &bml);
+    expand_bb_move_list(pbb, &bml, &ml);
     free(pbb);
 
 
@@ -1606,7 +2486,7 @@ bool movelist_comparison(const char *fen)
 */
 
     generate_move_list(pb, &classic);
-    generate_bb_move_list(pbb, &bb);
+    generate_bb_moves_expanded(pbb, generate_bb_move_list, &bb);
     movelist_sort_alpha(&classic, true);
     movelist_sort_alpha(&bb, false);
 
@@ -1690,131 +2570,6 @@ bool movelist_comparison(const char *fen)
 }
 
 
-void perf1()
-{
-    clock_t start, stop;
-    double elapsed;
-    int i;
-
-    struct ChessBoard *pb;
-    struct bitChessBoard *pbb;
-    struct bitChessBoardAttrs attr;
-    struct ChessBoard b;
-    struct bitChessBoard bb;
-    struct MoveList ml;
-    const int numreps = 1000000;
-    const int numreps2 = 20000000;
-
-    const_bitmask_init();
-    pb = new_board();
-    pbb = new_bitboard();
-    set_start_position(pb);
-    set_bitboard_startpos(pbb);
-
-    printf("Opening:\n");
-
-    start = clock();
-    for (i=0; i<numreps; i++) {
-        MOVELIST_CLEAR(&ml);
-        generate_move_list(pb, &ml);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("Old way elapsed; %f ms\n", elapsed);
-
-    start = clock();
-    for (i=0; i<numreps; i++) {
-        MOVELIST_CLEAR(&ml);
-        generate_bb_move_list(pbb, &ml);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("New way elapsed; %f ms\n\n", elapsed);
-
-    printf("Midgame: 1r1q1rk1/2p1bppp/p5b1/3pP3/Bn1Pn3/2N1BN1P/1P2QPP1/R2R2K1 w - - 0 1\n");
-    load_bitboard_from_fen(pbb, "1r1q1rk1/2p1bppp/p5b1/3pP3/Bn1Pn3/2N1BN1P/1P2QPP1/R2R2K1 w - - 0 1");
-    load_from_fen(pb,"1r1q1rk1/2p1bppp/p5b1/3pP3/Bn1Pn3/2N1BN1P/1P2QPP1/R2R2K1 w - - 0 1");
-    start = clock();
-    for (i=0; i<numreps; i++) {
-        MOVELIST_CLEAR(&ml);
-        generate_move_list(pb, &ml);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("Old way elapsed; %f ms\n", elapsed);
-
-    start = clock();
-    for (i=0; i<numreps; i++) {
-        MOVELIST_CLEAR(&ml);
-        generate_bb_move_list(pbb, &ml);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("New way elapsed; %f ms\n\n", elapsed);
-
-    printf("Endgame: r2r4/pp3p2/4bkpp/8/7P/3B1P2/PP4P1/1K1R3R b - - 0 1\n");
-    load_bitboard_from_fen(pbb, "r2r4/pp3p2/4bkpp/8/7P/3B1P2/PP4P1/1K1R3R b - - 0 1");
-    load_from_fen(pb,"r2r4/pp3p2/4bkpp/8/7P/3B1P2/PP4P1/1K1R3R b - - 0 1");
-    start = clock();
-    for (i=0; i<numreps; i++) {
-        MOVELIST_CLEAR(&ml);
-        generate_move_list(pb, &ml);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("Old way elapsed; %f ms\n", elapsed);
-
-    start = clock();
-    for (i=0; i<numreps; i++) {
-        MOVELIST_CLEAR(&ml);
-        generate_bb_move_list(pbb, &ml);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("New way elapsed; %f ms\n\n", elapsed);
-
-
-    printf("\n\nApply Move tests\n\n");
-    printf("Capture - 1r1q1rk1/2p1bppp/p5b1/3pP3/Bn1Pn3/2N1BN1P/1P2QPP1/R2R2K1 w - - 0 1\n");
-    load_bitboard_from_fen(pbb, "1r1q1rk1/2p1bppp/p5b1/3pP3/Bn1Pn3/2N1BN1P/1P2QPP1/R2R2K1 w - - 0 1");
-    load_from_fen(pb, "1r1q1rk1/2p1bppp/p5b1/3pP3/Bn1Pn3/2N1BN1P/1P2QPP1/R2R2K1 w - - 0 1");
-
-    start = clock();
-    for (i=0; i<numreps2; i++) {
-        b = *pb;
-        apply_move(&b, 167917355ul);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("old way elapsed; %f ms\n", elapsed);
-
-    start = clock();
-    for (i=0; i<numreps2; i++) {
-        bb = *pbb;
-        apply_bb_move(&bb, 167910418ul);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("New way elapsed; %f ms\n", elapsed);
-
-    start = clock();
-    for (i=0; i<numreps2; i++) {
-        store_bb_attrs(pbb, &attr);
-        apply_bb_move(pbb, 167910418ul);
-        undo_bb_move(pbb, 167910418ul, &attr);
-    }
-    stop = clock();
-    elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
-    printf("New way with undo elapsed; %f ms\n", elapsed);
-
-
-    free(pbb);
-    free(pb);
-
-
-}
-
-
 void kind_tests()
 {
     uint_64 test;
@@ -1917,13 +2672,10 @@ int main() {
 
 #ifndef DISABLE_HASH
     TT_init(0);
-    TT_init_bitboard(0);
+    perft_cache_init(PERFT_CACHE_DEFAULT_MB);
 #endif
 
-    const_bitmask_init();
-
 
-    perf1();
     //xt();
 
 
@@ -1953,13 +2705,31 @@ int main() {
     movelist_comparison("8/8/8/3k4/r3Pp1K/8/8/8 b - e3 0 1") ? success++ : fail++;
     movelist_comparison("8/8/8/5k2/4Pp2/8/8/4KR2 b - e3 0 1") ? success++ : fail++;
     movelist_comparison("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1") ? success++ : fail++;
+    // en passant: pinned along the rank and the diagonal, discovering check, and capturing the checking pawn
+    movelist_comparison("8/8/8/K2pP2r/8/8/8/7k w - d6 0 1") ? success++ : fail++;
+    movelist_comparison("8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1") ? success++ : fail++;
+    movelist_comparison("8/5bk1/8/2Pp4/8/1K6/8/8 w - d6 0 1") ? success++ : fail++;
+    movelist_comparison("8/8/8/1k1pP2R/8/8/8/4K3 w - d6 0 1") ? success++ : fail++;
+    movelist_comparison("4k3/8/8/3pP3/8/8/8/B3K3 w - d6 0 1") ? success++ : fail++;
+    movelist_comparison("8/8/8/2k5/3Pp3/8/8/4K3 b - d3 0 1") ? success++ : fail++;
+    movelist_comparison("8/8/8/8/3Pp3/8/2k5/3RK3 b - d3 0 1") ? success++ : fail++;
 
     unapply_bb_move_tests(&success, &fail);
+    search_tt_tests(&success, &fail);
+    eval_tests(&success, &fail);
+    search_tests(&success, &fail);
+    uci_move_tests(&success, &fail);
+    move_picker_tests(&success, &fail);
+    selective_movegen_tests(&success, &fail);
+#ifdef __AVX2__
+    slider_attack_tests(&success, &fail);
+#endif
 
 
     for (i=0; i<1; i++) {
         perft_tests(true, &success, &fail, false, false, true);
     }
+    perft_parallel_tests(&success, &fail);
     //init_check_tables();
 /*
     move_tests(false, &success, &fail);
@@ -1974,7 +2744,7 @@ int main() {
 
 #ifndef DISABLE_HASH
     TT_destroy();
-    TT_destroy_bitboard();
+    perft_cache_destroy();
 #ifndef NDEBUG
     printf("\n\n Hash: Inserts %ld, probes %ld\n", DEBUG_TT_INSERTS, DEBUG_TT_PROBES);
 #endif
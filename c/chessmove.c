@@ -130,3 +130,27 @@ char *pretty_print_move(Move move)
 {
     return pretty_print_move_main(move, false);
 }
+
+// Long algebraic as used by UCI and xboard (e2e4, e7e8q, castling as the king move e1g1).  s needs room for 6 chars.
+void bb_move_to_uci(Move move, char *s)
+{
+    static const char promo_chars[8] = {' ', 'p', 'n', 'b', 'r', 'q', 'k', ' '};
+    int start = GET_START(move);
+    int end = GET_END(move);
+    int promoted_to = GET_PROMOTED_TO(move);
+
+    if (move == NULL_MOVE) {
+        snprintf(s, 6, "0000");
+        return;
+    }
+    s[0] = (char)('a' + start % 8);
+    s[1] = (char)('1' + start / 8);
+    s[2] = (char)('a' + end % 8);
+    s[3] = (char)('1' + end / 8);
+    if (promoted_to) {
+        s[4] = promo_chars[promoted_to & 7];
+        s[5] = '\0';
+    } else {
+        s[4] = '\0';
+    }
+}
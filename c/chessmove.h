@@ -38,12 +38,46 @@ typedef unsigned long long Move;
 #define MOVE_FLAGS_SHIFT 56
 
 
+/* Compact moves - 2 bytes, for move lists and the transposition table on the bitboard path.
+    Bits 0-5 = Start square
+    Bits 6-11 = End square
+    Bits 12-14 = kind, one of the CM_ constants below
+    Bit 15 = the move gives check
+   The piece moving, the piece captured and the color of a promotion are not stored, they are read off the position
+   the move was generated for when it is expanded to a Move (expand_compact_move() in bitboard.c).
+*/
+typedef unsigned short CompactMove;
+
+#define CM_NORMAL 0
+#define CM_DOUBLE_PAWN 1
+#define CM_CASTLE 2
+#define CM_EN_PASSANT 3
+#define CM_PROMOTE_KNIGHT 4  // the promotions are 2 more than the piece type, so KNIGHT .. QUEEN map to 4 .. 7
+#define CM_PROMOTE_BISHOP 5
+#define CM_PROMOTE_ROOK 6
+#define CM_PROMOTE_QUEEN 7
+#define CM_CHECK 0x8000
+#define NULL_COMPACT_MOVE (CompactMove)0
+
+#define CM_START(cm) ((cm) & 63)
+#define CM_END(cm) (((cm) >> 6) & 63)
+#define CM_KIND(cm) (((cm) >> 12) & 7)
+#define CM_IS_PROMOTION(cm) (CM_KIND(cm) >= CM_PROMOTE_KNIGHT)
+#define CM_PROMOTED_TYPE(cm) (CM_KIND(cm) - 2)
+// Same from, to and promotion, whether or not the check bit agrees.
+#define SAME_COMPACT_MOVE(a, b) ((((a) ^ (b)) & 0x7fff) == 0)
+
+#define CREATE_COMPACT_MOVE(start, end, kind, gives_check) ((CompactMove)((start) | ((end) << 6) | ((kind) << 12) | ((gives_check) ? CM_CHECK : 0)))
+
 /* The move flags */
 #define MOVE_CASTLE (uc)1
 #define MOVE_EN_PASSANT (uc)2
 #define MOVE_CHECK (uc)4
 #define MOVE_DOUBLE_PAWN (uc)8
 #define NULL_MOVE (Move)0
+// Same from, to and promotion - moves from the TT or the killer table against moves from the generator, which may
+// differ in the captured piece, moving piece or flag bits.
+#define SAME_BB_MOVE(a, b) ((((a) ^ (b)) & (START | END | PROMOTED_TO)) == 0)
 
 #define GET_START(move) ((uc)(move & START))
 #define GET_END(move) ((uc)((move & END) >> END_SHIFT))
@@ -55,9 +89,18 @@ typedef unsigned long long Move;
 #define CREATE_MOVE(start, end, piece_moving, piece_captured, promoted_to, move_flags) ((start) | (((Move)(end)) << END_SHIFT) | (((Move)(piece_moving)) << PIECE_MOVING_SHIFT) | (((Move)(piece_captured)) << PIECE_CAPTURED_SHIFT) | (((Move)(promoted_to)) << PROMOTED_TO_SHIFT) | (((Move)(move_flags)) << MOVE_FLAGS_SHIFT))
 #define CREATE_BB_MOVE(start, end, piece_captured, promoted_to, move_flags) ((start) | (((Move)(end)) << END_SHIFT) | (((Move)(piece_captured)) << PIECE_CAPTURED_SHIFT) | (((Move)(promoted_to)) << PROMOTED_TO_SHIFT) | (((Move)(move_flags)) << MOVE_FLAGS_SHIFT))
 
+// The compact form of a bitboard Move.  Classic moves use mailbox squares and do not fit.
+#define COMPACT_KIND(promoted_to, move_flags) ((promoted_to) ? PIECE_BITS(promoted_to) + 2 : \
+                                               ((move_flags) & MOVE_EN_PASSANT) ? CM_EN_PASSANT : \
+                                               ((move_flags) & MOVE_CASTLE) ? CM_CASTLE : \
+                                               ((move_flags) & MOVE_DOUBLE_PAWN) ? CM_DOUBLE_PAWN : CM_NORMAL)
+#define CREATE_COMPACT_BB_MOVE(start, end, promoted_to, move_flags) CREATE_COMPACT_MOVE(start, end, COMPACT_KIND(promoted_to, move_flags), (move_flags) & MOVE_CHECK)
+#define COMPACT_MOVE(m) ((m) == NULL_MOVE ? NULL_COMPACT_MOVE : CREATE_COMPACT_BB_MOVE(GET_START(m), GET_END(m), GET_PROMOTED_TO(m), GET_FLAGS(m)))
+
 
 
 Move create_move(uc start, uc end, uc piece_moving, uc piece_captured,  uc promoted_to, uc move_flags);
 char * pretty_print_move(Move move);
 char * pretty_print_bb_move(Move move);
+void bb_move_to_uci(Move move, char *s);
 bool parse_move(Move move, uc *pStart, uc *pEnd, uc *pPiece_moving, uc *pPiece_captured, uc *pPromoted_to, uc *pMove_flags);
\ No newline at end of file
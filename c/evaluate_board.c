@@ -1,5 +1,91 @@
+#include <stdlib.h>
+
 #include "evaluate_board.h"
 
+// The tables of chessboard.py, from https://www.chessprogramming.org/Simplified_Evaluation_Function, laid out A1
+// first like the boardlayout enum, so rank 1 is the top row as printed.  Only the king has a separate endgame table.
+#define PAWN_SQUARES { \
+      0,   0,   0,   0,   0,   0,   0,   0, \
+      5,  10,  10, -20, -20,  10,  10,   5, \
+      5,  -5, -10,   0,   0, -10,  -5,   5, \
+      0,   0,   0,  20,  20,   0,   0,   0, \
+      5,   5,  10,  25,  25,  10,   5,   5, \
+     10,  10,  20,  30,  30,  20,  10,  10, \
+     50,  50,  50,  50,  50,  50,  50,  50, \
+      0,   0,   0,   0,   0,   0,   0,   0 }
+
+#define KNIGHT_SQUARES { \
+    -50, -40, -30, -30, -30, -30, -40, -50, \
+    -40, -20,   0,   5,   5,   0, -20, -40, \
+    -30,   5,  10,  15,  15,  10,   5, -30, \
+    -30,   0,  15,  20,  20,  15,   0, -30, \
+    -30,   5,  15,  20,  20,  15,   5, -30, \
+    -30,   0,  10,  15,  15,  10,   0, -30, \
+    -40, -20,   0,   0,   0,   0, -20, -40, \
+    -50, -40, -30, -30, -30, -30, -40, -50 }
+
+#define BISHOP_SQUARES { \
+    -20, -10, -10, -10, -10, -10, -10, -20, \
+    -10,   5,   0,   0,   0,   0,   5, -10, \
+    -10,  10,  10,  10,  10,  10,  10, -10, \
+    -10,   0,  10,  10,  10,  10,   0, -10, \
+    -10,   5,   5,  10,  10,   5,   5, -10, \
+    -10,   0,   5,  10,  10,   5,   0, -10, \
+    -10,   0,   0,   0,   0,   0,   0, -10, \
+    -20, -10, -10, -10, -10, -10, -10,  20 }
+
+#define ROOK_SQUARES { \
+      0,   0,   0,   5,   5,   0,   0,   0, \
+     -5,   0,   0,   0,   0,   0,   0,  -5, \
+     -5,   0,   0,   0,   0,   0,   0,  -5, \
+     -5,   0,   0,   0,   0,   0,   0,  -5, \
+     -5,   0,   0,   0,   0,   0,   0,  -5, \
+     -5,   0,   0,   0,   0,   0,   0,  -5, \
+      5,  10,  10,  10,  10,  10,  10,   5, \
+      0,   0,   0,   0,   0,   0,   0,   0 }
+
+#define QUEEN_SQUARES { \
+    -20, -10, -10,  -5,  -5, -10, -10, -20, \
+    -10,   0,   5,   0,   0,   0,   0, -10, \
+    -10,   5,   5,   5,   5,   5,   0, -10, \
+      0,   0,   5,   5,   5,   5,   0,  -5, \
+     -5,   0,   5,   5,   5,   5,   0,  -5, \
+    -10,   0,   5,   5,   5,   5,   0, -10, \
+    -10,   0,   0,   0,   0,   0,   0, -10, \
+    -20, -10, -10,  -5,  -5, -10, -10, -20 }
+
+#define KING_SQUARES { \
+     20,  30,  10,   0,   0,  10,  30,  20, \
+     20,  20,   0,   0,   0,   0,  20,  20, \
+    -10, -20, -20, -20, -20, -20, -20, -10, \
+    -20, -30, -30, -40, -40, -30, -30, -20, \
+    -30, -40, -40, -50, -50, -40, -40, -30, \
+    -30, -40, -40, -50, -50, -40, -40, -30, \
+    -30, -40, -40, -50, -50, -40, -40, -30, \
+    -30, -40, -40, -50, -50, -40, -40, -30 }
+
+#define KING_ENDGAME_SQUARES { \
+    -50, -30, -30, -30, -30, -30, -30, -50, \
+    -30, -30,   0,   0,   0,   0, -30, -30, \
+    -30, -10,  20,  30,  30,  20, -10, -30, \
+    -30, -10,  30,  40,  40,  30, -10, -30, \
+    -30, -10,  30,  40,  40,  30, -10, -30, \
+    -30, -10,  20,  30,  30,  20, -10, -30, \
+    -30, -20, -10,   0,   0, -10, -20, -30, \
+    -50, -40, -30, -20, -20, -30, -40, -50 }
+
+// The kings are always on the board and cancel out, so they carry no material here.
+const int PIECE_VALUES[8] = {[PAWN] = PAWN_VALUE, [KNIGHT] = KNIGHT_VALUE, [BISHOP] = BISHOP_VALUE,
+                             [ROOK] = ROOK_VALUE, [QUEEN] = QUEEN_VALUE};
+const int PHASE_WEIGHT[8] = {[KNIGHT] = 1, [BISHOP] = 1, [ROOK] = 2, [QUEEN] = 4};
+const unsigned int MATERIAL_KEY_UNIT[15] = {[WN] = 1u << 0, [WB] = 1u << 4, [WR] = 1u << 8, [WQ] = 1u << 12,
+                                            [BN] = 1u << 16, [BB] = 1u << 20, [BR] = 1u << 24, [BQ] = 1u << 28};
+
+const int PST_MG[8][64] = {[PAWN] = PAWN_SQUARES, [KNIGHT] = KNIGHT_SQUARES, [BISHOP] = BISHOP_SQUARES,
+                           [ROOK] = ROOK_SQUARES, [QUEEN] = QUEEN_SQUARES, [KING] = KING_SQUARES};
+const int PST_EG[8][64] = {[PAWN] = PAWN_SQUARES, [KNIGHT] = KNIGHT_SQUARES, [BISHOP] = BISHOP_SQUARES,
+                           [ROOK] = ROOK_SQUARES, [QUEEN] = QUEEN_SQUARES, [KING] = KING_ENDGAME_SQUARES};
+
 
 int piece_value(uc piece)
 {
@@ -22,4 +108,373 @@ int piece_value(uc piece)
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// Full scan for the running totals - for loading a position, and for checking the incremental ones.
+void compute_bb_eval_totals(struct bitChessBoard *pbb)
+{
+    int piece;
+    uint_64 pieces;
+
+    pbb->pst_mg = 0;
+    pbb->pst_eg = 0;
+    pbb->material_key = 0;
+    for (piece = WP; piece <= BK; piece++) {
+        if ((piece & 7) == 0 || (piece & 7) == 7) {
+            continue;
+        }
+        pieces = pbb->piece_boards[piece];
+        while (pieces) {
+            bb_pst_add(pbb, piece, pop_lsb(&pieces));
+            pbb->material_key += MATERIAL_KEY_UNIT[piece];
+        }
+    }
+}
+
+// Pawn structure weights, [relative rank] for the passed pawns.  The pawn PST already pays for advancing.
+#define DOUBLED_MG -10
+#define DOUBLED_EG -20
+#define ISOLATED_MG -10
+#define ISOLATED_EG -15
+#define BACKWARD_MG -8
+#define BACKWARD_EG -10
+static const int PASSED_MG[8] = {0, 0, 5, 10, 20, 35, 55, 0};
+static const int PASSED_EG[8] = {0, 10, 15, 25, 45, 70, 100, 0};
+// endgame points for each square our king is nearer than theirs to a passed pawn's stop square
+static const int PASSED_KING_DISTANCE[8] = {0, 0, 0, 3, 6, 9, 12, 0};
+#define KPK_KEY_SQUARE_BONUS 75
+
+#define PAWN_FILE_A 0x0101010101010101ul
+#define PAWN_FILE_H 0x8080808080808080ul
+#define PAWN_EAST(bb) (((bb) << 1) & ~PAWN_FILE_A)
+#define PAWN_WEST(bb) (((bb) >> 1) & ~PAWN_FILE_H)
+
+static __thread struct pawnHashEntry pawn_hash_table[PAWN_HASH_ENTRIES];
+static __thread uint_64 pawn_hash_probes;
+static __thread uint_64 pawn_hash_hits;
+
+static inline uint_64 north_fill(uint_64 bb)
+{
+    bb |= bb << 8;
+    bb |= bb << 16;
+    return bb | (bb << 32);
+}
+
+static inline uint_64 south_fill(uint_64 bb)
+{
+    bb |= bb >> 8;
+    bb |= bb >> 16;
+    return bb | (bb >> 32);
+}
+
+// The key squares of a white pawn, from https://en.wikipedia.org/wiki/King_and_pawn_versus_king_endgame like
+// white_kpk_key_squares in chessboard.py.
+static uint_64 kpk_key_squares(int square)
+{
+    int file = square & 7;
+    int rank = square >> 3;
+    uint_64 files;
+
+    if (file == 0) {
+        return (1ul << B7) | (1ul << B8);
+    } else if (file == 7) {
+        return (1ul << G7) | (1ul << G8);
+    }
+
+    files = 7ul << (file - 1);   // the pawn's file and both neighbors, on rank 1
+    if (rank <= 3) {
+        return files << (8 * (rank + 2));
+    } else if (rank <= 5) {
+        return (files << (8 * (rank + 1))) | (files << (8 * (rank + 2)));
+    }
+    return ((files & ~(1ul << file)) << 48) | (files << 56);
+}
+
+// Scores one side's pawns against the other's, for the side moving up the board.  Black's are scored on the board
+// flipped vertically.
+static void score_pawns(uint_64 own, uint_64 their, int *mg, int *eg, uint_64 *passed, uint_64 *key_squares)
+{
+    uint_64 their_front_span = south_fill(their >> 8);
+    uint_64 own_files = south_fill(north_fill(own));
+    uint_64 own_attack_span = north_fill(PAWN_EAST(own << 8) | PAWN_WEST(own << 8));
+    uint_64 their_attacks = PAWN_EAST(their >> 8) | PAWN_WEST(their >> 8);
+    uint_64 doubled, isolated, backward, pawns;
+    int square, rank;
+
+    // a pawn with one of ours in front of it is the rear one of a doubled pair, and never counts as passed
+    doubled = own & south_fill(own >> 8);
+    isolated = own & ~(PAWN_EAST(own_files) | PAWN_WEST(own_files));
+    // can't advance without being taken, and no pawn of ours can ever come up to defend the stop square
+    backward = ((own << 8) & their_attacks & ~own_attack_span) >> 8;
+    *passed = own & ~(their_front_span | PAWN_EAST(their_front_span) | PAWN_WEST(their_front_span)) & ~doubled;
+
+    *mg = DOUBLED_MG * __builtin_popcountl(doubled) + ISOLATED_MG * __builtin_popcountl(isolated) +
+          BACKWARD_MG * __builtin_popcountl(backward);
+    *eg = DOUBLED_EG * __builtin_popcountl(doubled) + ISOLATED_EG * __builtin_popcountl(isolated) +
+          BACKWARD_EG * __builtin_popcountl(backward);
+    pawns = *passed;
+    while (pawns) {
+        rank = pop_lsb(&pawns) >> 3;
+        *mg += PASSED_MG[rank];
+        *eg += PASSED_EG[rank];
+    }
+
+    *key_squares = 0;
+    pawns = own;
+    while (pawns) {
+        square = pop_lsb(&pawns);
+        *key_squares |= kpk_key_squares(square);
+    }
+}
+
+void evaluate_pawn_structure(uint_64 white_pawns, uint_64 black_pawns, struct pawnHashEntry *pe)
+{
+    int white_mg, white_eg, black_mg, black_eg;
+    uint_64 passed, key_squares;
+
+    score_pawns(white_pawns, black_pawns, &white_mg, &white_eg, &pe->passed[0], &pe->key_squares[0]);
+    score_pawns(__builtin_bswap64(black_pawns), __builtin_bswap64(white_pawns), &black_mg, &black_eg, &passed,
+                &key_squares);
+    pe->passed[1] = __builtin_bswap64(passed);
+    pe->key_squares[1] = __builtin_bswap64(key_squares);
+    pe->mg = white_mg - black_mg;
+    pe->eg = white_eg - black_eg;
+}
+
+const struct pawnHashEntry *probe_pawn_hash(const struct bitChessBoard *pbb)
+{
+    struct pawnHashEntry *pe = &pawn_hash_table[pbb->pawn_hash & (PAWN_HASH_ENTRIES - 1)];
+
+    pawn_hash_probes++;
+    if (pe->key == pbb->pawn_hash) {
+        pawn_hash_hits++;
+    } else {
+        evaluate_pawn_structure(pbb->piece_boards[WP], pbb->piece_boards[BP], pe);
+        pe->key = pbb->pawn_hash;
+    }
+    return pe;
+}
+
+// The calling thread's counts since it started.
+void pawn_hash_stats(uint_64 *probes, uint_64 *hits)
+{
+    *probes = pawn_hash_probes;
+    *hits = pawn_hash_hits;
+}
+
+// How many squares a king has to walk from one square to the other
+static inline int king_distance(int from, int to)
+{
+    int files = abs((from & 7) - (to & 7));
+    int ranks = abs((from >> 3) - (to >> 3));
+
+    return files > ranks ? files : ranks;
+}
+
+// Material imbalance, per side
+#define BISHOP_PAIR 40
+#define KNIGHT_PER_PAWN 6       // for each pawn over five
+#define ROOK_PER_PAWN -12
+
+// where in the table key a count is, the pawns are above the board's 32 bit material key
+#define MATERIAL_SHIFT(piece) (((piece) & 7) == PAWN ? 32 + (((piece) & BLACK) >> 1) : \
+                               4 * (((piece) & 7) - KNIGHT) + (((piece) & BLACK) << 1))
+#define MATERIAL_COUNT(key, piece) ((int) (((key) >> MATERIAL_SHIFT(piece)) & 15))
+
+static __thread struct materialEntry material_hash_table[MATERIAL_HASH_ENTRIES];
+
+// How far a square is from the nearest edge, 0 on the edge and 3 in the center
+static inline int edge_distance(int square)
+{
+    int file = square & 7;
+    int rank = square >> 3;
+
+    file = file < 7 - file ? file : 7 - file;
+    rank = rank < 7 - rank ? rank : 7 - rank;
+    return file < rank ? file : rank;
+}
+
+static int evaluate_draw(const struct bitChessBoard *pbb, int strong_side)
+{
+    (void) pbb;
+    (void) strong_side;
+    return 0;
+}
+
+// Mating material against a bare king: the material, plus the weak king near the edge and the kings close together,
+// which is the way to the mate.
+static int evaluate_kxk(const struct bitChessBoard *pbb, int strong_side)
+{
+    int strong_king = strong_side == WHITE ? pbb->wk_pos : pbb->bk_pos;
+    int weak_king = strong_side == WHITE ? pbb->bk_pos : pbb->wk_pos;
+    int score = KNOWN_WIN + 20 * (3 - edge_distance(weak_king)) + 10 * (7 - king_distance(strong_king, weak_king));
+    int piece;
+
+    for (piece = PAWN; piece <= QUEEN; piece++) {
+        score += PIECE_VALUES[piece] * __builtin_popcountl(pbb->piece_boards[piece + strong_side]);
+    }
+    return strong_side == WHITE ? score : -score;
+}
+
+// King, bishop and knight against king: the mate is only in a corner the bishop covers, so the weak king is driven to
+// one of those instead of to any edge.
+static int evaluate_kbnk(const struct bitChessBoard *pbb, int strong_side)
+{
+    int strong_king = strong_side == WHITE ? pbb->wk_pos : pbb->bk_pos;
+    int weak_king = strong_side == WHITE ? pbb->bk_pos : pbb->wk_pos;
+    int bishop = GET_LSB(pbb->piece_boards[BISHOP + strong_side]);
+    int corner1 = A1, corner2 = H8, corner_distance, score;
+
+    // a1 is a dark square, and a square is dark when its rank and file add up to an even number
+    if (((bishop & 7) + (bishop >> 3)) & 1) {
+        corner1 = A8;
+        corner2 = H1;
+    }
+    corner_distance = king_distance(weak_king, corner1) < king_distance(weak_king, corner2) ?
+                      king_distance(weak_king, corner1) : king_distance(weak_king, corner2);
+    score = KNOWN_WIN + BISHOP_VALUE + KNIGHT_VALUE + 20 * (7 - corner_distance) +
+            10 * (7 - king_distance(strong_king, weak_king));
+    return strong_side == WHITE ? score : -score;
+}
+
+// King and pawn against king.  It is won when the strong king is on one of the pawn's key squares and the pawn is not
+// left hanging to a weak king with the move, or when the weak king is outside the square of the pawn.  Anything else
+// scores a little for the pawn, so the search still heads for the key squares.
+static int evaluate_kpk(const struct bitChessBoard *pbb, int strong_side)
+{
+    int flip = strong_side == WHITE ? 0 : 56;
+    int strong_king = (strong_side == WHITE ? pbb->wk_pos : pbb->bk_pos) ^ flip;
+    int weak_king = (strong_side == WHITE ? pbb->bk_pos : pbb->wk_pos) ^ flip;
+    int pawn = GET_LSB(pbb->piece_boards[PAWN + strong_side]) ^ flip;
+    int rank = pawn >> 3;
+    int weak_to_move = pbb->side_to_move != strong_side;
+    int pawn_moves = 7 - rank - (rank == 1);    // to promote, with the double step from the second rank
+    int score;
+
+    if ((kpk_key_squares(pawn) & (1ul << strong_king)) &&
+        !(weak_to_move && king_distance(weak_king, pawn) == 1 && king_distance(strong_king, pawn) > 1)) {
+        score = KNOWN_WIN + PAWN_VALUE + 10 * rank;
+    } else if (king_distance(weak_king, (pawn & 7) + 56) - weak_to_move > pawn_moves) {
+        score = KNOWN_WIN + PAWN_VALUE + 10 * rank;
+    } else {
+        score = PAWN_VALUE / 4 + 5 * rank + 5 * (7 - king_distance(strong_king, pawn + 8));
+    }
+    return strong_side == WHITE ? score : -score;
+}
+
+// Fills in the entry for a table key, the material key with the pawn counts above it.
+void evaluate_material(uint_64 key, struct materialEntry *me)
+{
+    int count[15] = {0};
+    int non_pawn[9] = {0};
+    int imbalance[9] = {0};
+    int phase = 0;
+    int piece, color, other, weak_nothing;
+
+    for (piece = WP; piece <= BQ; piece++) {
+        if ((piece & 7) >= PAWN && (piece & 7) <= QUEEN) {
+            count[piece] = MATERIAL_COUNT(key, piece);
+            phase += PHASE_WEIGHT[piece & 7] * count[piece];
+            if ((piece & 7) != PAWN) {
+                non_pawn[piece & BLACK] += PIECE_VALUES[piece & 7] * count[piece];
+            }
+        }
+    }
+
+    me->key = key;
+    me->phase = phase < TOTAL_PHASE ? phase : TOTAL_PHASE;
+    me->evaluate = NULL;
+    me->strong_side = WHITE;
+
+    for (color = WHITE; color <= BLACK; color += BLACK) {
+        other = color ^ BLACK;
+        imbalance[color] = (count[BISHOP + color] >= 2 ? BISHOP_PAIR : 0) +
+                           KNIGHT_PER_PAWN * count[KNIGHT + color] * (count[PAWN + color] - 5) +
+                           ROOK_PER_PAWN * count[ROOK + color] * (count[PAWN + color] - 5);
+
+        // Without pawns a side needs more than a minor piece over the other side's material to be able to win.
+        // Stockfish's scaling for this.
+        me->scale[color >> 3] = SCALE_NORMAL;
+        if (count[PAWN + color] == 0 && non_pawn[color] - non_pawn[other] <= BISHOP_VALUE) {
+            me->scale[color >> 3] = non_pawn[color] < ROOK_VALUE ? 0 : (non_pawn[other] <= BISHOP_VALUE ? 4 : 14);
+        }
+
+        weak_nothing = count[PAWN + other] == 0 && non_pawn[other] == 0;
+        if (count[PAWN + color] == 0 && weak_nothing && count[KNIGHT + color] == 2 && non_pawn[color] == 2 * KNIGHT_VALUE) {
+            me->evaluate = evaluate_draw;
+        } else if (count[PAWN + color] == 0 && weak_nothing && count[KNIGHT + color] == 1 && count[BISHOP + color] == 1 &&
+                   non_pawn[color] == KNIGHT_VALUE + BISHOP_VALUE) {
+            me->evaluate = evaluate_kbnk;
+        } else if (weak_nothing && non_pawn[color] >= ROOK_VALUE) {
+            me->evaluate = evaluate_kxk;
+        } else if (count[PAWN + color] == 1 && non_pawn[color] == 0 && weak_nothing) {
+            me->evaluate = evaluate_kpk;
+        } else {
+            continue;
+        }
+        me->strong_side = color;
+    }
+    me->imbalance = imbalance[WHITE] - imbalance[BLACK];
+
+    // the dead draws, last so they are not taken for a win by the side with the minor piece
+    if (count[WP] + count[BP] == 0 && non_pawn[WHITE] + non_pawn[BLACK] <= BISHOP_VALUE) {
+        me->evaluate = evaluate_draw;
+    }
+}
+
+const struct materialEntry *probe_material_hash(const struct bitChessBoard *pbb)
+{
+    uint_64 key = pbb->material_key | ((uint_64) __builtin_popcountl(pbb->piece_boards[WP]) << 32) |
+                  ((uint_64) __builtin_popcountl(pbb->piece_boards[BP]) << 36) | MATERIAL_ENTRY_USED;
+    struct materialEntry *me = &material_hash_table[((key * 0x9e3779b97f4a7c15ul) >> 32) & (MATERIAL_HASH_ENTRIES - 1)];
+
+    if (me->key != key) {
+        evaluate_material(key, me);
+    }
+    return me;
+}
+
+// From the point of view of the side to move like the Python evaluate_board().
+int evaluate_bb_board(const struct bitChessBoard *pbb)
+{
+    const struct materialEntry *me = probe_material_hash(pbb);
+    const struct pawnHashEntry *pe;
+    int phase = me->phase;
+    int mg, eg, score, square;
+    uint_64 passed;
+
+    if (me->evaluate) {
+        score = me->evaluate(pbb, me->strong_side);
+        return (pbb->side_to_move == WHITE) ? score : -score;
+    }
+
+    pe = probe_pawn_hash(pbb);
+    mg = pbb->pst_mg + pe->mg + me->imbalance;
+    eg = pbb->pst_eg + pe->eg + me->imbalance;
+
+    // the kings move too often to be part of the cached score, so they are measured against the cached passed pawns
+    passed = pe->passed[0];
+    while (passed) {
+        square = pop_lsb(&passed);
+        eg += PASSED_KING_DISTANCE[square >> 3] * (king_distance(pbb->bk_pos, square + 8) - king_distance(pbb->wk_pos, square + 8));
+    }
+    passed = pe->passed[1];
+    while (passed) {
+        square = pop_lsb(&passed);
+        eg -= PASSED_KING_DISTANCE[7 - (square >> 3)] * (king_distance(pbb->wk_pos, square - 8) - king_distance(pbb->bk_pos, square - 8));
+    }
+
+    // kings and pawns only, the endgame tables are all there is
+    if (phase == 0) {
+        if (pe->key_squares[0] & (1ul << pbb->wk_pos)) {
+            eg += KPK_KEY_SQUARE_BONUS;
+        }
+        if (pe->key_squares[1] & (1ul << pbb->bk_pos)) {
+            eg -= KPK_KEY_SQUARE_BONUS;
+        }
+    }
+
+    score = (mg * phase + eg * (TOTAL_PHASE - phase)) / TOTAL_PHASE;
+    score = score * me->scale[score > 0 ? 0 : 1] / SCALE_NORMAL;
+    return (pbb->side_to_move == WHITE) ? score : -score;
+}
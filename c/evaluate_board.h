@@ -1,6 +1,7 @@
 #pragma once
 
 #include "chess_constants.h"
+#include "bitboard.h"
 
 #define PAWN_VALUE 100
 #define KNIGHT_VALUE 290
@@ -9,4 +10,121 @@
 #define QUEEN_VALUE 900
 #define KING_VALUE 20000
 
-int piece_value(uc piece);
\ No newline at end of file
+// Tapered piece-square evaluation, the C port of ChessBoard.evaluate_board() in chessboard.py.  The board carries
+// the middlegame and endgame sums (material plus square bonus, white minus black) and the material key.
+// apply_bb_move() keeps them current and undo_bb_move() restores them from the attrs, so a leaf eval is a blend of
+// two numbers.  The phase, from the material table, counts the minors, rooks twice and queens four times: 24 with
+// every piece on the board, 0 with only kings and pawns.
+#define TOTAL_PHASE 24
+
+// Indexed by piece type, white's point of view, A1 first.  Black uses the square flipped vertically.
+extern const int PIECE_VALUES[8];
+extern const int PHASE_WEIGHT[8];
+extern const int PST_MG[8][64];
+extern const int PST_EG[8][64];
+
+#define PST_SQUARE(piece, square) ((square) ^ (((piece) & BLACK) ? 56 : 0))
+
+static inline __attribute__((always_inline)) void bb_pst_add(struct bitChessBoard *pbb, int piece, int square)
+{
+    int type = piece & 7;
+    int sq = PST_SQUARE(piece, square);
+
+    if (piece & BLACK) {
+        pbb->pst_mg -= PIECE_VALUES[type] + PST_MG[type][sq];
+        pbb->pst_eg -= PIECE_VALUES[type] + PST_EG[type][sq];
+    } else {
+        pbb->pst_mg += PIECE_VALUES[type] + PST_MG[type][sq];
+        pbb->pst_eg += PIECE_VALUES[type] + PST_EG[type][sq];
+    }
+}
+
+static inline __attribute__((always_inline)) void bb_pst_remove(struct bitChessBoard *pbb, int piece, int square)
+{
+    int type = piece & 7;
+    int sq = PST_SQUARE(piece, square);
+
+    if (piece & BLACK) {
+        pbb->pst_mg += PIECE_VALUES[type] + PST_MG[type][sq];
+        pbb->pst_eg += PIECE_VALUES[type] + PST_EG[type][sq];
+    } else {
+        pbb->pst_mg -= PIECE_VALUES[type] + PST_MG[type][sq];
+        pbb->pst_eg -= PIECE_VALUES[type] + PST_EG[type][sq];
+    }
+}
+
+static inline __attribute__((always_inline)) void bb_pst_move(struct bitChessBoard *pbb, int piece, int start, int end)
+{
+    int type = piece & 7;
+    int from = PST_SQUARE(piece, start);
+    int to = PST_SQUARE(piece, end);
+
+    if (piece & BLACK) {
+        pbb->pst_mg -= PST_MG[type][to] - PST_MG[type][from];
+        pbb->pst_eg -= PST_EG[type][to] - PST_EG[type][from];
+    } else {
+        pbb->pst_mg += PST_MG[type][to] - PST_MG[type][from];
+        pbb->pst_eg += PST_EG[type][to] - PST_EG[type][from];
+    }
+}
+
+// Pawn structure - doubled, isolated, backward and passed pawns, and the KPK key squares - depends on the pawns
+// alone, so it is scored once per pawn_hash and kept in a table.  The pawns change on few moves, so nearly every
+// probe in a search hits.  Each thread has its own table and counters, like the helpers share nothing but the TT.
+// A zeroed entry is right for the pawnless key 0, so the table needs no initializing.
+#define PAWN_HASH_ENTRIES 8192    // a power of 2, 384 KB
+
+typedef struct pawnHashEntry {
+    uint_64 key;
+    uint_64 passed[2];          // [color >> 3]
+    uint_64 key_squares[2];     // where the side's king wins a king and pawn ending, see chessboard.py
+    short mg;                   // white minus black, like the PST totals
+    short eg;
+} pawnHashEntry;
+
+// The material key has four bits for the count of each kind of piece - knights, bishops, rooks and queens of each
+// color - so it is exact however many promotions there are.  Pawns and kings add nothing, the pawn counts are added
+// from the bitboards when the material table is probed.
+extern const unsigned int MATERIAL_KEY_UNIT[15];
+#define MATERIAL_KEY(piece, count) (MATERIAL_KEY_UNIT[piece] * (count))
+
+// Everything about the evaluation that depends on the material alone is worked out once per material key and kept,
+// per thread like the pawn table:
+//   phase      for the blend between the middlegame and endgame scores
+//   imbalance  the bishop pair, and knights better and rooks worse with more pawns on the board (Kaufman)
+//   scale      out of SCALE_NORMAL, for a side that is ahead but cannot be expected to win without pawns
+//   evaluate   for the endings the general eval gets wrong: the dead draws, KNNK, KPK, and driving the bare king to
+//              the edge (KXK) or to the bishop's corner (KBNK).  NULL for the general eval.
+#define MATERIAL_HASH_ENTRIES 1024    // a power of 2
+#define SCALE_NORMAL 64
+#define KNOWN_WIN 1000
+
+// Scores from white's point of view, strong_side the side the ending is recognized for.
+typedef int (*endgameEvalFn)(const struct bitChessBoard *pbb, int strong_side);
+
+typedef struct materialEntry {
+    uint_64 key;                // the material key and the pawn counts, with MATERIAL_ENTRY_USED set
+    endgameEvalFn evaluate;
+    short imbalance;            // white minus black
+    unsigned char phase;
+    unsigned char strong_side;  // WHITE or BLACK, for evaluate
+    unsigned char scale[2];     // [color >> 3], applied when the score favors that side
+} materialEntry;
+
+#define MATERIAL_ENTRY_USED (1ul << 63)
+
+// The positions where neither side can ever mate, so the search need not look any further: no pawns, and at most
+// one minor piece on the board.
+#define BB_IS_DEAD_DRAW(pbb) (!((pbb)->piece_boards[WP] | (pbb)->piece_boards[BP]) && \
+    ((pbb)->material_key == 0 || (pbb)->material_key == MATERIAL_KEY_UNIT[WN] || \
+     (pbb)->material_key == MATERIAL_KEY_UNIT[WB] || (pbb)->material_key == MATERIAL_KEY_UNIT[BN] || \
+     (pbb)->material_key == MATERIAL_KEY_UNIT[BB]))
+
+int piece_value(uc piece);
+void compute_bb_eval_totals(struct bitChessBoard *pbb);
+void evaluate_pawn_structure(uint_64 white_pawns, uint_64 black_pawns, struct pawnHashEntry *pe);
+const struct pawnHashEntry *probe_pawn_hash(const struct bitChessBoard *pbb);
+void pawn_hash_stats(uint_64 *probes, uint_64 *hits);
+void evaluate_material(uint_64 key, struct materialEntry *me);
+const struct materialEntry *probe_material_hash(const struct bitChessBoard *pbb);
+int evaluate_bb_board(const struct bitChessBoard *pbb);
@@ -25,10 +25,6 @@ void print_move_list_main(const struct MoveList *list, bool is_bitboard)
 }
 
 
-void print_bb_move_list(const struct MoveList *list) {
-    print_move_list_main(list, true);
-};
-
 void print_move_list(const struct MoveList *list)
 {
     print_move_list_main(list, false);
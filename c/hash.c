@@ -4,18 +4,26 @@
 
 #include "random.h"
 #include "hash.h"
+#include "table_memory.h"
 
 
 struct hashNode *TRANSPOSITION_TABLE;
-struct hashNode *BB_TRANSPOSITION_TABLE;
-long TRANSPOSITION_TABLE_SIZE = 1048799; //1048799; ////251611; // prime number;  NEEDS TO BE SAME FOR BOTH CACHES for simplicity of coding
-bool MANUAL_SIZE_OVERRIDE_USED = false;
+long TRANSPOSITION_TABLE_SIZE = 1048799; //1048799; ////251611; // prime number;
 
 #ifndef NDEBUG
 long DEBUG_TT_INSERTS;
 long DEBUG_TT_PROBES;
 #endif
 
+struct perftCacheEntry *PERFT_CACHE = NULL;
+uint_64 PERFT_CACHE_MASK = 0;
+
+struct ttBucket *SEARCH_TT = NULL;
+uint_64 SEARCH_TT_MASK = 0;
+int SEARCH_TT_GENERATION = 0;
+uint_64 SEARCH_TT_EPOCH_KEY = 0;  // XOR'ed into every stored key, changing it invalidates the whole table at once
+int TT_CLEAR_THREADS = 0;
+
 
 
 uint_64 hash_whitetomove;
@@ -24,14 +32,9 @@ uint_64 hash_whitecastlequeen;
 uint_64 hash_blackcastleking;
 uint_64 hash_blackcastlequeen;
 
-uint_64 bb_hash_whitetomove;
-
 
 uint_64 hash_enpassanttarget[120];
 uint_64 piece_hash[15][120];
-uint_64 bb_piece_hash[15][64];
-uint_64 bb_hash_enpassanttarget[64];
-uint_64 bb_hash_castling[16];
 
 
 
@@ -39,28 +42,20 @@ void TT_init(long size)
 {
     int rnd = 0; // runs from 0-789, which is the spot in our random array from random.h.
     uc i;
-    unsigned long j;
 
 #ifndef NDEBUG
     DEBUG_TT_INSERTS = 0;
     DEBUG_TT_PROBES = 0;
 #endif
 
-    assert (size == 0 || (!MANUAL_SIZE_OVERRIDE_USED) || size == TRANSPOSITION_TABLE_SIZE);
-
     if (size != 0) {
         TRANSPOSITION_TABLE_SIZE = size;
-        MANUAL_SIZE_OVERRIDE_USED = true;
     }
 
-    TRANSPOSITION_TABLE = (struct hashNode *) malloc (TRANSPOSITION_TABLE_SIZE * sizeof(struct hashNode));
+    // table_alloc() memory is already zero, which is an empty hash and an empty move list in every slot
+    TRANSPOSITION_TABLE = (struct hashNode *) table_alloc(TRANSPOSITION_TABLE_SIZE * sizeof(struct hashNode));
     assert(TRANSPOSITION_TABLE); // TODO: Real error handling
 
-    for (j = 0; j <= TRANSPOSITION_TABLE_SIZE; j++) {
-        TRANSPOSITION_TABLE[j].hash = 0;
-        MOVELIST_CLEAR(&TRANSPOSITION_TABLE[j].legal_moves);
-    }
-
     // init the hash tables:
     for (i = 0; i < 120; i++) {
         if (arraypos_is_on_board(i)) {
@@ -89,75 +84,34 @@ void TT_init(long size)
 
 }
 
-void TT_init_bitboard(long size)
-{
-    int rnd = 0; // runs from 0-789, which is the spot in our random array from random.h.
-    uc i;
-    unsigned long j;
-
-#ifndef NDEBUG
-    DEBUG_TT_INSERTS = 0;
-    DEBUG_TT_PROBES = 0;
-#endif
-
-    assert (size == 0 || (!MANUAL_SIZE_OVERRIDE_USED) || size == TRANSPOSITION_TABLE_SIZE);
-
-    if (size != 0) {
-        TRANSPOSITION_TABLE_SIZE = size;
-        MANUAL_SIZE_OVERRIDE_USED = true;
-    }
-
-
-    BB_TRANSPOSITION_TABLE = (struct hashNode *) malloc (TRANSPOSITION_TABLE_SIZE * sizeof(struct hashNode));
-    assert(BB_TRANSPOSITION_TABLE); // TODO: Real error handling
-
-    for (j = 0; j <= TRANSPOSITION_TABLE_SIZE; j++) {
-        BB_TRANSPOSITION_TABLE[j].hash = 0;
-        MOVELIST_CLEAR(&BB_TRANSPOSITION_TABLE[j].legal_moves);
-    }
-
-    // init the hash tables:
-    for (i = 0; i < 64; i++) {
-
-        bb_piece_hash[WP][i] = Random64[rnd++];
-        bb_piece_hash[WN][i] = Random64[rnd++];
-        bb_piece_hash[WB][i] = Random64[rnd++];
-        bb_piece_hash[WR][i] = Random64[rnd++];
-        bb_piece_hash[WQ][i] = Random64[rnd++];
-        bb_piece_hash[WK][i] = Random64[rnd++];
-        bb_piece_hash[BP][i] = Random64[rnd++];
-        bb_piece_hash[BN][i] = Random64[rnd++];
-        bb_piece_hash[BB][i] = Random64[rnd++];
-        bb_piece_hash[BR][i] = Random64[rnd++];
-        bb_piece_hash[BQ][i] = Random64[rnd++];
-        bb_piece_hash[BK][i] = Random64[rnd++];
-
-        if ((i >= 16 && i <= 23) || (i >= 40 && i <= 47)) {
-            bb_hash_enpassanttarget[i] = Random64[rnd++];
-        }
-    }
+void TT_destroy() {
 
-    for (i=0; i<16; i++) {
-        bb_hash_castling[i] = Random64[rnd++];
+    if (TRANSPOSITION_TABLE) {
+        table_free(TRANSPOSITION_TABLE, TRANSPOSITION_TABLE_SIZE * sizeof(struct hashNode));
+        TRANSPOSITION_TABLE = NULL;
     }
-
-    bb_hash_whitetomove = Random64[rnd++];
-
 }
 
+void perft_cache_init(int size_mb)
+{
+    uint_64 num_entries = 1;
 
-
-void TT_destroy() {
-
-    if (TRANSPOSITION_TABLE) {
-        free(TRANSPOSITION_TABLE);
+    // largest power of two that fits, so the index is a mask instead of a modulus
+    while (num_entries * 2 * sizeof(struct perftCacheEntry) <= (uint_64) size_mb * 1024 * 1024) {
+        num_entries *= 2;
     }
-}
 
-void TT_destroy_bitboard() {
+    perft_cache_destroy();
+    PERFT_CACHE = (struct perftCacheEntry *) table_alloc(num_entries * sizeof(struct perftCacheEntry));
+    assert(PERFT_CACHE); // TODO: Real error handling
+    PERFT_CACHE_MASK = num_entries - 1;
+}
 
-    if (BB_TRANSPOSITION_TABLE) {
-        free(BB_TRANSPOSITION_TABLE);
+void perft_cache_destroy()
+{
+    if (PERFT_CACHE) {
+        table_free(PERFT_CACHE, (PERFT_CACHE_MASK + 1) * sizeof(struct perftCacheEntry));
+        PERFT_CACHE = NULL;
     }
 }
 
@@ -231,6 +185,23 @@ uint_64 compute_bitboard_hash(const struct bitChessBoard *pbb)
 
 }
 
+// Only the pawns, with the same keys as compute_bitboard_hash()
+uint_64 compute_bitboard_pawn_hash(const struct bitChessBoard *pbb)
+{
+    uint_64 ret = 0;
+    uint_64 tmpmask;
+
+    tmpmask = pbb->piece_boards[WP];
+    while (tmpmask) {
+        ret ^= bb_piece_hash[WP][pop_lsb(&tmpmask)];
+    }
+    tmpmask = pbb->piece_boards[BP];
+    while (tmpmask) {
+        ret ^= bb_piece_hash[BP][pop_lsb(&tmpmask)];
+    }
+    return ret;
+}
+
 bool TT_insert(const struct ChessBoard *pb, const struct MoveList *ml)
 {
 
@@ -272,43 +243,175 @@ bool TT_probe(const struct ChessBoard *pb, struct MoveList *ml)
     }
 }
 
-bool TT_insert_bb(const struct bitChessBoard *pbb, const struct MoveList *ml)
+// Mixing the depth into the index keeps the same position at different remaining depths from fighting over one slot.
+#define PERFT_CACHE_INDEX(hash, depth) (((hash) ^ ((uint_64)(depth) * 0x9e3779b97f4a7c15ul)) & PERFT_CACHE_MASK)
+
+bool perft_cache_probe(uint_64 hash, int depth, uint_64 *nodes)
 {
+    struct perftCacheEntry *pe;
+    uint_64 key, data;
 
+    if_unlikely(!PERFT_CACHE) {
+        return false;
+    }
+    pe = &PERFT_CACHE[PERFT_CACHE_INDEX(hash, depth)];
+    key = pe->key;
+    data = pe->data;
+    if ((key ^ data) == hash && (int)(data & 0xff) == depth) {
+        *nodes = data >> 8;
+        return true;
+    }
+    return false;
+}
 
-    uint_64 hash, hash_modded;
+void perft_cache_store(uint_64 hash, int depth, uint_64 nodes)
+{
+    struct perftCacheEntry *pe;
+    uint_64 data;
 
-#ifdef DISABLE_HASH
-    return true;
-#endif
-    hash = pbb->hash;
+    if_unlikely(!PERFT_CACHE) {
+        return;
+    }
+    pe = &PERFT_CACHE[PERFT_CACHE_INDEX(hash, depth)];
+    data = (nodes << 8) | (uint_64) depth;
+    pe->key = hash ^ data;
+    pe->data = data;
+}
 
-    hash_modded = hash % TRANSPOSITION_TABLE_SIZE;
-    BB_TRANSPOSITION_TABLE[hash_modded].hash = hash;
-    BB_TRANSPOSITION_TABLE[hash_modded].legal_moves = *ml;
-#ifndef NDEBUG
-    DEBUG_TT_INSERTS ++;
-#endif
-    return true;
+
+// The largest power of two number of buckets that fits in size_mb
+static uint_64 search_tt_buckets(int size_mb)
+{
+    uint_64 num_buckets = 1;
+
+    while (num_buckets * 2 * sizeof(struct ttBucket) <= (uint_64) size_mb * 1024 * 1024) {
+        num_buckets *= 2;
+    }
+    return num_buckets;
 }
 
-bool TT_probe_bb(const struct bitChessBoard *pbb, struct MoveList *ml)
+void TT_init_search(int size_mb)
 {
+    uint_64 num_buckets = search_tt_buckets(size_mb);
+
+    // a fresh mapping is all zeroes, so there is nothing to clear
+    TT_destroy_search();
+    SEARCH_TT = (struct ttBucket *) table_alloc(num_buckets * sizeof(struct ttBucket));
+    assert(SEARCH_TT); // TODO: Real error handling
+    SEARCH_TT_MASK = num_buckets - 1;
+    SEARCH_TT_GENERATION = 0;
+}
 
-    uint_64 hash, hash_modded;
-#ifdef DISABLE_HASH
-    return false;
-#endif
-    hash = pbb->hash;
-    hash_modded = hash % TRANSPOSITION_TABLE_SIZE;
-    if (BB_TRANSPOSITION_TABLE[hash_modded].hash == hash) {
-        *ml = BB_TRANSPOSITION_TABLE[hash_modded].legal_moves;
+int TT_search_size_mb()
+{
+    return (int)(((SEARCH_TT_MASK + 1) * sizeof(struct ttBucket)) / (1024 * 1024));
+}
+
+// Only safe between searches - nothing may be probing the table while it is swapped out.
+void TT_resize_search(int size_mb)
+{
+    // compared in buckets, as a size that is not a power of two is rounded down
+    if (SEARCH_TT && SEARCH_TT_MASK + 1 == search_tt_buckets(size_mb)) {
+        return;
+    }
+    TT_init_search(size_mb);
+}
+
+void TT_destroy_search()
+{
+    if (SEARCH_TT) {
+        table_free(SEARCH_TT, (SEARCH_TT_MASK + 1) * sizeof(struct ttBucket));
+        SEARCH_TT = NULL;
+    }
+}
+
+void TT_clear_search()
+{
+    table_clear(SEARCH_TT, (SEARCH_TT_MASK + 1) * sizeof(struct ttBucket), TT_CLEAR_THREADS);
+    SEARCH_TT_GENERATION = 0;
+}
+
+// Clear without touching memory: a new epoch key makes every existing entry fail validation, and jumping the
+// generation half way round makes them the first choice to be replaced.
+void TT_clear_search_lazy()
+{
+    SEARCH_TT_EPOCH_KEY += 0x9e3779b97f4a7c15ul;
+    SEARCH_TT_GENERATION = (SEARCH_TT_GENERATION + (TT_GENERATION_MASK + 1) / 2) & TT_GENERATION_MASK;
+}
+
+void TT_new_search()
+{
+    SEARCH_TT_GENERATION = (SEARCH_TT_GENERATION + 1) & TT_GENERATION_MASK;
+}
+
+bool TT_probe_search(uint_64 hash, struct ttData *ptd)
+{
+    struct ttBucket *pb;
+    uint_64 key, data;
+    int i;
+
+    hash ^= SEARCH_TT_EPOCH_KEY;
+    pb = &SEARCH_TT[hash & SEARCH_TT_MASK];
+    for (i = 0; i < TT_BUCKET_SIZE; i++) {
+        key = pb->entries[i].key;
+        data = pb->entries[i].data;
+        if ((key ^ data) == hash && data) {
+            ptd->move = TT_DATA_MOVE(data);
+            ptd->score = TT_DATA_SCORE(data);
+            ptd->depth = TT_DATA_DEPTH(data);
+            ptd->bound = TT_DATA_BOUND(data);
 #ifndef NDEBUG
-        DEBUG_TT_PROBES++;
+            DEBUG_TT_PROBES++;
 #endif
-        return true;
+            return true;
+        }
     }
-    else {
-        return false;
+    return false;
+}
+
+void TT_store_search(uint_64 hash, CompactMove move, int score, int depth, int bound)
+{
+    struct ttBucket *pb;
+    struct ttEntry *replace;
+    uint_64 key, data;
+    int i, age, value, replace_value;
+
+    hash ^= SEARCH_TT_EPOCH_KEY;
+    pb = &SEARCH_TT[hash & SEARCH_TT_MASK];
+
+    // Take the slot this position already owns if there is one.  Otherwise replace the slot worth the least, where
+    // an entry is worth its depth less 8 plies for every search since it was written - so deep entries from the
+    // current search survive, and old entries age out even if they were deep.
+    replace = &pb->entries[0];
+    replace_value = 1 << 30;
+    for (i = 0; i < TT_BUCKET_SIZE; i++) {
+        key = pb->entries[i].key;
+        data = pb->entries[i].data;
+        if ((key ^ data) == hash) {
+            replace = &pb->entries[i];
+            // don't lose the best move we knew about if this search did not produce one
+            if (move == NULL_COMPACT_MOVE) {
+                move = TT_DATA_MOVE(data);
+            }
+            break;
+        }
+        age = (SEARCH_TT_GENERATION - TT_DATA_GENERATION(data)) & TT_GENERATION_MASK;
+        value = TT_DATA_DEPTH(data) - 8 * age;
+        if (value < replace_value) {
+            replace_value = value;
+            replace = &pb->entries[i];
+        }
+    }
+
+    if (depth < 0) {
+        depth = 0;
+    } else if (depth > 255) {
+        depth = 255;
     }
-}
\ No newline at end of file
+    data = (uint_64) move | ((uint_64)(score + TT_SCORE_OFFSET) << 16) | ((uint_64) depth << 36) | ((uint_64) bound << 44) | ((uint_64) SEARCH_TT_GENERATION << 46);
+    replace->key = hash ^ data;
+    replace->data = data;
+#ifndef NDEBUG
+    DEBUG_TT_INSERTS++;
+#endif
+}
@@ -12,20 +12,21 @@ extern uint_64 hash_whitecastlequeen;
 extern uint_64 hash_blackcastleking;
 extern uint_64 hash_blackcastlequeen;
 
-extern uint_64 bb_hash_castling[16];
+// The bb_ keys are const data written by the table generator, see bitboard_constant_generation.c
+extern const uint_64 bb_hash_castling[16];
 
-extern uint_64 bb_hash_whitetomove;
+extern const uint_64 bb_hash_whitetomove;
 
 
 extern uint_64 hash_enpassanttarget[120];
-extern uint_64 bb_hash_enpassanttarget[64];
+extern const uint_64 bb_hash_enpassanttarget[64];
 
 /* pieces are 1=pawn, 2=knight, ... 6 = king, 9 = black pawn, .. 14 = black king.
  * so 0, 7, and 8 of the 15 are not used */
 
 // TODO only compile in the one that we are using
 extern uint_64 piece_hash[15][120];
-extern uint_64 bb_piece_hash[15][64];
+extern const uint_64 bb_piece_hash[15][64];
 
 typedef struct hashNode {
 	uint_64 hash;
@@ -39,22 +40,95 @@ typedef struct hashNode {
 } hashNode;
 
 extern struct hashNode *TRANSPOSITION_TABLE;
-extern struct hashNode *BB_TRANSPOSITION_TABLE;
 extern long TRANSPOSITION_TABLE_SIZE;
-extern bool MANUAL_SIZE_OVERRIDE_USED;
 
 #ifndef NDEBUG
 extern long DEBUG_TT_INSERTS;
 extern long DEBUG_TT_PROBES;
 #endif
 
+// Perft cache - the leaf count of the subtree below a position, for a given remaining depth.  16 bytes per entry,
+// so a hit skips the whole subtree for far less memory than caching move lists.  The key is stored XOR'ed with the
+// data, so an entry torn by two threads writing at once fails validation instead of returning a bad count.
+typedef struct perftCacheEntry {
+    uint_64 key;   // hash ^ data
+    uint_64 data;  // node count in the upper 56 bits, remaining depth in the lower 8
+} perftCacheEntry;
+
+#define PERFT_CACHE_DEFAULT_MB 64
+
+extern struct perftCacheEntry *PERFT_CACHE;
+extern uint_64 PERFT_CACHE_MASK;
+
+// Search transposition table for the bitboard engine.  Buckets are one 64-byte cache line holding TT_BUCKET_SIZE
+// entries, and the bucket is found by masking the hash, so the table is always a power of two in size.  As with the
+// perft cache, the key is stored XOR'ed with the data so threads can share the table without locks.
+//
+// data layout, low bits first:
+//    16 bits - best move, as a CompactMove
+//    20 bits - score, offset by TT_SCORE_OFFSET so it is never negative (mate scores are around +/- 100000)
+//     8 bits - depth
+//     2 bits - bound type
+//     6 bits - generation, bumped once per search so stale entries can be replaced first
+#define TT_BUCKET_SIZE 4
+#define TT_DEFAULT_MB 128
+
+#define TT_BOUND_NONE 0
+#define TT_BOUND_UPPER 1  // failed low, score is at most this
+#define TT_BOUND_LOWER 2  // failed high, score is at least this
+#define TT_BOUND_EXACT 3
+
+#define TT_SCORE_OFFSET 524288
+#define TT_GENERATION_MASK 63
+
+#define TT_DATA_MOVE(d) ((CompactMove)((d) & 0xfffful))
+#define TT_DATA_SCORE(d) ((int)(((d) >> 16) & 0xffffful) - TT_SCORE_OFFSET)
+#define TT_DATA_DEPTH(d) ((int)(((d) >> 36) & 0xff))
+#define TT_DATA_BOUND(d) ((int)(((d) >> 44) & 3))
+#define TT_DATA_GENERATION(d) ((int)(((d) >> 46) & TT_GENERATION_MASK))
+
+typedef struct ttEntry {
+    uint_64 key;  // hash ^ data
+    uint_64 data;
+} ttEntry;
+
+typedef struct ttBucket {
+    struct ttEntry entries[TT_BUCKET_SIZE];
+} __attribute__((aligned(64))) ttBucket;
+
+// Number of threads TT_clear_search() uses to zero the table, 0 means one per CPU.
+extern int TT_CLEAR_THREADS;
+
+// what a probe hands back to the search
+typedef struct ttData {
+    CompactMove move;  // expand_compact_move() or bb_validate_move() turns it back into a Move
+    int score;
+    int depth;
+    int bound;
+} ttData;
+
+extern struct ttBucket *SEARCH_TT;
+extern uint_64 SEARCH_TT_MASK;
+extern int SEARCH_TT_GENERATION;
+extern uint_64 SEARCH_TT_EPOCH_KEY;
+
 void TT_init(long size);
-void TT_init_bitboard(long size);
 void TT_destroy();
-void TT_destroy_bitboard();
 bool TT_insert(const struct ChessBoard *pb, const struct MoveList *ml);
-bool TT_insert_bb(const struct bitChessBoard *pbb, const struct MoveList *ml);
 bool TT_probe(const struct ChessBoard *pb, struct MoveList *ml);
-bool TT_probe_bb(const struct bitChessBoard *pbb, struct MoveList *ml);
+void perft_cache_init(int size_mb);
+void perft_cache_destroy();
+bool perft_cache_probe(uint_64 hash, int depth, uint_64 *nodes);
+void perft_cache_store(uint_64 hash, int depth, uint_64 nodes);
+void TT_init_search(int size_mb);
+void TT_resize_search(int size_mb);
+int TT_search_size_mb();
+void TT_destroy_search();
+void TT_clear_search();
+void TT_clear_search_lazy();
+void TT_new_search();
+bool TT_probe_search(uint_64 hash, struct ttData *ptd);
+void TT_store_search(uint_64 hash, CompactMove move, int score, int depth, int bound);
 uint_64 compute_hash(const struct ChessBoard *pb);
-uint_64 compute_bitboard_hash(const struct bitChessBoard *pbb);
\ No newline at end of file
+uint_64 compute_bitboard_hash(const struct bitChessBoard *pbb);
+uint_64 compute_bitboard_pawn_hash(const struct bitChessBoard *pbb);
\ No newline at end of file
@@ -154,6 +154,9 @@ const U64 magicmoves_b_mask[64]=
 	C64(0x0028440200000000), C64(0x0050080402000000), C64(0x0020100804020000), C64(0x0040201008040200)
 };
 
+// the attack tables and initmagicmoves() only go into the table generator, the engine gets the tables it writes out
+#ifdef TABLE_GENERATOR
+
 #ifdef MINIMIZE_MAGIC
 U64 magicmovesbdb[5248];
 const U64* magicmoves_b_indices[64]=
@@ -214,6 +217,8 @@ const U64* magicmoves_r_indices[64]=
 	#endif
 #endif
 
+#endif // TABLE_GENERATOR
+
 U64 initmagicmoves_occ(const int* squares, const int numSquares, const U64 linocc)
 {
 	int i;
@@ -304,8 +309,9 @@ U64 initmagicmoves_Bmoves(const int square, const U64 occ)
 	return ret;
 }
 
-//used so that the original indices can be left as const so that the compiler can optimize better
+#ifdef TABLE_GENERATOR
 
+//used so that the original indices can be left as const so that the compiler can optimize better
 #ifndef PERFECT_MAGIC_HASH
 	#ifdef MINIMIZE_MAGIC
 		#define BmagicNOMASK2(square, occupancy) *(magicmoves_b_indices2[square]+(((occupancy)*magicmoves_b_magics[square])>>magicmoves_b_shift[square]))
@@ -461,3 +467,5 @@ void initmagicmoves(void)
 		}
 	}
 }
+
+#endif // TABLE_GENERATOR
@@ -6,6 +6,8 @@
  *
  *Usage:
  *You must first initialize the generator with a call to initmagicmoves().
+ *(In this engine the build runs initmagicmoves() in generate_tables and links
+ *the result in as const data, see bitboard_constant_generation.c.)
  *Then you can use the following macros for generating move bitboards by
  *giving them a square and an occupancy.  The macro will then "return"
  *the correct move bitboard for that particular square and occupancy. It
@@ -79,7 +81,10 @@
 //the default configuration is the best
 
 //Uncommont either one of the following or none
+//SLIDER_BACKEND=PLAIN_MAGIC turns MINIMIZE_MAGIC off, see slider_attacks.h
+#ifndef SLIDER_PLAIN_MAGIC
 #define MINIMIZE_MAGIC
+#endif
 //#define PERFECT_MAGIC_HASH unsigned short
 
 //the following works only for perfect magic hash or no defenitions above
@@ -117,6 +122,13 @@
 	#endif
 #endif
 
+//the tables are filled in by initmagicmoves() in the table generator only, the engine links them in as const data
+#ifdef TABLE_GENERATOR
+	#define MM_TABLE
+#else
+	#define MM_TABLE const
+#endif
+
 extern const U64 magicmoves_r_magics[64];
 extern const U64 magicmoves_r_mask[64];
 extern const U64 magicmoves_b_magics[64];
@@ -157,8 +169,8 @@ extern const unsigned int magicmoves_r_shift[64];
 			#define RmagicNOMASK(square, occupancy) magicmovesrdb[square][((occupancy)*magicmoves_r_magics[square])>>MINIMAL_R_BITS_SHIFT(square)]
 		#endif //USE_INLINING
 
-		extern U64 magicmovesbdb[64][1<<9];
-		extern U64 magicmovesrdb[64][1<<12];
+		extern MM_TABLE U64 magicmovesbdb[64][1<<9];
+		extern MM_TABLE U64 magicmovesrdb[64][1<<12];
 
 	#endif //MINIMIAZE_MAGICMOVES
 #else //PERFCT_MAGIC_HASH defined
@@ -245,6 +257,8 @@ extern const unsigned int magicmoves_r_shift[64];
 
 #endif //USE_INLINING
 
+#ifdef TABLE_GENERATOR
 void initmagicmoves(void);
+#endif
 
 #endif //_magicmoveshvesh
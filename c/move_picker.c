@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "evaluate_board.h"
+#include "move_picker.h"
+
+void move_picker_init(struct movePicker *mp, struct bitChessBoard *pbb, Move pv_move, Move tt_move, const Move *killers, const int (*history)[64])
+{
+    mp->pbb = pbb;
+    mp->history = history;
+    mp->phase = PICK_FIRST_MOVES;
+    mp->index = 0;
+    mp->first_moves[0] = pv_move;
+    mp->first_moves[1] = tt_move;
+    mp->killers[0] = killers[0];
+    mp->killers[1] = killers[1];
+    mp->num_early = 0;
+    mp->ml.size = 0;
+}
+
+static inline bool already_picked(const struct movePicker *mp, Move m)
+{
+    int i;
+
+    for (i = 0; i < mp->num_early; i++) {
+        if (SAME_BB_MOVE(m, mp->early[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// MVV-LVA - take the most valuable victim with the least valuable attacker first.  An en passant capture finds an
+// empty square at the end, and scores like any other pawn takes pawn.
+static inline int capture_score(const struct bitChessBoard *pbb, CompactMove cm)
+{
+    int victim = (CM_KIND(cm) == CM_EN_PASSANT) ? PAWN : BB_PIECE_ON(pbb, CM_END(cm));
+
+    return ORDER_CAPTURE + 10 * piece_value(victim) - piece_value(BB_PIECE_ON(pbb, CM_START(cm)))
+           + (CM_IS_PROMOTION(cm) ? piece_value(CM_PROMOTED_TYPE(cm)) : 0);
+}
+
+// selection sort one step at a time, most nodes cut off after the first few moves so sorting the whole list is waste
+static inline Move pick_best(struct movePicker *mp)
+{
+    int i, best, tmp_score;
+    CompactMove tmp_move;
+    Move m;
+
+    while (mp->index < mp->ml.size) {
+        best = mp->index;
+        for (i = mp->index + 1; i < mp->ml.size; i++) {
+            if (mp->scores[i] > mp->scores[best]) {
+                best = i;
+            }
+        }
+        tmp_move = mp->ml.moves[best];
+        mp->ml.moves[best] = mp->ml.moves[mp->index];
+        mp->ml.moves[mp->index] = tmp_move;
+        tmp_score = mp->scores[best];
+        mp->scores[best] = mp->scores[mp->index];
+        mp->scores[mp->index] = tmp_score;
+        mp->index++;
+        m = expand_compact_move(mp->pbb, tmp_move);
+        if (!already_picked(mp, m)) {
+            return m;
+        }
+    }
+    return NULL_MOVE;
+}
+
+Move move_picker_next(struct movePicker *mp)
+{
+    struct bitChessBoard *pbb = mp->pbb;
+    CompactMove cm;
+    Move m;
+    int i;
+
+    switch (mp->phase) {
+        case PICK_FIRST_MOVES:
+            while (mp->index < 2) {
+                m = mp->first_moves[mp->index++];
+                if (m != NULL_MOVE && !already_picked(mp, m)) {
+                    m = bb_validate_move(pbb, m);
+                    if (m != NULL_MOVE) {
+                        mp->early[mp->num_early++] = m;
+                        return m;
+                    }
+                }
+            }
+            mp->index = 0;
+            mp->phase = pbb->in_check ? PICK_GEN_EVASIONS : PICK_GEN_CAPTURES;
+            return move_picker_next(mp);
+
+        case PICK_GEN_CAPTURES:
+            generate_bb_captures(pbb, &mp->ml);
+            for (i = 0; i < mp->ml.size; i++) {
+                mp->scores[i] = capture_score(pbb, mp->ml.moves[i]);
+            }
+            mp->index = 0;
+            mp->phase = PICK_CAPTURES;
+            // fall through
+        case PICK_CAPTURES:
+            m = pick_best(mp);
+            if (m != NULL_MOVE) {
+                return m;
+            }
+            mp->index = 0;
+            mp->phase = PICK_KILLERS;
+            // fall through
+        case PICK_KILLERS:
+            while (mp->index < 2) {
+                m = mp->killers[mp->index++];
+                if (m != NULL_MOVE && !already_picked(mp, m)) {
+                    m = bb_validate_move(pbb, m);
+                    // a killer that captures here was already searched with the captures
+                    if (m != NULL_MOVE && !GET_PIECE_CAPTURED(m) && !GET_PROMOTED_TO(m)) {
+                        mp->early[mp->num_early++] = m;
+                        return m;
+                    }
+                }
+            }
+            mp->phase = PICK_GEN_QUIETS;
+            // fall through
+        case PICK_GEN_QUIETS:
+            generate_bb_quiets(pbb, &mp->ml);
+            for (i = 0; i < mp->ml.size; i++) {
+                cm = mp->ml.moves[i];
+                mp->scores[i] = mp->history[BB_PIECE_ON(pbb, CM_START(cm))][CM_END(cm)];
+            }
+            mp->index = 0;
+            mp->phase = PICK_QUIETS;
+            // fall through
+        case PICK_QUIETS:
+            m = pick_best(mp);
+            if (m != NULL_MOVE) {
+                return m;
+            }
+            mp->phase = PICK_DONE;
+            return NULL_MOVE;
+
+        case PICK_GEN_EVASIONS:
+            generate_bb_evasions(pbb, &mp->ml);
+            for (i = 0; i < mp->ml.size; i++) {
+                cm = mp->ml.moves[i];
+                if (BB_IS_CAPTURE_OR_PROMOTION(pbb, cm)) {
+                    mp->scores[i] = capture_score(pbb, cm);
+                } else if (SAME_COMPACT_MOVE(cm, COMPACT_MOVE(mp->killers[0]))) {
+                    mp->scores[i] = ORDER_KILLER_1;
+                } else if (SAME_COMPACT_MOVE(cm, COMPACT_MOVE(mp->killers[1]))) {
+                    mp->scores[i] = ORDER_KILLER_2;
+                } else {
+                    mp->scores[i] = mp->history[BB_PIECE_ON(pbb, CM_START(cm))][CM_END(cm)];
+                }
+            }
+            mp->index = 0;
+            mp->phase = PICK_EVASIONS;
+            // fall through
+        case PICK_EVASIONS:
+            m = pick_best(mp);
+            if (m != NULL_MOVE) {
+                return m;
+            }
+            mp->phase = PICK_DONE;
+            return NULL_MOVE;
+
+        case PICK_DONE:
+        default:
+            return NULL_MOVE;
+    }
+}
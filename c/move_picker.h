@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include "bitboard.h"
+
+// Staged move generation for the search.  The moves most likely to cut off are handed out before the rest of the
+// list is generated, so a node that cuts off on the TT move never generates anything, and one that cuts off on a
+// capture never generates the quiet moves:
+//   1. the previous iteration's PV move and the TT move, checked for legality with bb_validate_move()
+//   2. captures and promotions, best MVV-LVA score first
+//   3. the two killer moves, if they are legal quiet moves here
+//   4. the remaining quiet moves, best history score first
+// In check there is a single evasion stage after the first moves, as the evasions are few and generated together.
+
+// Scores of the evasion stage, which has to order every kind of move in one list.
+#define ORDER_CAPTURE 100000
+#define ORDER_KILLER_1 90000
+#define ORDER_KILLER_2 80000
+
+enum pickPhase {
+    PICK_FIRST_MOVES = 0,
+    PICK_GEN_CAPTURES,
+    PICK_CAPTURES,
+    PICK_KILLERS,
+    PICK_GEN_QUIETS,
+    PICK_QUIETS,
+    PICK_GEN_EVASIONS,
+    PICK_EVASIONS,
+    PICK_DONE
+};
+
+typedef struct movePicker {
+    struct bitChessBoard *pbb;
+    const int (*history)[64];   // [piece][to square], quiet moves are ordered by it
+    enum pickPhase phase;
+    int index;
+    Move first_moves[2];        // PV move, TT move
+    Move killers[2];
+    Move early[4];              // moves already handed out before their stage was generated
+    int num_early;
+    struct bitMoveList ml;
+    int scores[MAX_MOVELIST_SIZE];
+} movePicker;
+
+// pv_move and tt_move may be NULL_MOVE, killers points to two moves that may each be NULL_MOVE.  None of them need
+// be legal in this position.
+void move_picker_init(struct movePicker *mp, struct bitChessBoard *pbb, Move pv_move, Move tt_move, const Move *killers, const int (*history)[64]);
+// Returns NULL_MOVE once every legal move has been returned.  The position must be the same on every call.
+Move move_picker_next(struct movePicker *mp);
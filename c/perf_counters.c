@@ -0,0 +1,202 @@
+#ifdef PERF_COUNTERS
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#include "perf_counters.h"
+
+// Each event is opened on its own rather than as a group - six events do not fit in the PMU alongside the NMI
+// watchdog on most Intel parts, and the kernel will only schedule a group all at once.  The counters are read in
+// user space with rdpmc through the mmap'ed control page, which costs tens of cycles instead of a read() syscall.
+// When an event is not on the PMU at the moment (multiplexed out) we fall back to read().
+
+typedef struct perfCounterState {
+    bool active;
+    int fd[PERF_NUM_EVENTS];
+    struct perf_event_mmap_page *page[PERF_NUM_EVENTS];
+    uint_64 start[PERF_NUM_REGIONS][PERF_NUM_EVENTS];
+    uint_64 total[PERF_NUM_REGIONS][PERF_NUM_EVENTS];
+    uint_64 calls[PERF_NUM_REGIONS];
+} perfCounterState;
+
+static __thread struct perfCounterState PC;
+
+static const char *region_names[PERF_NUM_REGIONS] = {"movegen", "make", "unmake", "tt_probe", "tt_store", "kernel"};
+
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} event_configs[PERF_NUM_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+
+static inline uint_64 rdpmc(unsigned int counter)
+{
+    unsigned int hi, lo;
+    __asm__ __volatile__ ("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return ((((uint_64)(hi))<<32)|lo);
+}
+
+static inline uint_64 read_counter(int e)
+{
+    struct perf_event_mmap_page *pc = PC.page[e];
+    unsigned int seq, idx;
+    long long count;
+    uint_64 pmc;
+    int width;
+
+    if (pc) {
+        do {
+            seq = pc->lock;
+            __asm__ __volatile__ ("" ::: "memory");
+            idx = pc->index;
+            count = pc->offset;
+            if (pc->cap_user_rdpmc && idx) {
+                width = pc->pmc_width;
+                pmc = rdpmc(idx - 1);
+                count += (long long)(pmc << (64 - width)) >> (64 - width);
+            }
+            __asm__ __volatile__ ("" ::: "memory");
+        } while (pc->lock != seq);
+        if (pc->cap_user_rdpmc && idx) {
+            return (uint_64) count;
+        }
+    }
+    if (read(PC.fd[e], &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    return (uint_64) count;
+}
+
+bool perf_counters_init()
+{
+    struct perf_event_attr attr;
+    void *p;
+    int e;
+
+    memset(&PC, 0, sizeof(PC));
+    for (e = 0; e < PERF_NUM_EVENTS; e++) {
+        PC.fd[e] = -1;
+    }
+
+    for (e = 0; e < PERF_NUM_EVENTS; e++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event_configs[e].type;
+        attr.config = event_configs[e].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        PC.fd[e] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (PC.fd[e] < 0) {
+            fprintf(stderr, "perf_event_open failed for event %d, hardware counters disabled\n", e);
+            perf_counters_destroy();
+            return false;
+        }
+        p = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, PC.fd[e], 0);
+        PC.page[e] = (p == MAP_FAILED) ? NULL : (struct perf_event_mmap_page *) p;
+    }
+    PC.active = true;
+    return true;
+}
+
+void perf_counters_destroy()
+{
+    int e;
+
+    for (e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (PC.page[e]) {
+            munmap(PC.page[e], sysconf(_SC_PAGESIZE));
+            PC.page[e] = NULL;
+        }
+        if (PC.fd[e] >= 0) {
+            close(PC.fd[e]);
+            PC.fd[e] = -1;
+        }
+    }
+    PC.active = false;
+}
+
+void perf_counters_reset()
+{
+    memset(PC.total, 0, sizeof(PC.total));
+    memset(PC.calls, 0, sizeof(PC.calls));
+}
+
+void perf_region_begin(int region)
+{
+    int e;
+
+    if (!PC.active) {
+        return;
+    }
+    for (e = 0; e < PERF_NUM_EVENTS; e++) {
+        PC.start[region][e] = read_counter(e);
+    }
+}
+
+void perf_region_end(int region)
+{
+    uint_64 now[PERF_NUM_EVENTS];
+    int e;
+
+    if (!PC.active) {
+        return;
+    }
+    // read everything before doing any arithmetic so the bookkeeping is not counted
+    for (e = 0; e < PERF_NUM_EVENTS; e++) {
+        now[e] = read_counter(e);
+    }
+    for (e = 0; e < PERF_NUM_EVENTS; e++) {
+        PC.total[region][e] += now[e] - PC.start[region][e];
+    }
+    PC.calls[region]++;
+}
+
+// One line per region that was entered, with every event divided by the number of nodes in the run.  The rdpmc reads
+// themselves land inside the regions, so very short regions (a single TT probe) carry a few dozen cycles of overhead.
+void perf_counters_report(FILE *f, const char *label, uint_64 nodes)
+{
+    double *t;
+    int r;
+
+    if (!PC.active) {
+        return;
+    }
+    if (nodes == 0) {
+        nodes = 1;
+    }
+    fprintf(f, "%s - hardware counters per node (%lu nodes)\n", label, nodes);
+    fprintf(f, "%-10s %12s %10s %10s %6s %10s %10s %10s %10s\n", "region", "calls", "cycles", "instrs", "IPC",
+            "L1D miss", "LLC miss", "br miss", "dTLB miss");
+    for (r = 0; r < PERF_NUM_REGIONS; r++) {
+        double per_node[PERF_NUM_EVENTS];
+        int e;
+
+        if (!PC.calls[r]) {
+            continue;
+        }
+        for (e = 0; e < PERF_NUM_EVENTS; e++) {
+            per_node[e] = (double) PC.total[r][e] / nodes;
+        }
+        t = per_node;
+        fprintf(f, "%-10s %12lu %10.2f %10.2f %6.2f %10.4f %10.4f %10.4f %10.4f\n", region_names[r], PC.calls[r],
+                t[PERF_EVENT_CYCLES], t[PERF_EVENT_INSTRUCTIONS],
+                t[PERF_EVENT_CYCLES] > 0 ? t[PERF_EVENT_INSTRUCTIONS] / t[PERF_EVENT_CYCLES] : 0.0,
+                t[PERF_EVENT_L1D_MISSES], t[PERF_EVENT_LLC_MISSES], t[PERF_EVENT_BRANCH_MISSES], t[PERF_EVENT_DTLB_MISSES]);
+    }
+}
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "bitboard.h"
+
+// Optional hardware performance counters (Linux perf_event_open) around the hot paths.  Build with -DPERF_COUNTERS
+// (cmake -DPERF_COUNTERS=ON) to turn them on; otherwise every macro below compiles to nothing.
+//
+// The counters are opened for the calling thread only, so run perft with one thread when collecting them.  Regions
+// must not nest - the time spent in an inner region would also be charged to the outer one.
+
+enum perfRegion {
+    PERF_REGION_MOVEGEN = 0,
+    PERF_REGION_MAKE,
+    PERF_REGION_UNMAKE,
+    PERF_REGION_TT_PROBE,
+    PERF_REGION_TT_STORE,
+    PERF_REGION_KERNEL,     // whatever a benchmark kernel is timing
+    PERF_NUM_REGIONS
+};
+
+enum perfEvent {
+    PERF_EVENT_CYCLES = 0,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_L1D_MISSES,
+    PERF_EVENT_LLC_MISSES,
+    PERF_EVENT_BRANCH_MISSES,
+    PERF_EVENT_DTLB_MISSES,
+    PERF_NUM_EVENTS
+};
+
+#ifdef PERF_COUNTERS
+
+bool perf_counters_init();
+void perf_counters_destroy();
+void perf_counters_reset();
+void perf_counters_report(FILE *f, const char *label, uint_64 nodes);
+void perf_region_begin(int region);
+void perf_region_end(int region);
+
+#define PERF_COUNTERS_INIT() perf_counters_init()
+#define PERF_COUNTERS_DESTROY() perf_counters_destroy()
+#define PERF_COUNTERS_RESET() perf_counters_reset()
+#define PERF_COUNTERS_REPORT(f, label, nodes) perf_counters_report((f), (label), (nodes))
+#define PERF_REGION_BEGIN(region) perf_region_begin(region)
+#define PERF_REGION_END(region) perf_region_end(region)
+
+#else
+
+// a function rather than (false), so a bare PERF_COUNTERS_INIT(); is not a statement with no effect
+static inline bool perf_counters_init_stub() { return false; }
+#define PERF_COUNTERS_INIT() perf_counters_init_stub()
+#define PERF_COUNTERS_DESTROY()
+#define PERF_COUNTERS_RESET()
+#define PERF_COUNTERS_REPORT(f, label, nodes)
+#define PERF_REGION_BEGIN(region)
+#define PERF_REGION_END(region)
+
+#endif
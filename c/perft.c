@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "perft.h"
+#include "perf_counters.h"
+
+// If the root has fewer moves than this per thread, split one ply deeper so every thread has something to steal.
+#define PERFT_ITEMS_PER_THREAD 4
+
+// Each thread owns a contiguous slice of the work item array.  The owner takes items from the head, and a thread
+// whose slice has run dry steals from the tail of another thread's slice.  Items are whole subtrees, so the lock is
+// taken a few hundred times per perft at most and a mutex is plenty.
+typedef struct perftDeque {
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} perftDeque;
+
+typedef struct perftJob {
+    const struct bitChessBoard *root;
+    int depth;
+    int num_threads;
+    struct perftWorkItem *items;
+    int num_items;
+    struct perftDeque deques[MAX_PERFT_THREADS];
+} perftJob;
+
+typedef struct perftWorker {
+    pthread_t thread;
+    int id;
+    struct perftJob *job;
+    struct bitChessBoard board;  // each worker gets its own board, make/unmake mutates it
+    uint_64 nodes;               // per-thread counter, summed by the driver once all workers are joined
+} perftWorker;
+
+
+uint_64 perft_bb_nodes(struct bitChessBoard *pbb, int depth)
+{
+    struct bitMoveList ml;
+#ifdef COPY_MAKE
+    struct bitChessBoard child;  // the frames of the recursion are the per-ply board stack
+#else
+    struct bitChessBoardAttrs pa;
+#endif
+    uint_64 nodes = 0;
+    Move m;
+    int i;
+#ifndef DISABLE_HASH
+    bool hit;
+#endif
+
+    if (depth == 0) {
+        return 1;
+    }
+
+    // the perft cache is shared by all the threads of perft_bb_parallel(), its entries validate themselves so no locking is needed.
+    // Depth 1 is never cached, it is cheaper to generate the moves than to miss in the cache.
+#ifndef DISABLE_HASH
+    if (depth > 1) {
+        PERF_REGION_BEGIN(PERF_REGION_TT_PROBE);
+        hit = perft_cache_probe(pbb->hash, depth, &nodes);
+        PERF_REGION_END(PERF_REGION_TT_PROBE);
+        if (hit) {
+            return nodes;
+        }
+    }
+#endif
+
+    // bulk counting - the generator only produces legal moves, so the leaves do not need to be made
+    PERF_REGION_BEGIN(PERF_REGION_MOVEGEN);
+    generate_bb_move_list(pbb, &ml);
+    PERF_REGION_END(PERF_REGION_MOVEGEN);
+    if (depth == 1) {
+        return ml.size;
+    }
+
+    for (i = 0; i < ml.size; i++) {
+        PERF_REGION_BEGIN(PERF_REGION_MAKE);
+        m = expand_compact_move(pbb, ml.moves[i]);
+#ifdef COPY_MAKE
+        child = *pbb;
+        apply_bb_move(&child, m);
+        PERF_REGION_END(PERF_REGION_MAKE);
+        nodes += perft_bb_nodes(&child, depth - 1);
+#else
+        store_bb_attrs(pbb, &pa);
+        apply_bb_move(pbb, m);
+        PERF_REGION_END(PERF_REGION_MAKE);
+        nodes += perft_bb_nodes(pbb, depth - 1);
+        PERF_REGION_BEGIN(PERF_REGION_UNMAKE);
+        undo_bb_move(pbb, m, &pa);
+        PERF_REGION_END(PERF_REGION_UNMAKE);
+#endif
+    }
+
+#ifndef DISABLE_HASH
+    PERF_REGION_BEGIN(PERF_REGION_TT_STORE);
+    perft_cache_store(pbb->hash, depth, nodes);
+    PERF_REGION_END(PERF_REGION_TT_STORE);
+#endif
+    return nodes;
+}
+
+static int build_work_items(struct bitChessBoard *pbb, int depth, int num_threads, struct perftWorkItem *items)
+{
+    struct bitMoveList root_ml, child_ml;
+    struct bitChessBoardAttrs pa;
+    Move m;
+    int i, j;
+    int num_items = 0;
+
+    generate_bb_move_list(pbb, &root_ml);
+
+    if (root_ml.size >= num_threads * PERFT_ITEMS_PER_THREAD || depth <= 2) {
+        for (i = 0; i < root_ml.size; i++) {
+            items[num_items].path[0] = expand_compact_move(pbb, root_ml.moves[i]);
+            items[num_items].path_len = 1;
+            items[num_items].root_index = i;
+            items[num_items].nodes = 0;
+            num_items++;
+        }
+        return num_items;
+    }
+
+    // Too few root moves to keep every thread busy, so split at the second ply.  A root move with no replies
+    // contributes no leaves at depth > 1, so it simply produces no items.
+    for (i = 0; i < root_ml.size; i++) {
+        m = expand_compact_move(pbb, root_ml.moves[i]);
+        store_bb_attrs(pbb, &pa);
+        apply_bb_move(pbb, m);
+        generate_bb_move_list(pbb, &child_ml);
+        for (j = 0; j < child_ml.size; j++) {
+            items[num_items].path[0] = m;
+            items[num_items].path[1] = expand_compact_move(pbb, child_ml.moves[j]);
+            items[num_items].path_len = 2;
+            items[num_items].root_index = i;
+            items[num_items].nodes = 0;
+            num_items++;
+        }
+        undo_bb_move(pbb, m, &pa);
+    }
+    return num_items;
+}
+
+static int next_work_item(struct perftJob *job, int id)
+{
+    struct perftDeque *dq;
+    int i, victim;
+    int ret = -1;
+
+    dq = &job->deques[id];
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        ret = dq->head++;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    if (ret >= 0) {
+        return ret;
+    }
+
+    // our own slice is empty, so steal from the back of someone else's
+    for (i = 1; i < job->num_threads && ret < 0; i++) {
+        victim = (id + i) % job->num_threads;
+        dq = &job->deques[victim];
+        pthread_mutex_lock(&dq->lock);
+        if (dq->head < dq->tail) {
+            ret = --dq->tail;
+        }
+        pthread_mutex_unlock(&dq->lock);
+    }
+    return ret;
+}
+
+static void *perft_worker_main(void *arg)
+{
+    struct perftWorker *w = (struct perftWorker *) arg;
+    struct perftJob *job = w->job;
+    struct perftWorkItem *item;
+    int i, p;
+
+    while ((i = next_work_item(job, w->id)) >= 0) {
+        item = &job->items[i];
+        w->board = *job->root;
+        for (p = 0; p < item->path_len; p++) {
+            apply_bb_move(&w->board, item->path[p]);
+        }
+        item->nodes = perft_bb_nodes(&w->board, job->depth - item->path_len);
+        w->nodes += item->nodes;
+    }
+    return NULL;
+}
+
+static uint_64 perft_bb_divide_serial(struct bitChessBoard *pbb, int depth, struct bitMoveList *ml, uint_64 *root_nodes)
+{
+    struct bitChessBoardAttrs pa;
+    uint_64 total = 0;
+    Move m;
+    int i;
+
+    for (i = 0; i < ml->size; i++) {
+        m = expand_compact_move(pbb, ml->moves[i]);
+        store_bb_attrs(pbb, &pa);
+        apply_bb_move(pbb, m);
+        root_nodes[i] = perft_bb_nodes(pbb, depth - 1);
+        undo_bb_move(pbb, m, &pa);
+        total += root_nodes[i];
+    }
+    return total;
+}
+
+// Shared driver for perft_bb_parallel() and perft_bb_divide().  If root_nodes is not NULL it receives the leaf count
+// below each root move, in the order generate_bb_move_list() produces them.
+static uint_64 perft_bb_run(const struct bitChessBoard *pbb, int depth, int num_threads, uint_64 *root_nodes)
+{
+    struct bitChessBoard root;
+    struct perftJob job;
+    struct perftWorker *workers;
+    struct bitMoveList ml;
+    uint_64 total = 0;
+    int i;
+
+    if (depth <= 1 || num_threads <= 1) {
+        root = *pbb;
+        if (root_nodes && depth >= 1) {
+            generate_bb_move_list(&root, &ml);
+            return perft_bb_divide_serial(&root, depth, &ml, root_nodes);
+        }
+        return perft_bb_nodes(&root, depth);
+    }
+    if (num_threads > MAX_PERFT_THREADS) {
+        num_threads = MAX_PERFT_THREADS;
+    }
+
+    root = *pbb;
+    job.root = &root;
+    job.depth = depth;
+    job.num_threads = num_threads;
+    job.items = (struct perftWorkItem *) malloc(MAX_MOVELIST_SIZE * MAX_MOVELIST_SIZE * sizeof(struct perftWorkItem));
+    assert(job.items);  // TODO: Real error handling
+    job.num_items = build_work_items(&root, depth, num_threads, job.items);
+
+    for (i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&job.deques[i].lock, NULL);
+        job.deques[i].head = (job.num_items * i) / num_threads;
+        job.deques[i].tail = (job.num_items * (i + 1)) / num_threads;
+    }
+
+    workers = (struct perftWorker *) aligned_alloc(64, num_threads * sizeof(struct perftWorker));
+    assert(workers);
+    for (i = 0; i < num_threads; i++) {
+        workers[i].id = i;
+        workers[i].job = &job;
+        workers[i].nodes = 0;
+        pthread_create(&workers[i].thread, NULL, perft_worker_main, &workers[i]);
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].nodes;
+        pthread_mutex_destroy(&job.deques[i].lock);
+    }
+    if (root_nodes) {
+        generate_bb_move_list(&root, &ml);
+        for (i = 0; i < ml.size; i++) {
+            root_nodes[i] = 0;
+        }
+        for (i = 0; i < job.num_items; i++) {
+            root_nodes[job.items[i].root_index] += job.items[i].nodes;
+        }
+    }
+
+    free(workers);
+    free(job.items);
+    return total;
+}
+
+uint_64 perft_bb_parallel(const struct bitChessBoard *pbb, int depth, int num_threads)
+{
+    return perft_bb_run(pbb, depth, num_threads, NULL);
+}
+
+uint_64 perft_bb_divide(const struct bitChessBoard *pbb, int depth, int num_threads, struct bitMoveList *ml, uint_64 *root_nodes)
+{
+    struct bitChessBoard root;
+
+    assert(depth >= 1);
+    root = *pbb;
+    generate_bb_move_list(&root, ml);
+    return perft_bb_run(pbb, depth, num_threads, root_nodes);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include "bitboard.h"
+
+// Perft drivers for the bitboard move generator.  perft_bb_nodes() is the plain serial recursion, and
+// perft_bb_parallel() splits the tree near the root into work items that a pool of threads pull from.
+
+#define MAX_PERFT_THREADS 64
+#define MAX_PERFT_SPLIT_PLY 2
+
+// One unit of work for the parallel driver - the moves from the root that lead to the subtree, and the leaf
+// count of that subtree once a worker has searched it.
+typedef struct perftWorkItem {
+    Move path[MAX_PERFT_SPLIT_PLY];
+    int path_len;
+    int root_index;  // which root move this item descends from, so results can be grouped for a divide
+    uint_64 nodes;
+} perftWorkItem;
+
+uint_64 perft_bb_nodes(struct bitChessBoard *pbb, int depth);
+uint_64 perft_bb_parallel(const struct bitChessBoard *pbb, int depth, int num_threads);
+// Fills ml with the root moves and root_nodes[i] with the leaf count below ml->moves[i].  Returns the total.
+uint_64 perft_bb_divide(const struct bitChessBoard *pbb, int depth, int num_threads, struct bitMoveList *ml, uint_64 *root_nodes);
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "chess_constants.h"
+#include "bitboard.h"
+#include "slider_attacks.h"
+#include "hash.h"
+#include "perft.h"
+#include "perf_counters.h"
+
+// Standalone perft driver for the bitboard move generator.  Reads perft-suite EPD lines of the form
+//     FEN ;D1 20 ;D2 400 ;D3 8902
+// from a file or stdin and prints nodes, time and NPS for each position as JSON or CSV, so runs can be compared
+// from a script.  Exits non-zero if any position disagrees with the counts listed in its EPD line.
+
+#define PERFT_MAX_EPD_DEPTH 20
+#define PERFT_MAX_LINE 1024
+
+typedef enum perftFormat {
+    PERFT_FORMAT_JSON,
+    PERFT_FORMAT_CSV
+} perftFormat;
+
+typedef struct perftOptions {
+    int depth;       // 0 = deepest ;D entry on each line
+    bool divide;
+    int num_threads;
+    int hash_mb;     // 0 disables the perft cache
+    perftFormat format;
+} perftOptions;
+
+typedef struct epdPosition {
+    char fen[PERFT_MAX_LINE];
+    uint_64 expected[PERFT_MAX_EPD_DEPTH + 1];  // 0 where the line lists no count for that depth
+    int max_depth;
+} epdPosition;
+
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] [EPD file]\n", prog);
+    printf("Reads perft suite lines (FEN ;D1 20 ;D2 400 ...) from the file, or stdin if no file is given.\n\n");
+    printf("  --depth N      search N plies (default: the deepest ;D entry on each line)\n");
+    printf("  --divide       also report the leaf count below each root move\n");
+    printf("  --threads N    number of search threads (default 1)\n");
+    printf("  --hash MB      perft cache size, 0 disables it (default %d)\n", PERFT_CACHE_DEFAULT_MB);
+    printf("  --format F     json or csv (default json)\n");
+}
+
+static bool parse_epd_line(const char *line, struct epdPosition *pos)
+{
+    const char *p;
+    char *endp;
+    size_t len;
+    int depth;
+    uint_64 nodes;
+
+    memset(pos, 0, sizeof(struct epdPosition));
+    p = strchr(line, ';');
+    len = p ? (size_t)(p - line) : strlen(line);
+    while (len > 0 && isspace((unsigned char) line[len - 1])) {
+        len--;
+    }
+    if (len == 0 || len >= PERFT_MAX_LINE) {
+        return false;
+    }
+    memcpy(pos->fen, line, len);
+    pos->fen[len] = '\0';
+
+    while (p) {
+        p++;
+        while (isspace((unsigned char) *p)) {
+            p++;
+        }
+        if (*p == 'D') {
+            depth = (int) strtol(p + 1, &endp, 10);
+            nodes = strtoull(endp, &endp, 10);
+            if (depth >= 1 && depth <= PERFT_MAX_EPD_DEPTH) {
+                pos->expected[depth] = nodes;
+                if (depth > pos->max_depth) {
+                    pos->max_depth = depth;
+                }
+            }
+        }
+        p = strchr(p, ';');
+    }
+    return true;
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *stop)
+{
+    return (stop->tv_sec - start->tv_sec) * 1000.0 + (stop->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static bool run_position(const struct epdPosition *pos, const struct perftOptions *opts, bool *first)
+{
+    struct bitChessBoard *pbb;
+    struct bitMoveList ml;
+    struct timespec start, stop;
+    uint_64 root_nodes[MAX_MOVELIST_SIZE];
+    uint_64 nodes, expected;
+    double ms, nps;
+    int depth, i;
+    char move[6];
+    bool pass;
+    const char *result;
+
+    depth = opts->depth ? opts->depth : pos->max_depth;
+    if (depth <= 0) {
+        fprintf(stderr, "No depth for %s, give --depth or a ;D entry\n", pos->fen);
+        return false;
+    }
+
+    pbb = new_bitboard();
+    if (!load_bitboard_from_fen(pbb, pos->fen)) {
+        fprintf(stderr, "Invalid FEN %s\n", pos->fen);
+        free(pbb);
+        return false;
+    }
+
+    PERF_COUNTERS_RESET();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (opts->divide) {
+        nodes = perft_bb_divide(pbb, depth, opts->num_threads, &ml, root_nodes);
+    } else {
+        nodes = perft_bb_parallel(pbb, depth, opts->num_threads);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    PERF_COUNTERS_REPORT(stderr, pos->fen, nodes);
+
+    ms = elapsed_ms(&start, &stop);
+    nps = ms > 0 ? (nodes * 1000.0) / ms : 0;
+    expected = depth <= PERFT_MAX_EPD_DEPTH ? pos->expected[depth] : 0;
+    pass = (expected == 0 || nodes == expected);
+    result = expected == 0 ? "unchecked" : (pass ? "pass" : "fail");
+
+    if (opts->format == PERFT_FORMAT_JSON) {
+        printf("%s  {\"fen\": \"%s\", \"depth\": %d, \"nodes\": %lu, ", *first ? "" : ",\n", pos->fen, depth, nodes);
+        if (expected) {
+            printf("\"expected\": %lu, ", expected);
+        } else {
+            printf("\"expected\": null, ");
+        }
+        printf("\"result\": \"%s\", \"ms\": %.3f, \"nps\": %.0f", result, ms, nps);
+        if (opts->divide) {
+            printf(", \"divide\": [");
+            for (i = 0; i < ml.size; i++) {
+                bb_move_to_uci(expand_compact_move(pbb, ml.moves[i]), move);
+                printf("%s{\"move\": \"%s\", \"nodes\": %lu}", i ? ", " : "", move, root_nodes[i]);
+            }
+            printf("]");
+        }
+        printf("}");
+    } else {
+        if (opts->divide) {
+            for (i = 0; i < ml.size; i++) {
+                bb_move_to_uci(expand_compact_move(pbb, ml.moves[i]), move);
+                printf("\"%s\",%d,%s,%lu,,,,\n", pos->fen, depth, move, root_nodes[i]);
+            }
+        }
+        printf("\"%s\",%d,,%lu,", pos->fen, depth, nodes);
+        if (expected) {
+            printf("%lu", expected);
+        }
+        printf(",%s,%.3f,%.0f\n", result, ms, nps);
+    }
+    fflush(stdout);
+    free(pbb);
+    *first = false;
+
+    if (!pass) {
+        fprintf(stderr, "FAILED %s depth %d nodes %lu expected %lu\n", pos->fen, depth, nodes, expected);
+    }
+    return pass;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"depth",   required_argument, NULL, 'd'},
+        {"divide",  no_argument,       NULL, 'v'},
+        {"threads", required_argument, NULL, 't'},
+        {"hash",    required_argument, NULL, 'h'},
+        {"format",  required_argument, NULL, 'f'},
+        {"help",    no_argument,       NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+    struct perftOptions opts = {0, false, 1, PERFT_CACHE_DEFAULT_MB, PERFT_FORMAT_JSON};
+    struct epdPosition pos;
+    char line[PERFT_MAX_LINE];
+    FILE *in = stdin;
+    bool first = true;
+    int failures = 0;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'd':
+                opts.depth = atoi(optarg);
+                break;
+            case 'v':
+                opts.divide = true;
+                break;
+            case 't':
+                opts.num_threads = atoi(optarg);
+                break;
+            case 'h':
+                opts.hash_mb = atoi(optarg);
+                break;
+            case 'f':
+                if (!strcmp(optarg, "json")) {
+                    opts.format = PERFT_FORMAT_JSON;
+                } else if (!strcmp(optarg, "csv")) {
+                    opts.format = PERFT_FORMAT_CSV;
+                } else {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (opts.depth < 0 || opts.num_threads < 1 || opts.hash_mb < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (optind < argc && strcmp(argv[optind], "-")) {
+        in = fopen(argv[optind], "r");
+        if (!in) {
+            fprintf(stderr, "Could not open %s\n", argv[optind]);
+            return 2;
+        }
+    }
+
+#ifndef DISABLE_HASH
+    if (opts.hash_mb > 0) {
+        perft_cache_init(opts.hash_mb);
+    }
+#endif
+    // hardware counters only see the main thread
+    if (PERF_COUNTERS_INIT() && opts.num_threads > 1) {
+        fprintf(stderr, "Hardware counters only cover the main thread, use --threads 1\n");
+    }
+    // on stderr, so the CSV and JSON stay as they were - the NPS depends on which slider backend was built
+    fprintf(stderr, "slider backend %s\n", SLIDER_BACKEND_NAME);
+
+    if (opts.format == PERFT_FORMAT_JSON) {
+        printf("[\n");
+    } else {
+        printf("fen,depth,move,nodes,expected,result,ms,nps\n");
+    }
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || !parse_epd_line(line, &pos)) {
+            continue;
+        }
+        if (!run_position(&pos, &opts, &first)) {
+            failures++;
+        }
+    }
+    if (opts.format == PERFT_FORMAT_JSON) {
+        printf("%s]\n", first ? "" : "\n");
+    }
+
+    if (in != stdin) {
+        fclose(in);
+    }
+#ifndef DISABLE_HASH
+    perft_cache_destroy();
+#endif
+    PERF_COUNTERS_DESTROY();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "evaluate_board.h"
+#include "search.h"
+#include "move_picker.h"
+
+volatile bool SEARCH_STOP_REQUESTED = false;
+volatile bool SEARCH_PONDERING = false;
+
+long search_now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Only called every SEARCH_POLL_NODES nodes, reading the clock costs more than a node of search.
+static void check_time(struct searchState *ss)
+{
+    if (SEARCH_STOP_REQUESTED || (ss->abort && *ss->abort)) {
+        ss->stopped = true;
+        return;
+    }
+    if (ss->pondering) {
+        if (SEARCH_PONDERING) {
+            return;
+        }
+        // ponderhit - the opponent played the move we were pondering on, and our clock starts now
+        ss->pondering = false;
+        ss->start_ms = search_now_ms();
+    }
+    if (ss->hard_limit_ms && search_now_ms() - ss->start_ms >= ss->hard_limit_ms) {
+        ss->stopped = true;
+    }
+}
+
+// Any earlier position with the same side to move since the last capture or pawn move counts as a draw.  The Python
+// engine waits for a threefold repetition, but inside the tree the first repeat is enough - if it was good to go
+// back once it will be good to go back again.
+static inline bool is_repetition(const struct searchState *ss)
+{
+    uint_64 key = SEARCH_BOARD(ss)->hash;
+    int i, stop;
+
+    stop = ss->history_len - SEARCH_BOARD(ss)->halfmove_clock;
+    if (stop < 0) {
+        stop = 0;
+    }
+    for (i = ss->history_len - 2; i >= stop; i -= 2) {
+        if (ss->hash_history[i] == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Quiet moves that caused a cutoff, weighted by depth squared so cutoffs near the root count for more.  The table
+// is halved whenever an entry would pass SEARCH_HISTORY_MAX, keeping every history score below the killers.
+static inline void update_history(struct searchState *ss, int piece, int to, int depth)
+{
+    int p, sq;
+
+    ss->history[piece][to] += depth * depth;
+    if (ss->history[piece][to] > SEARCH_HISTORY_MAX) {
+        for (p = 0; p < 16; p++) {
+            for (sq = 0; sq < 64; sq++) {
+                ss->history[p][sq] /= 2;
+            }
+        }
+    }
+}
+
+int search_negamax(struct searchState *ss, int depth, int alpha, int beta)
+{
+    struct bitChessBoard *pbb = SEARCH_BOARD(ss);
+#ifndef COPY_MAKE
+    struct bitChessBoardAttrs pa;
+#endif
+    struct bitMoveList ml;
+    struct movePicker mp;
+    struct ttData td;
+    int original_alpha = alpha;
+    int best_score = -INFINITE_SCORE;
+    int mate_in_one_score = MATE_SCORE + (depth - 1);
+    int ply = ss->ply;
+    int score, bound, j, moves_searched = 0;
+    bool on_pv = ss->follow_pv;
+    Move m, pv_move = NULL_MOVE, tt_move = NULL_MOVE, best_move = NULL_MOVE;
+
+    ss->nodes++;
+    ss->pv_length[ply] = 0;
+    if ((ss->nodes & (SEARCH_POLL_NODES - 1)) == 0) {
+        check_time(ss);
+    }
+    if (ss->node_limit && ss->nodes >= ss->node_limit) {
+        ss->stopped = true;
+    }
+    if (ss->stopped) {
+        return 0;
+    }
+
+    if (ply > 0) {
+        // FIDE rule 9.6 - the game is drawn automatically after 75 moves without a capture or pawn move, and it is
+        // drawn once no sequence of moves could mate
+        if (pbb->halfmove_clock >= 150 || is_repetition(ss) || BB_IS_DEAD_DRAW(pbb)) {
+            return 0;
+        }
+    }
+
+    if (TT_probe_search(pbb->hash, &td)) {
+        tt_move = expand_compact_move(pbb, td.move);
+        if (ply > 0 && td.depth >= depth) {
+            // A mate stored from a deeper search was found with more depth remaining than we have here, so it is
+            // (td.depth - depth) plies further away from this node than the score says.  Same correction as chess.py.
+            score = td.score;
+            if (score <= -MATE_SCORE) {
+                score += (td.depth - depth);
+            } else if (score >= MATE_SCORE) {
+                score -= (td.depth - depth);
+            }
+            // Only cut off where the score lies outside the window.  A score inside it makes this a PV node, which is
+            // searched so the line below it reaches pv[] and bestmove still has a ponder move.
+            if ((td.bound != TT_BOUND_UPPER && score >= beta) || (td.bound != TT_BOUND_LOWER && score <= alpha)) {
+                return score;
+            }
+        }
+    }
+
+    if (depth <= 0 || ply >= MAX_SEARCH_PLY - 1) {
+        // generate the whole list at the leaves, so mate and stalemate are scored correctly there
+        generate_bb_move_list(pbb, &ml);
+        if (ml.size == 0) {
+            return pbb->in_check ? -MATE_SCORE - depth : 0;
+        }
+        return evaluate_bb_board(pbb);
+    }
+
+    // the previous iteration's PV is searched first, like best_known_line in chess.py
+    if (on_pv && ply < ss->prev_pv_length) {
+        pv_move = ss->prev_pv[ply];
+    }
+    move_picker_init(&mp, pbb, pv_move, tt_move, ss->killers[ply], (const int (*)[64]) ss->history);
+    ss->hash_history[ss->history_len++] = pbb->hash;
+
+    while ((m = move_picker_next(&mp)) != NULL_MOVE) {
+        moves_searched++;
+#ifdef COPY_MAKE
+        pbb[1] = *pbb;
+        apply_bb_move(pbb + 1, m);
+#else
+        store_bb_attrs(pbb, &pa);
+        apply_bb_move(pbb, m);
+#endif
+        ss->ply++;
+        ss->follow_pv = on_pv && SAME_BB_MOVE(m, pv_move);
+        score = -search_negamax(ss, depth - 1, -beta, -alpha);
+        ss->follow_pv = false;
+        ss->ply--;
+#ifndef COPY_MAKE
+        undo_bb_move(pbb, m, &pa);
+#endif
+
+        if (ss->stopped) {
+            // the score of an unfinished subtree means nothing, leave the PV and TT as they were
+            ss->history_len--;
+            return 0;
+        }
+
+        if (score > best_score) {
+            best_score = score;
+            best_move = m;
+        }
+        if (score > alpha) {
+            alpha = score;
+            ss->pv[ply][0] = m;
+            for (j = 0; j < ss->pv_length[ply + 1]; j++) {
+                ss->pv[ply][j + 1] = ss->pv[ply + 1][j];
+            }
+            ss->pv_length[ply] = ss->pv_length[ply + 1] + 1;
+        }
+        if (alpha >= beta) {
+            if (!GET_PIECE_CAPTURED(m) && !GET_PROMOTED_TO(m)) {
+                if (!SAME_BB_MOVE(m, ss->killers[ply][0])) {
+                    ss->killers[ply][1] = ss->killers[ply][0];
+                    ss->killers[ply][0] = m;
+                }
+                update_history(ss, BB_PIECE_ON(pbb, GET_START(m)), GET_END(m), depth);
+            }
+            break;
+        }
+        if (alpha >= mate_in_one_score) {
+            // will not do any better
+            break;
+        }
+    }
+    ss->history_len--;
+
+    if (moves_searched == 0) {
+        return pbb->in_check ? -MATE_SCORE - depth : 0;
+    }
+
+    if (best_score <= original_alpha) {
+        bound = TT_BOUND_UPPER;
+        best_move = NULL_MOVE;  // every move failed low, none of them is known to be best
+    } else if (best_score >= beta) {
+        bound = TT_BOUND_LOWER;
+    } else {
+        bound = TT_BOUND_EXACT;
+    }
+    TT_store_search(pbb->hash, COMPACT_MOVE(best_move), best_score, depth, bound);
+
+    return best_score;
+}
+
+// Sets the hard limit, after which the search is abandoned mid-iteration, and returns the soft limit, after which no
+// new iteration is started.  0 means no limit.
+static long allocate_time(const struct searchLimits *limits, int side_to_move, long *hard_ms)
+{
+    long time_left, inc, available, soft, cap;
+    int moves_to_go;
+
+    *hard_ms = 0;
+    if (limits->movetime) {
+        *hard_ms = limits->movetime > SEARCH_MOVE_OVERHEAD ? limits->movetime - SEARCH_MOVE_OVERHEAD : 1;
+        return 0;
+    }
+
+    time_left = (side_to_move == WHITE) ? limits->wtime : limits->btime;
+    inc = (side_to_move == WHITE) ? limits->winc : limits->binc;
+    if (time_left <= 0) {
+        return 0;
+    }
+
+    moves_to_go = limits->movestogo ? limits->movestogo : SEARCH_DEFAULT_MOVES_TO_GO;
+    available = time_left > SEARCH_MOVE_OVERHEAD ? time_left - SEARCH_MOVE_OVERHEAD : 1;
+    soft = available / moves_to_go + inc * 3 / 4;
+
+    // an iteration that overruns may take up to 4 times its share, but never more than half the clock unless this
+    // is the last move before the time control
+    cap = (moves_to_go == 1) ? available : available / 2;
+    *hard_ms = soft * 4 < cap ? soft * 4 : cap;
+    if (*hard_ms < 1) {
+        *hard_ms = 1;
+    }
+    return soft < *hard_ms ? soft : *hard_ms;
+}
+
+static struct searchState *new_search_state(const struct bitChessBoard *pbb, const uint_64 *game_history, int game_history_len, int thread_id)
+{
+    struct searchState *ss;
+    int i;
+
+    ss = (struct searchState *) aligned_alloc(64, sizeof(struct searchState));
+    assert(ss);  // TODO: Real error handling
+    ss->ply = 0;
+    *SEARCH_BOARD(ss) = *pbb;
+    ss->thread_id = thread_id;
+    ss->abort = NULL;
+    ss->nodes = 0;
+    ss->node_limit = 0;
+    ss->start_ms = search_now_ms();
+    ss->hard_limit_ms = 0;
+    ss->stopped = false;
+    ss->pondering = false;
+    ss->prev_pv_length = 0;
+    memset(ss->killers, 0, sizeof(ss->killers));
+    memset(ss->history, 0, sizeof(ss->history));
+
+    // only the last MAX_GAME_HISTORY positions can matter, anything older is past the 75 move rule anyway
+    if (game_history_len > MAX_GAME_HISTORY) {
+        game_history += game_history_len - MAX_GAME_HISTORY;
+        game_history_len = MAX_GAME_HISTORY;
+    }
+    ss->history_len = 0;
+    for (i = 0; game_history && i < game_history_len; i++) {
+        ss->hash_history[ss->history_len++] = game_history[i];
+    }
+    return ss;
+}
+
+static void save_prev_pv(struct searchState *ss)
+{
+    int i;
+
+    for (i = 0; i < ss->pv_length[0]; i++) {
+        ss->prev_pv[i] = ss->pv[0][i];
+    }
+    ss->prev_pv_length = ss->pv_length[0];
+}
+
+// Lazy SMP: a helper searches the same root as the main thread with nothing shared but the TT, and never reports.
+// Odd helpers start one ply deeper, so the threads are not all on the same iteration and the entries one stores
+// tend to be the ones another is about to need.  The main thread stops the helpers through ss->abort.
+static void *search_helper_main(void *arg)
+{
+    struct searchHelper *h = (struct searchHelper *) arg;
+    struct searchState *ss = h->ss;
+    int depth;
+
+    for (depth = 1 + (ss->thread_id & 1); depth <= h->max_depth; depth++) {
+        ss->follow_pv = true;
+        search_negamax(ss, depth, -INFINITE_SCORE, INFINITE_SCORE);
+        if (ss->stopped) {
+            break;
+        }
+        save_prev_pv(ss);
+    }
+    return NULL;
+}
+
+void search(const struct bitChessBoard *pbb, const uint_64 *game_history, int game_history_len, const struct searchLimits *limits, struct searchResult *result)
+{
+    struct searchState *ss;
+    struct searchResult iteration;
+    struct searchHelper helpers[MAX_SEARCH_THREADS];
+    struct bitMoveList ml;
+    volatile bool abort_helpers = false;
+    long soft_limit_ms, elapsed;
+    int max_depth, depth, score, i, num_helpers;
+    uint_64 pawn_probes, pawn_hits;
+
+    if (!SEARCH_TT) {
+        TT_init_search(TT_DEFAULT_MB);
+    }
+    TT_new_search();
+    pawn_hash_stats(&pawn_probes, &pawn_hits);
+
+    ss = new_search_state(pbb, game_history, game_history_len, 0);
+    ss->pondering = SEARCH_PONDERING;
+    soft_limit_ms = allocate_time(limits, pbb->side_to_move, &ss->hard_limit_ms);
+    ss->node_limit = limits->nodes;
+    max_depth = (limits->depth > 0 && limits->depth < MAX_SEARCH_PLY) ? limits->depth : MAX_SEARCH_PLY - 1;
+
+    num_helpers = limits->threads > MAX_SEARCH_THREADS ? MAX_SEARCH_THREADS - 1 : limits->threads - 1;
+    for (i = 0; i < num_helpers; i++) {
+        helpers[i].ss = new_search_state(pbb, game_history, game_history_len, i + 1);
+        helpers[i].ss->abort = &abort_helpers;
+        helpers[i].max_depth = max_depth;
+        if (pthread_create(&helpers[i].thread, NULL, search_helper_main, &helpers[i]) != 0) {
+            free(helpers[i].ss);
+            break;
+        }
+    }
+    num_helpers = i;
+
+    memset(result, 0, sizeof(struct searchResult));
+    for (depth = 1; depth <= max_depth; depth++) {
+        ss->follow_pv = true;
+        score = search_negamax(ss, depth, -INFINITE_SCORE, INFINITE_SCORE);
+        if (ss->stopped) {
+            break;
+        }
+
+        iteration.score = score;
+        iteration.depth = depth;
+        // the helpers' counters are read while they run, so this may be a few nodes behind
+        iteration.nodes = ss->nodes;
+        for (i = 0; i < num_helpers; i++) {
+            iteration.nodes += helpers[i].ss->nodes;
+        }
+        iteration.elapsed_ms = search_now_ms() - ss->start_ms;
+        iteration.pv_length = ss->pv_length[0];
+        for (i = 0; i < ss->pv_length[0]; i++) {
+            iteration.pv[i] = ss->pv[0][i];
+        }
+        save_prev_pv(ss);
+        iteration.best_move = iteration.pv_length ? iteration.pv[0] : NULL_MOVE;
+        *result = iteration;
+        if (limits->report) {
+            limits->report(result);
+        }
+
+        // no legal moves, or a forced mate that a deeper search will not change
+        if (iteration.pv_length == 0 || score >= MATE_SCORE) {
+            break;
+        }
+        check_time(ss);
+        if (ss->stopped) {
+            break;
+        }
+        // the next iteration will take several times as long as this one, don't start what we cannot finish
+        elapsed = search_now_ms() - ss->start_ms;
+        if (!ss->pondering && soft_limit_ms && elapsed >= soft_limit_ms / 2) {
+            break;
+        }
+    }
+
+    abort_helpers = true;
+    result->nodes = ss->nodes;
+    for (i = 0; i < num_helpers; i++) {
+        pthread_join(helpers[i].thread, NULL);
+        result->nodes += helpers[i].ss->nodes;
+        free(helpers[i].ss);
+    }
+
+    // stopped before even depth 1 finished - any legal move beats forfeiting on time
+    if (result->best_move == NULL_MOVE && result->depth == 0) {
+        generate_bb_move_list(SEARCH_BOARD(ss), &ml);
+        if (ml.size) {
+            result->best_move = expand_compact_move(SEARCH_BOARD(ss), ml.moves[0]);
+            result->pv[0] = result->best_move;
+            result->pv_length = 1;
+        }
+    }
+    result->elapsed_ms = search_now_ms() - ss->start_ms;
+    pawn_hash_stats(&result->pawn_hash_probes, &result->pawn_hash_hits);
+    result->pawn_hash_probes -= pawn_probes;
+    result->pawn_hash_hits -= pawn_hits;
+
+    free(ss);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "bitboard.h"
+
+// Negamax alpha-beta search on the bitboard representation.  Scores are in centipawns from the point of view of the
+// side to move.  Mates follow the Python engine: the side that is mated scores -100000 - depth, where depth is the
+// depth remaining when the mate was found, so a mate nearer the root scores further from zero.
+
+#define MATE_SCORE 100000
+#define INFINITE_SCORE 101000
+#define IS_MATE_SCORE(s) ((s) >= MATE_SCORE - MAX_SEARCH_PLY || (s) <= -(MATE_SCORE - MAX_SEARCH_PLY))
+
+#define MAX_SEARCH_PLY 128
+#define MAX_GAME_HISTORY 1024
+
+// Quiet moves are ordered by their history score, which is kept below this so that in the evasion stage of the move
+// picker they stay behind the killers.
+#define SEARCH_HISTORY_MAX 60000
+
+// Lazy SMP - the main thread plus up to MAX_SEARCH_THREADS - 1 helpers, sharing nothing but the TT.
+#define MAX_SEARCH_THREADS 64
+
+// The clock is read once every SEARCH_POLL_NODES nodes, it must be a power of 2.
+#define SEARCH_POLL_NODES 1024
+// Time held back on every move for the GUI and the operating system, in ms.
+#define SEARCH_MOVE_OVERHEAD 30
+// Moves we budget for when the time control does not say how many are left.
+#define SEARCH_DEFAULT_MOVES_TO_GO 30
+
+typedef struct searchResult {
+    Move best_move;
+    int score;
+    int depth;
+    uint_64 nodes;
+    long elapsed_ms;
+    int pv_length;
+    Move pv[MAX_SEARCH_PLY];
+    uint_64 pawn_hash_probes;   // the main thread's, the helpers have tables of their own
+    uint_64 pawn_hash_hits;
+} searchResult;
+
+// Called after each completed iteration, e.g. to print thinking output.
+typedef void (*searchReportFn)(const struct searchResult *sr);
+
+// Any combination may be given, the search stops at whichever limit it reaches first.  All zero means search until
+// SEARCH_STOP_REQUESTED is set or MAX_SEARCH_PLY is reached.
+typedef struct searchLimits {
+    int depth;
+    uint_64 nodes;
+    long movetime;      // exact time for this move, in ms
+    long wtime;         // clock time left, in ms
+    long btime;
+    long winc;
+    long binc;
+    int movestogo;      // 0 = the rest of the game
+    int threads;        // 0 or 1 = single threaded; the node limit applies to the main thread's nodes only
+    searchReportFn report;
+} searchLimits;
+
+// Everything one search mutates.  hash_history holds the keys of the game so far followed by the keys of the
+// positions on the current search path, for repetition detection.  prev_pv is the PV of the last finished iteration,
+// which the next iteration searches first.
+typedef struct searchState {
+#ifdef COPY_MAKE
+    struct bitChessBoard boards[MAX_SEARCH_PLY + 1];    // [ply] - each move is made on a copy of its parent
+#else
+    struct bitChessBoard board;     // made and unmade in place
+#endif
+    int thread_id;          // 0 = the main thread, which alone keeps time and reports
+    volatile bool *abort;   // set by the main thread to stop a helper, NULL for the main thread
+    uint_64 nodes;
+    uint_64 node_limit;
+    long start_ms;
+    long hard_limit_ms;
+    bool stopped;
+    bool pondering;     // no time limits apply until SEARCH_PONDERING is cleared
+    bool follow_pv;
+    int ply;
+    int history_len;
+    uint_64 hash_history[MAX_GAME_HISTORY + MAX_SEARCH_PLY];
+    Move killers[MAX_SEARCH_PLY][2];
+    int history[16][64];    // [piece][to square]
+    int pv_length[MAX_SEARCH_PLY];
+    Move pv[MAX_SEARCH_PLY][MAX_SEARCH_PLY];
+    int prev_pv_length;
+    Move prev_pv[MAX_SEARCH_PLY];
+} searchState;
+
+// The position at the ply being searched.
+#ifdef COPY_MAKE
+#define SEARCH_BOARD(ss) (&(ss)->boards[(ss)->ply])
+#else
+#define SEARCH_BOARD(ss) (&(ss)->board)
+#endif
+
+typedef struct searchHelper {
+    pthread_t thread;
+    struct searchState *ss;
+    int max_depth;
+} searchHelper;
+
+// Set from another thread to make the search return as soon as it next polls.
+extern volatile bool SEARCH_STOP_REQUESTED;
+// Set before starting a search to ignore the time limits; clearing it (ponderhit) starts the clock.
+extern volatile bool SEARCH_PONDERING;
+
+// game_history is the list of position keys before the root, oldest first, and may be NULL.
+void search(const struct bitChessBoard *pbb, const uint_64 *game_history, int game_history_len, const struct searchLimits *limits, struct searchResult *result);
+int search_negamax(struct searchState *ss, int depth, int alpha, int beta);
+long search_now_ms();
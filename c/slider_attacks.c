@@ -0,0 +1,28 @@
+#include <stdio.h>
+
+#include "slider_attacks.h"
+
+// The attack tables, and for FANCY_MAGIC and PEXT the per-square entries pointing into them, are const data the
+// build writes into generated_tables.c.  Only the backend's name and size live here.
+
+#if defined(SLIDER_MIN_MAGIC)
+
+const char *SLIDER_BACKEND_NAME = "MIN_MAGIC";
+const size_t SLIDER_TABLE_BYTES = (102400 + 5248) * sizeof(U64);
+
+#elif defined(SLIDER_PLAIN_MAGIC)
+
+const char *SLIDER_BACKEND_NAME = "PLAIN_MAGIC";
+const size_t SLIDER_TABLE_BYTES = 64 * ((1 << 12) + (1 << 9)) * sizeof(U64);
+
+#elif defined(SLIDER_PEXT)
+
+const char *SLIDER_BACKEND_NAME = "PEXT";
+const size_t SLIDER_TABLE_BYTES = (SLIDER_ROOK_ENTRIES + SLIDER_BISHOP_ENTRIES) * sizeof(U64);
+
+#else // SLIDER_FANCY_MAGIC
+
+const char *SLIDER_BACKEND_NAME = "FANCY_MAGIC";
+const size_t SLIDER_TABLE_BYTES = (SLIDER_ROOK_ENTRIES + SLIDER_BISHOP_ENTRIES) * sizeof(U64);
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+
+// Rook and bishop attacks.  Everything calls Rmagic(square, occupancy) and Bmagic(square, occupancy), whichever
+// backend the build was configured with (cmake -DSLIDER_BACKEND=...):
+//   MIN_MAGIC    magicmoves.c with MINIMIZE_MAGIC: variable shift, a pointer per square into 107,648 shared entries
+//                (841 KB).  The default.
+//   PLAIN_MAGIC  magicmoves.c without MINIMIZE_MAGIC: fixed shift into a 512 or 4096 entry table per square (2.3 MB),
+//                no pointer to chase.
+//   FANCY_MAGIC  the magics and table offsets of MIN_MAGIC, but mask, magic, pointer and shift for a square kept
+//                together in one 32 byte entry, so a lookup reads one cache line of metadata instead of four.
+//   PEXT         BMI2 pext of the occupancy under the square's mask indexes the same 107,648 entries directly.
+// bench reports the lookup throughput and latency and perft3 for the backend it was built with, build one tree per
+// backend to compare them on a host.
+//
+// The tables are built by the generate_tables step of the build and linked in as const data, nothing to initialize.
+
+#ifndef __64_BIT_INTEGER_DEFINED__
+#define __64_BIT_INTEGER_DEFINED__
+typedef unsigned long long U64;
+#endif
+
+#if !defined(SLIDER_MIN_MAGIC) && !defined(SLIDER_PLAIN_MAGIC) && !defined(SLIDER_FANCY_MAGIC) && !defined(SLIDER_PEXT)
+#define SLIDER_MIN_MAGIC
+#endif
+
+extern const char *SLIDER_BACKEND_NAME;
+extern const size_t SLIDER_TABLE_BYTES;
+
+#if defined(SLIDER_MIN_MAGIC) || defined(SLIDER_PLAIN_MAGIC)
+
+#include "magicmoves.h"
+
+#else
+
+#define SLIDER_ROOK_ENTRIES 102400
+#define SLIDER_BISHOP_ENTRIES 5248
+
+typedef struct sliderSquare {
+    U64 mask;           // relevant occupancy, the edges are left off
+    U64 magic;          // unused by PEXT
+    const U64 *attacks; // this square's slice of the shared table
+    unsigned int shift; // unused by PEXT
+} sliderSquare;
+
+// 32 byte entries, aligned so none straddles a cache line
+extern const sliderSquare slider_rook[64];
+extern const sliderSquare slider_bishop[64];
+
+#ifdef SLIDER_PEXT
+
+#ifndef __BMI2__
+#error SLIDER_BACKEND=PEXT needs BMI2, build with -march=haswell or later
+#endif
+#include <immintrin.h>
+
+static inline __attribute__((always_inline)) U64 Rmagic(const unsigned int square, const U64 occupancy)
+{
+    return slider_rook[square].attacks[_pext_u64(occupancy, slider_rook[square].mask)];
+}
+
+static inline __attribute__((always_inline)) U64 Bmagic(const unsigned int square, const U64 occupancy)
+{
+    return slider_bishop[square].attacks[_pext_u64(occupancy, slider_bishop[square].mask)];
+}
+
+#else
+
+static inline __attribute__((always_inline)) U64 Rmagic(const unsigned int square, const U64 occupancy)
+{
+    const sliderSquare *s = &slider_rook[square];
+    return s->attacks[((occupancy & s->mask) * s->magic) >> s->shift];
+}
+
+static inline __attribute__((always_inline)) U64 Bmagic(const unsigned int square, const U64 occupancy)
+{
+    const sliderSquare *s = &slider_bishop[square];
+    return s->attacks[((occupancy & s->mask) * s->magic) >> s->shift];
+}
+
+#endif // SLIDER_PEXT
+#endif // SLIDER_MIN_MAGIC || SLIDER_PLAIN_MAGIC
@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "table_memory.h"
+
+#define MAX_CLEAR_THREADS 64
+
+typedef struct clearSlice {
+    char *start;
+    size_t bytes;
+} clearSlice;
+
+
+void *table_alloc(size_t bytes)
+{
+    char *p, *aligned;
+    size_t head, tail;
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    bytes = (bytes + page_size - 1) & ~(page_size - 1);
+
+#ifdef MAP_HUGETLB
+    // explicit huge pages only work if the admin reserved some (vm.nr_hugepages), so failing here is normal
+    if (bytes % HUGE_PAGE_SIZE == 0) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            return p;
+        }
+    }
+#endif
+
+    // Over-map by one huge page and trim both ends so the table starts on a huge page boundary, otherwise
+    // transparent huge pages cannot back the first and last partial 2 MB of it.
+    p = mmap(NULL, bytes + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    aligned = (char *)(((uintptr_t) p + HUGE_PAGE_SIZE - 1) & ~((uintptr_t) HUGE_PAGE_SIZE - 1));
+    head = aligned - p;
+    tail = HUGE_PAGE_SIZE - head;
+    if (head) {
+        munmap(p, head);
+    }
+    if (tail) {
+        munmap(aligned + bytes, tail);
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+// bytes is the size that was asked of table_alloc(), munmap rounds it up to the page the same way table_alloc() did
+void table_free(void *p, size_t bytes)
+{
+    if (p) {
+        munmap(p, bytes);
+    }
+}
+
+static void *clear_slice(void *arg)
+{
+    struct clearSlice *cs = (struct clearSlice *) arg;
+    memset(cs->start, 0, cs->bytes);
+    return NULL;
+}
+
+void table_clear(void *p, size_t bytes, int num_threads)
+{
+    pthread_t threads[MAX_CLEAR_THREADS];
+    struct clearSlice slices[MAX_CLEAR_THREADS];
+    bool started[MAX_CLEAR_THREADS];
+    size_t per_thread;
+    int i;
+
+    if (num_threads <= 0) {
+        num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads > MAX_CLEAR_THREADS) {
+        num_threads = MAX_CLEAR_THREADS;
+    }
+    // not worth starting threads for less than a huge page each
+    if (num_threads <= 1 || bytes < (size_t) num_threads * HUGE_PAGE_SIZE) {
+        memset(p, 0, bytes);
+        return;
+    }
+
+    // slice on huge page boundaries so two threads never fault in the same page
+    per_thread = ((bytes / num_threads) + HUGE_PAGE_SIZE - 1) & ~((size_t) HUGE_PAGE_SIZE - 1);
+    for (i = 0; i < num_threads; i++) {
+        slices[i].start = (char *) p + (size_t) i * per_thread;
+        if ((size_t) i * per_thread >= bytes) {
+            slices[i].bytes = 0;
+        } else if ((size_t)(i + 1) * per_thread > bytes) {
+            slices[i].bytes = bytes - (size_t) i * per_thread;
+        } else {
+            slices[i].bytes = per_thread;
+        }
+        // a slice without a thread of its own is cleared here
+        started[i] = pthread_create(&threads[i], NULL, clear_slice, &slices[i]) == 0;
+        if (!started[i]) {
+            clear_slice(&slices[i]);
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
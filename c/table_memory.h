@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+
+// Memory for the big hash tables.  Tables come straight from anonymous mmap, aligned to a huge page and backed by
+// huge pages when the OS will give them to us, which cuts TLB misses on random probes.  Fresh mappings are already
+// zero, and the kernel hands pages over as they are first touched, so allocating a table costs almost nothing up front.
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+void *table_alloc(size_t bytes);
+void table_free(void *p, size_t bytes);
+void table_clear(void *p, size_t bytes, int num_threads);
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+
+#include "chess_constants.h"
+#include "chessmove.h"
+#include "bitboard.h"
+#include "hash.h"
+#include "search.h"
+
+// Time-to-depth harness for the Lazy SMP search.  Searches every position to a fixed depth once per thread count,
+// clearing the TT in between so each run starts cold, and prints the time and nodes per position plus each thread
+// count's total time and its speedup over the first count in the list.  Positions come from a file of FENs or EPD
+// lines (anything after the first ';' is ignored), or from the built-in set below.
+
+#define TTD_MAX_LINE 1024
+#define TTD_MAX_POSITIONS 256
+#define TTD_MAX_THREAD_COUNTS 16
+#define TTD_DEFAULT_DEPTH 8
+#define TTD_DEFAULT_HASH_MB 64
+
+typedef enum ttdFormat {
+    TTD_FORMAT_JSON,
+    TTD_FORMAT_CSV
+} ttdFormat;
+
+typedef struct ttdOptions {
+    int depth;
+    int hash_mb;
+    int thread_counts[TTD_MAX_THREAD_COUNTS];
+    int num_thread_counts;
+    ttdFormat format;
+} ttdOptions;
+
+// The opening, the perft suite's middlegames and a few quieter middlegame and endgame positions.
+static const char *DEFAULT_POSITIONS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "2r2rk1/pp3ppp/2n1pn2/q2p4/3P4/P1PBPN2/5PPP/R2Q1RK1 b - - 0 14",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options] [FEN/EPD file]\n", prog);
+    printf("Searches each position to a fixed depth with each thread count and reports the speedup.\n\n");
+    printf("  --depth N       search depth (default %d)\n", TTD_DEFAULT_DEPTH);
+    printf("  --threads LIST  comma separated thread counts (default 1,2,4,8,16)\n");
+    printf("  --hash MB       transposition table size (default %d)\n", TTD_DEFAULT_HASH_MB);
+    printf("  --format F      json or csv (default json)\n");
+}
+
+static bool parse_thread_counts(const char *s, struct ttdOptions *opts)
+{
+    char *endp;
+    long n;
+
+    opts->num_thread_counts = 0;
+    while (*s) {
+        n = strtol(s, &endp, 10);
+        if (endp == s || n < 1 || n > MAX_SEARCH_THREADS || opts->num_thread_counts == TTD_MAX_THREAD_COUNTS) {
+            return false;
+        }
+        opts->thread_counts[opts->num_thread_counts++] = (int) n;
+        s = (*endp == ',') ? endp + 1 : endp;
+        if (*endp && *endp != ',') {
+            return false;
+        }
+    }
+    return opts->num_thread_counts > 0;
+}
+
+static int read_positions(FILE *in, char **fens)
+{
+    char line[TTD_MAX_LINE];
+    size_t len;
+    int n = 0;
+
+    while (n < TTD_MAX_POSITIONS && fgets(line, sizeof(line), in)) {
+        line[strcspn(line, ";\r\n")] = '\0';
+        len = strlen(line);
+        while (len > 0 && isspace((unsigned char) line[len - 1])) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        fens[n] = strdup(line);
+        n++;
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"depth",   required_argument, NULL, 'd'},
+        {"threads", required_argument, NULL, 't'},
+        {"hash",    required_argument, NULL, 'h'},
+        {"format",  required_argument, NULL, 'f'},
+        {"help",    no_argument,       NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+    struct ttdOptions opts = {TTD_DEFAULT_DEPTH, TTD_DEFAULT_HASH_MB, {1, 2, 4, 8, 16}, 5, TTD_FORMAT_JSON};
+    struct bitChessBoard *pbb;
+    struct searchLimits limits = {0};
+    struct searchResult sr;
+    char *fens[TTD_MAX_POSITIONS];
+    char move[6];
+    FILE *in;
+    long total_ms, baseline_ms = 0;
+    uint_64 total_nodes;
+    int num_positions, t, p, c;
+    bool first = true;
+
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'd':
+                opts.depth = atoi(optarg);
+                break;
+            case 't':
+                if (!parse_thread_counts(optarg, &opts)) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'h':
+                opts.hash_mb = atoi(optarg);
+                break;
+            case 'f':
+                if (!strcmp(optarg, "json")) {
+                    opts.format = TTD_FORMAT_JSON;
+                } else if (!strcmp(optarg, "csv")) {
+                    opts.format = TTD_FORMAT_CSV;
+                } else {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (opts.depth < 1 || opts.depth >= MAX_SEARCH_PLY || opts.hash_mb < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (optind < argc) {
+        in = strcmp(argv[optind], "-") ? fopen(argv[optind], "r") : stdin;
+        if (!in) {
+            fprintf(stderr, "Could not open %s\n", argv[optind]);
+            return 2;
+        }
+        num_positions = read_positions(in, fens);
+        if (in != stdin) {
+            fclose(in);
+        }
+    } else {
+        num_positions = sizeof(DEFAULT_POSITIONS) / sizeof(DEFAULT_POSITIONS[0]);
+        for (p = 0; p < num_positions; p++) {
+            fens[p] = strdup(DEFAULT_POSITIONS[p]);
+        }
+    }
+
+    TT_init_search(opts.hash_mb);
+    pbb = new_bitboard();
+
+    if (opts.format == TTD_FORMAT_JSON) {
+        printf("[\n");
+    } else {
+        printf("threads,fen,depth,move,score,nodes,ms,speedup\n");
+    }
+    for (t = 0; t < opts.num_thread_counts; t++) {
+        total_ms = 0;
+        total_nodes = 0;
+        for (p = 0; p < num_positions; p++) {
+            if (!load_bitboard_from_fen(pbb, fens[p])) {
+                fprintf(stderr, "Invalid FEN %s\n", fens[p]);
+                continue;
+            }
+            TT_clear_search();
+            limits.depth = opts.depth;
+            limits.threads = opts.thread_counts[t];
+            search(pbb, NULL, 0, &limits, &sr);
+            total_ms += sr.elapsed_ms;
+            total_nodes += sr.nodes;
+
+            bb_move_to_uci(sr.best_move, move);
+            if (opts.format == TTD_FORMAT_JSON) {
+                printf("%s  {\"threads\": %d, \"fen\": \"%s\", \"depth\": %d, \"move\": \"%s\", \"score\": %d, \"nodes\": %lu, \"ms\": %ld}",
+                       first ? "" : ",\n", opts.thread_counts[t], fens[p], sr.depth, move, sr.score, sr.nodes, sr.elapsed_ms);
+            } else {
+                printf("%d,\"%s\",%d,%s,%d,%lu,%ld,\n", opts.thread_counts[t], fens[p], sr.depth, move, sr.score, sr.nodes, sr.elapsed_ms);
+            }
+            first = false;
+            fflush(stdout);
+        }
+
+        if (t == 0) {
+            baseline_ms = total_ms;
+        }
+        if (opts.format == TTD_FORMAT_JSON) {
+            printf("%s  {\"threads\": %d, \"total_nodes\": %lu, \"total_ms\": %ld, \"speedup\": %.2f}",
+                   first ? "" : ",\n", opts.thread_counts[t], total_nodes, total_ms, total_ms ? (double) baseline_ms / total_ms : 0.0);
+        } else {
+            printf("%d,total,%d,,,%lu,%ld,%.2f\n", opts.thread_counts[t], opts.depth, total_nodes, total_ms,
+                   total_ms ? (double) baseline_ms / total_ms : 0.0);
+        }
+        first = false;
+        fflush(stdout);
+    }
+    if (opts.format == TTD_FORMAT_JSON) {
+        printf("%s]\n", first ? "" : "\n");
+    }
+
+    for (p = 0; p < num_positions; p++) {
+        free(fens[p]);
+    }
+    free(pbb);
+    TT_destroy_search();
+    return 0;
+}